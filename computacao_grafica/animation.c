@@ -0,0 +1,343 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "instance.h"
+#include "jobs.h"
+#include "animation.h"
+
+/**
+ * Acima desse cosseno entre duas chaves, slerp vira nlerp: o seno do ângulo
+ * é pequeno demais para dividir
+ */
+#define SLERP_THRESHOLD	.9995f
+
+/**
+ * Quaternion de uma rotação
+ *
+ * Com o mesmo ângulo, a matriz de mat4x4_from_quat gira no sentido oposto ao
+ * de mat4x4_rotate_X, _Y e _Z.
+ *
+ * @param axis Eixo unitário
+ * @param angle Ângulo, em radianos
+ */
+void axisAngleRotation(quat q, vec3 axis, float angle)
+{
+	float s = sinf(.5f*angle);
+
+	q[0] = s*axis[0];
+	q[1] = s*axis[1];
+	q[2] = s*axis[2];
+	q[3] = cosf(.5f*angle);
+}
+
+/**
+ * Cria uma trilha com as amostras de uma animação em intervalos fixos
+ *
+ * Uma trilha repetida tem um número inteiro de chaves no período: a taxa é
+ * ajustada para isso, e a chave seguinte à última é a primeira. Uma trilha
+ * não repetida termina com uma chave em duration. As rotações entre chaves
+ * usam nlerp; com chaves distantes, slerp pode ser ligado na trilha.
+ *
+ * @param duration Duração, ou período, em segundos
+ * @param rate Chaves por segundo, aproximadamente
+ * @param sample Amostra a animação em um instante
+ * @return 0 em caso de sucesso
+ */
+int bakeAnimationTrack(AnimationTrack *t, float duration, float rate,
+		       GLboolean loop, TrackSampler sample, void *arg)
+{
+	uint i, n;
+
+	assert(NULL != t);
+	assert(duration > 0.f && rate > 0.f);
+	assert(NULL != sample);
+
+	memset(t, 0, sizeof(*t));
+	if ( loop ) {
+		n = (uint) (duration*rate + .5f);
+		if ( 0 == n )
+			n = 1;
+		t->rate = n/duration;
+	} else {
+		n = (uint) ceilf(duration*rate) + 1;
+		t->rate = (n - 1)/duration;
+	}
+
+	t->translation = malloc(n*sizeof(*t->translation));
+	t->rotation = malloc(n*sizeof(*t->rotation));
+	t->scale = malloc(n*sizeof(*t->scale));
+	if ( NULL == t->translation || NULL == t->rotation || NULL == t->scale ) {
+		printf("Incapaz de alocar as %u chaves da trilha\n", n);
+		releaseAnimationTrack(t);
+		return -1;
+	}
+
+	for (i = 0; i < n; ++i) {
+		sample(arg, i/t->rate, t->translation[i], t->rotation[i],
+		       t->scale[i]);
+		quat_norm(t->rotation[i], t->rotation[i]);
+	}
+	t->keyCount = n;
+	t->loop = loop;
+	t->slerp = GL_FALSE;
+	return 0;
+}
+
+void releaseAnimationTrack(AnimationTrack *t)
+{
+	assert(NULL != t);
+
+	free(t->translation);
+	free(t->rotation);
+	free(t->scale);
+	memset(t, 0, sizeof(*t));
+}
+
+/**
+ * Prepara um conjunto de objetos animados
+ *
+ * As trilhas não são copiadas, e devem continuar válidas enquanto o conjunto
+ * for usado.
+ *
+ * @param count Quantidade de objetos, definidos com bindAnimation
+ */
+void initAnimationSet(AnimationSet *set, AnimationTrack *tracks,
+		      uint trackCount, uint count)
+{
+	uint i;
+
+	assert(NULL != set);
+	assert(NULL != tracks || 0 == trackCount);
+
+	memset(set, 0, sizeof(*set));
+	set->tracks = tracks;
+	set->trackCount = trackCount;
+	set->objects = calloc(count, sizeof(*set->objects));
+	set->count = count;
+	for (i = 0; i < count; ++i)
+		mat4x4_identity(set->objects[i].rest);
+}
+
+/**
+ * Define o objeto animado na posição position
+ *
+ * A matriz da instância passa a ser rest multiplicada pela da trilha.
+ *
+ * @param offset Atraso da trilha, em segundos
+ */
+void bindAnimation(AnimationSet *set, uint position, uint instance,
+		   uint track, float offset, mat4x4 rest)
+{
+	AnimatedInstance *o;
+
+	assert(NULL != set);
+	assert(position < set->count);
+	assert(track < set->trackCount);
+
+	o = &set->objects[position];
+	o->instance = instance;
+	o->track = track;
+	o->offset = offset;
+	mat4x4_dup(o->rest, rest);
+}
+
+/**
+ * Encontra as chaves em volta de um instante
+ *
+ * @param f Recebe a posição entre as chaves k0 e k1, de 0 a 1
+ */
+static void findKeys(const AnimationTrack *t, double time, uint *k0, uint *k1,
+		     float *f)
+{
+	double u = time*t->rate;
+	uint last = t->keyCount - 1;
+
+	*f = 0.f;
+	if ( t->keyCount < 2 ) {
+		*k0 = *k1 = 0;
+		return;
+	}
+
+	if ( t->loop ) {
+		u = fmod(u, t->keyCount);
+		if ( u < 0. )
+			u += t->keyCount;
+		*k0 = (uint) u;
+		if ( *k0 > last )
+			*k0 = last;
+		*k1 = *k0 == last ? 0 : *k0 + 1;
+	} else {
+		if ( u <= 0. ) {
+			*k0 = *k1 = 0;
+			return;
+		}
+		if ( u >= last ) {
+			*k0 = *k1 = last;
+			return;
+		}
+		*k0 = (uint) u;
+		*k1 = *k0 + 1;
+	}
+	*f = (float) (u - *k0);
+}
+
+/**
+ * Avalia até ANIMATION_BATCH objetos seguidos
+ *
+ * Somente a busca das chaves e a escrita das matrizes são feitas objeto por
+ * objeto. As interpolações e a montagem das matrizes trabalham com um valor
+ * de cada objeto por vez, em laços que o compilador transforma em instruções
+ * vetoriais. Posições sem objeto repetem o primeiro, e não são escritas.
+ *
+ * @param lanes Quantidade de objetos
+ */
+static void evaluateBatch(AnimationSet *set, uint first, uint lanes)
+{
+	float f[ANIMATION_BATCH], wa[ANIMATION_BATCH], wb[ANIMATION_BATCH];
+	float d[ANIMATION_BATCH], slerp[ANIMATION_BATCH];
+	float ta[3][ANIMATION_BATCH], tb[3][ANIMATION_BATCH];
+	float sa[3][ANIMATION_BATCH], sb[3][ANIMATION_BATCH];
+	float qa[4][ANIMATION_BATCH], qb[4][ANIMATION_BATCH];
+	float m[4][4][ANIMATION_BATCH];
+	uint l, c;
+
+	for (l = 0; l < ANIMATION_BATCH; ++l) {
+		const AnimatedInstance *o = &set->objects[first + (l < lanes ? l : 0)];
+		const AnimationTrack *t = &set->tracks[o->track];
+		uint k0, k1;
+
+		findKeys(t, set->time + o->offset, &k0, &k1, &f[l]);
+		slerp[l] = t->slerp ? 1.f : 0.f;
+		for (c = 0; c < 3; ++c) {
+			ta[c][l] = t->translation[k0][c];
+			tb[c][l] = t->translation[k1][c];
+			sa[c][l] = t->scale[k0][c];
+			sb[c][l] = t->scale[k1][c];
+		}
+		for (c = 0; c < 4; ++c) {
+			qa[c][l] = t->rotation[k0][c];
+			qb[c][l] = t->rotation[k1][c];
+		}
+	}
+
+	// q e -q são a mesma rotação: o sinal escolhe o caminho mais curto
+	for (l = 0; l < ANIMATION_BATCH; ++l)
+		d[l] = qa[0][l]*qb[0][l] + qa[1][l]*qb[1][l] + qa[2][l]*qb[2][l] +
+		       qa[3][l]*qb[3][l];
+	for (l = 0; l < ANIMATION_BATCH; ++l) {
+		float sign = d[l] < 0.f ? -1.f : 1.f;
+
+		d[l] *= sign;
+		wa[l] = 1.f - f[l];
+		wb[l] = sign*f[l];
+	}
+	for (l = 0; l < ANIMATION_BATCH; ++l) {
+		float theta, s;
+
+		if ( 0.f == slerp[l] || d[l] > SLERP_THRESHOLD )
+			continue;
+		theta = acosf(d[l]);
+		s = wb[l] < 0.f ? -1.f : 1.f;
+		wa[l] = sinf((1.f - f[l])*theta)/sinf(theta);
+		wb[l] = s*sinf(f[l]*theta)/sinf(theta);
+	}
+
+	// nlerp; com os pesos de slerp, somente corrige o arredondamento
+	for (c = 0; c < 4; ++c)
+		for (l = 0; l < ANIMATION_BATCH; ++l)
+			qa[c][l] = wa[l]*qa[c][l] + wb[l]*qb[c][l];
+	for (l = 0; l < ANIMATION_BATCH; ++l)
+		d[l] = 1.f/sqrtf(qa[0][l]*qa[0][l] + qa[1][l]*qa[1][l] +
+				 qa[2][l]*qa[2][l] + qa[3][l]*qa[3][l]);
+	for (c = 0; c < 4; ++c)
+		for (l = 0; l < ANIMATION_BATCH; ++l)
+			qa[c][l] *= d[l];
+	for (c = 0; c < 3; ++c)
+		for (l = 0; l < ANIMATION_BATCH; ++l) {
+			ta[c][l] += f[l]*(tb[c][l] - ta[c][l]);
+			sa[c][l] += f[l]*(sb[c][l] - sa[c][l]);
+		}
+
+	// Translação * rotação * escala, com a rotação de mat4x4_from_quat
+	for (l = 0; l < ANIMATION_BATCH; ++l) {
+		float x = qa[0][l], y = qa[1][l], z = qa[2][l], w = qa[3][l];
+
+		m[0][0][l] = sa[0][l]*(w*w + x*x - y*y - z*z);
+		m[0][1][l] = sa[0][l]*2.f*(x*y + w*z);
+		m[0][2][l] = sa[0][l]*2.f*(x*z - w*y);
+		m[0][3][l] = 0.f;
+		m[1][0][l] = sa[1][l]*2.f*(x*y - w*z);
+		m[1][1][l] = sa[1][l]*(w*w - x*x + y*y - z*z);
+		m[1][2][l] = sa[1][l]*2.f*(y*z + w*x);
+		m[1][3][l] = 0.f;
+		m[2][0][l] = sa[2][l]*2.f*(x*z + w*y);
+		m[2][1][l] = sa[2][l]*2.f*(y*z - w*x);
+		m[2][2][l] = sa[2][l]*(w*w - x*x - y*y + z*z);
+		m[2][3][l] = 0.f;
+		m[3][0][l] = ta[0][l];
+		m[3][1][l] = ta[1][l];
+		m[3][2][l] = ta[2][l];
+		m[3][3][l] = 1.f;
+	}
+
+	for (l = 0; l < lanes; ++l) {
+		AnimatedInstance *o = &set->objects[first + l];
+		mat4x4 *out = getInstanceTransformation(set->inst, o->instance,
+							set->instanceCount);
+		mat4x4 trs;
+		uint r;
+
+		for (c = 0; c < 4; ++c)
+			for (r = 0; r < 4; ++r)
+				trs[c][r] = m[c][r][l];
+		mat4x4_mul(*out, o->rest, trs);
+	}
+}
+
+/**
+ * Avalia um intervalo de objetos, ANIMATION_BATCH por vez
+ */
+static void animate(void *arg, uint first, uint count)
+{
+	AnimationSet *set = arg;
+	uint n;
+
+	for (n = first; n < first + count; n += ANIMATION_BATCH)
+		evaluateBatch(set, n, first + count - n < ANIMATION_BATCH ?
+				      first + count - n : ANIMATION_BATCH);
+}
+
+/**
+ * Escreve nas instâncias as matrizes dos objetos animados em um instante
+ *
+ * Instâncias sem animação não mudam.
+ *
+ * @param time Instante, em segundos
+ * @param jobs Sistema de trabalhos. Se NULL, os objetos são avaliados na hora
+ * @param done Contador dos trabalhos. O conjunto e as instâncias não podem
+ *             ser usados até o grupo terminar
+ */
+void evaluateAnimations(AnimationSet *set, double time, Instance *inst,
+			uint instanceCount, JobSystem *jobs, JobCounter *done)
+{
+	assert(NULL != set);
+	assert(NULL != inst || 0 == set->count);
+
+	set->time = time;
+	set->inst = inst;
+	set->instanceCount = instanceCount;
+	parallelFor(jobs, animate, set, set->count, ANIMATION_GRAIN, done, NULL);
+}
+
+void releaseAnimationSet(AnimationSet *set)
+{
+	assert(NULL != set);
+
+	free(set->objects);
+	memset(set, 0, sizeof(*set));
+}
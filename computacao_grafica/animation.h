@@ -0,0 +1,93 @@
+#ifndef __ANIMATION_H
+#define __ANIMATION_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+# include "instance.h"
+# include "jobs.h"
+
+/**
+ * Objetos avaliados juntos, um por posição dos vetores do processador
+ */
+#define ANIMATION_BATCH	8
+/**
+ * Objetos animados por trabalho. Múltiplo de ANIMATION_BATCH
+ */
+#define ANIMATION_GRAIN	(32*ANIMATION_BATCH)
+
+/**
+ * @brief Translação, rotação e escala de uma trilha no instante time
+ *
+ * @param arg Argumento dado a bakeAnimationTrack
+ * @param rotation Quaternion unitário
+ */
+typedef void (*TrackSampler)(void *arg, float time, vec3 translation,
+			     quat rotation, vec3 scale);
+
+/**
+ * @brief Chaves de translação, rotação e escala em intervalos fixos
+ *
+ * Com as chaves igualmente espaçadas, a chave de um instante é encontrada
+ * sem busca: o custo de avaliar uma trilha não depende do seu tamanho.
+ */
+typedef struct AnimationTrack
+{
+	float		rate;		/**< chaves por segundo */
+	uint		keyCount;
+	GLboolean	loop;		/**< se a última chave volta à primeira */
+	GLboolean	slerp;		/**< rotações com slerp. Senão, nlerp */
+	vec3		*translation;	/**< keyCount chaves */
+	quat		*rotation;
+	vec3		*scale;
+} AnimationTrack;
+
+/**
+ * @brief Uma instância movida por uma trilha
+ */
+typedef struct AnimatedInstance
+{
+	uint		instance;	/**< posição da instância */
+	uint		track;		/**< posição da trilha em AnimationSet.tracks */
+	float		offset;		/**< atraso da trilha, em segundos */
+	mat4x4		rest;		/**< matriz aplicada antes da trilha */
+} AnimatedInstance;
+
+/**
+ * @brief Instâncias animadas, avaliadas juntas
+ *
+ * A matriz de cada instância vem somente do instante: nada é acumulado de um
+ * passo para o outro, e o resultado de um instante não depende dos passos
+ * anteriores.
+ */
+typedef struct AnimationSet
+{
+	AnimationTrack		*tracks;
+	uint			trackCount;
+	AnimatedInstance	*objects;
+	uint			count;		/**< objetos animados */
+	double			time;		/**< instante sendo avaliado */
+	Instance		*inst;		/**< recebe as matrizes */
+	uint			instanceCount;
+} AnimationSet;
+
+void axisAngleRotation(quat q, vec3 axis, float angle);
+
+int bakeAnimationTrack(AnimationTrack *t, float duration, float rate,
+		       GLboolean loop, TrackSampler sample, void *arg);
+
+void releaseAnimationTrack(AnimationTrack *t);
+
+void initAnimationSet(AnimationSet *set, AnimationTrack *tracks,
+		      uint trackCount, uint count);
+
+void bindAnimation(AnimationSet *set, uint position, uint instance,
+		   uint track, float offset, mat4x4 rest);
+
+void evaluateAnimations(AnimationSet *set, double time, Instance *inst,
+			uint instanceCount, JobSystem *jobs, JobCounter *done);
+
+void releaseAnimationSet(AnimationSet *set);
+
+#endif
@@ -0,0 +1,270 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "quantize.h"
+#include "codec.h"
+
+/**
+ * Quantidade de valores decodificados de uma vez. Múltiplo de 3 e de 8
+ */
+#define CODEC_BATCH	48
+
+static uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+	return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+}
+
+/**
+ * Grava um inteiro em 7 bits por byte. O bit mais alto indica continuação
+ */
+static unsigned char* putVarint(unsigned char *out, uint32_t v)
+{
+	while ( v >= 0x80 ) {
+		*out++ = (unsigned char) (v | 0x80);
+		v >>= 7;
+	}
+	*out++ = (unsigned char) v;
+	return out;
+}
+
+/**
+ * Lê n inteiros gravados por putVarint, já convertidos de zigzag
+ *
+ * Valores pequenos ocupam um byte. Quando os próximos 8 bytes são todos
+ * valores de um byte, o que é verificado com uma única leitura de 64 bits,
+ * eles são convertidos sem os testes de continuação.
+ *
+ * @return Posição após o último byte lido, ou NULL se os dados terminarem
+ *         antes ou se algum valor for inválido
+ */
+static const unsigned char* getDeltas(const unsigned char *in,
+				      const unsigned char *end, int32_t *v,
+				      uint n)
+{
+	uint i = 0;
+
+	while ( i < n ) {
+		uint32_t value = 0;
+		int shift = 0;
+		unsigned char b;
+
+		if ( i + 8 <= n && end - in >= 8 ) {
+			uint64_t word;
+
+			memcpy(&word, in, sizeof(word));
+			if ( 0 == (word & 0x8080808080808080ull) ) {
+				int k;
+				for (k = 0; k < 8; ++k)
+					v[i + k] = unzigzag(in[k]);
+				in += 8;
+				i += 8;
+				continue;
+			}
+		}
+
+		do {
+			if ( in == end || shift > 28 )
+				return NULL;
+			b = *in++;
+			value |= (uint32_t) (b & 0x7f) << shift;
+			shift += 7;
+		} while ( b & 0x80 );
+		v[i++] = unzigzag(value);
+	}
+	return in;
+}
+
+/**
+ * Tamanho máximo de count elementos codificados por encodeIndices
+ */
+size_t encodeIndicesBound(uint count)
+{
+	return (size_t) count*CODEC_MAX_VARINT;
+}
+
+/**
+ * Codifica um vetor de elementos
+ *
+ * Cada elemento é guardado como a diferença para o anterior, em zigzag, com
+ * 7 bits por byte. Em malhas com boa localidade, a maioria das diferenças
+ * cabe em um byte, e a sequência resultante ainda comprime bem com um
+ * compressor genérico. O índice de reinício das tiras também é suportado.
+ *
+ * @param in Elementos
+ * @param count Quantidade de elementos
+ * @param out Vetor de saída, com pelo menos encodeIndicesBound(count) bytes
+ * @return Quantidade de bytes escritos
+ */
+size_t encodeIndices(const GLuint *in, uint count, unsigned char *out)
+{
+	unsigned char *o = out;
+	GLuint prev = 0;
+	uint i;
+
+	assert(NULL != in || 0 == count);
+	assert(NULL != out);
+
+	for (i = 0; i < count; ++i) {
+		o = putVarint(o, zigzag((int32_t) (in[i] - prev)));
+		prev = in[i];
+	}
+	return o - out;
+}
+
+/**
+ * Decodifica um vetor gerado por encodeIndices
+ *
+ * A saída é escrita em ordem e nunca lida, podendo ser um buffer do OpenGL
+ * mapeado somente para escrita.
+ *
+ * @param in Dados codificados
+ * @param size Tamanho dos dados, em bytes
+ * @param out Vetor de saída, com count elementos
+ * @param count Quantidade de elementos
+ * @return 0 se os dados foram consumidos exatamente
+ */
+int decodeIndices(const unsigned char *in, size_t size, GLuint *out, uint count)
+{
+	const unsigned char *end = in + size;
+	int32_t delta[CODEC_BATCH];
+	GLuint prev = 0;
+	uint i, k;
+
+	assert(NULL != in || 0 == size);
+	assert(NULL != out || 0 == count);
+
+	for (i = 0; i < count; i += CODEC_BATCH) {
+		uint n = count - i < CODEC_BATCH ? count - i : CODEC_BATCH;
+
+		in = getDeltas(in, end, delta, n);
+		if ( NULL == in )
+			return -1;
+		for (k = 0; k < n; ++k) {
+			prev += (GLuint) delta[k];
+			out[i + k] = prev;
+		}
+	}
+	return in == end ? 0 : -1;
+}
+
+/**
+ * Tamanho máximo de vertexCount posições codificadas por encodeVertices
+ */
+size_t encodeVerticesBound(uint vertexCount)
+{
+	// Diferenças de 17 bits cabem em 3 bytes
+	return CODEC_VERTEX_HEADER + (size_t) vertexCount*3*3;
+}
+
+/**
+ * Codifica as posições de um vetor de vértices
+ *
+ * As posições são quantizadas em 16 bits em relação à caixa envolvente, como
+ * em quantizeVertices, e cada coordenada é guardada como a diferença para a
+ * mesma coordenada do vértice anterior, em zigzag, com 7 bits por byte. A
+ * codificação tem perdas: a precisão é a mesma das posições SNORM16 usadas
+ * na memória de vídeo.
+ *
+ * @param points Posição do primeiro vértice
+ * @param stride Distância entre dois vértices, em GLfloat
+ * @param vertexCount Quantidade de vértices
+ * @param out Vetor de saída, com pelo menos encodeVerticesBound bytes
+ * @return Quantidade de bytes escritos
+ */
+size_t encodeVertices(const GLfloat *points, uint stride, uint vertexCount,
+		      unsigned char *out)
+{
+	unsigned char *o = out + CODEC_VERTEX_HEADER;
+	GLfloat box[6];
+	int32_t prev[3] = { 0, 0, 0 };
+	mat4x4 dequant;
+	uint i;
+	int k;
+
+	assert(NULL != points || 0 == vertexCount);
+	assert(NULL != out);
+
+	computeQuantization(points, stride, vertexCount, dequant);
+	for (k = 0; k < 3; ++k) {
+		box[k] = dequant[3][k];
+		box[3 + k] = dequant[k][k];
+	}
+	memcpy(out, box, sizeof(box));
+
+	for (i = 0; i < vertexCount; ++i)
+		for (k = 0; k < 3; ++k) {
+			float c = (points[stride*i + k] - box[k]) / box[3 + k];
+			int32_t q;
+
+			if ( c > 1.f )
+				c = 1.f;
+			if ( c < -1.f )
+				c = -1.f;
+			q = (int32_t) lrintf(c*QUANTIZE_SNORM16_MAX);
+			o = putVarint(o, zigzag(q - prev[k]));
+			prev[k] = q;
+		}
+	return o - out;
+}
+
+/**
+ * Decodifica as posições geradas por encodeVertices
+ *
+ * As coordenadas são escritas em ordem e nunca lidas, podendo ir direto para
+ * um buffer do OpenGL mapeado somente para escrita.
+ *
+ * @param in Dados codificados
+ * @param size Tamanho dos dados, em bytes
+ * @param out Posição do primeiro vértice de saída
+ * @param stride Distância entre dois vértices de saída, em GLfloat
+ * @param vertexCount Quantidade de vértices
+ * @return 0 se os dados foram consumidos exatamente
+ */
+int decodeVertices(const unsigned char *in, size_t size, GLfloat *out,
+		   uint stride, uint vertexCount)
+{
+	const unsigned char *end = in + size;
+	int32_t delta[CODEC_BATCH];
+	int32_t prev[3] = { 0, 0, 0 };
+	GLfloat box[6], scale[3];
+	uint i, k, n, total = 3*vertexCount;
+
+	assert(NULL != in);
+	assert(NULL != out || 0 == vertexCount);
+
+	if ( size < CODEC_VERTEX_HEADER )
+		return -1;
+	memcpy(box, in, sizeof(box));
+	in += CODEC_VERTEX_HEADER;
+	for (k = 0; k < 3; ++k)
+		scale[k] = box[3 + k] / QUANTIZE_SNORM16_MAX;
+
+	// O lote é múltiplo de 3: cada lote começa na coordenada x
+	for (i = 0; i < total; i += n) {
+		GLfloat *o = out + stride*(i/3);
+
+		n = total - i < CODEC_BATCH ? total - i : CODEC_BATCH;
+		in = getDeltas(in, end, delta, n);
+		if ( NULL == in )
+			return -1;
+		for (k = 0; k < n; k += 3, o += stride) {
+			prev[0] += delta[k];
+			prev[1] += delta[k + 1];
+			prev[2] += delta[k + 2];
+			o[0] = box[0] + prev[0]*scale[0];
+			o[1] = box[1] + prev[1]*scale[1];
+			o[2] = box[2] + prev[2]*scale[2];
+		}
+	}
+	return in == end ? 0 : -1;
+}
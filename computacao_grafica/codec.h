@@ -0,0 +1,31 @@
+#ifndef __CODEC_H
+#define __CODEC_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+/**
+ * Maior quantidade de bytes de um inteiro de 32 bits codificado
+ */
+#define CODEC_MAX_VARINT	5
+/**
+ * Bytes no início de um vetor de vértices codificado: centro e metade da
+ * caixa envolvente, 3 GLfloat cada
+ */
+#define CODEC_VERTEX_HEADER	(6*sizeof(GLfloat))
+
+size_t encodeIndicesBound(uint count);
+
+size_t encodeIndices(const GLuint *in, uint count, unsigned char *out);
+
+int decodeIndices(const unsigned char *in, size_t size, GLuint *out, uint count);
+
+size_t encodeVerticesBound(uint vertexCount);
+
+size_t encodeVertices(const GLfloat *points, uint stride, uint vertexCount,
+		      unsigned char *out);
+
+int decodeVertices(const unsigned char *in, size_t size, GLfloat *out,
+		   uint stride, uint vertexCount);
+
+#endif
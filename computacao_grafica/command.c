@@ -0,0 +1,152 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "linmath.h"
+#include "reflect.h"
+#include "command.h"
+
+/**
+ * Esvazia o buffer, mantendo a memória
+ */
+void resetCommandBuffer(CommandBuffer *b)
+{
+	assert(NULL != b);
+
+	b->count = 0;
+}
+
+/**
+ * Reserva o próximo comando, dobrando o buffer se está cheio
+ */
+static Command* pushCommand(CommandBuffer *b, CommandType type)
+{
+	Command *c;
+
+	assert(NULL != b);
+
+	if ( b->count == b->capacity ) {
+		b->capacity = b->capacity > 0 ? 2*b->capacity : COMMAND_INITIAL_CAPACITY;
+		b->commands = realloc(b->commands, b->capacity*sizeof(*b->commands));
+	}
+	c = &b->commands[b->count++];
+	c->type = type;
+	return c;
+}
+
+void recordBindVertexArray(CommandBuffer *b, GLuint vao)
+{
+	pushCommand(b, COMMAND_BIND_VERTEX_ARRAY)->u.vao = vao;
+}
+
+/**
+ * Grava a mudança de uma uniform mat4
+ *
+ * @param uniform Índice da variável, de findUniform. Se negativo, a variável
+ *                não existe no programa e nada é gravado
+ */
+void recordUniformMatrix4(CommandBuffer *b, int uniform, mat4x4 value)
+{
+	Command *c;
+
+	if ( uniform < 0 )
+		return;
+	c = pushCommand(b, COMMAND_UNIFORM_MATRIX4);
+	c->u.uniform.index = uniform;
+	mat4x4_dup(c->u.uniform.value, value);
+}
+
+/**
+ * Grava a mudança de uma uniform vec4
+ *
+ * @param uniform Índice da variável, de findUniform. Se negativo, nada é
+ *                gravado
+ */
+void recordUniformVec4(CommandBuffer *b, int uniform, const vec4 value)
+{
+	Command *c;
+
+	if ( uniform < 0 )
+		return;
+	c = pushCommand(b, COMMAND_UNIFORM_VEC4);
+	c->u.vector.index = uniform;
+	memcpy(c->u.vector.value, value, sizeof(vec4));
+}
+
+/**
+ * Grava o desenho de um intervalo de elementos GL_UNSIGNED_INT
+ *
+ * @param offset Posição no buffer de elementos, em bytes, ou o endereço dos
+ *               elementos, se nenhum buffer de elementos está ligado ao vertex
+ *               array
+ */
+void recordDrawElements(CommandBuffer *b, GLenum mode, GLsizei count,
+			GLintptr offset)
+{
+	Command *c = pushCommand(b, COMMAND_DRAW_ELEMENTS);
+
+	c->u.draw.mode = mode;
+	c->u.draw.count = count;
+	c->u.draw.offset = offset;
+}
+
+/**
+ * Envia ao driver os comandos de vários buffers, um buffer depois do outro
+ *
+ * Deve ser chamada pela thread do OpenGL, com o programa em uso. Os comandos
+ * não são validados, somente os redundantes são descartados: o vertex array
+ * já ligado não é ligado de novo, e uniforms iguais às anteriores não são
+ * reenviadas. O vertex array ligado no fim não é desfeito.
+ *
+ * @param count Quantidade de buffers
+ * @param shader Variáveis do programa em uso
+ */
+void replayCommandBuffers(const CommandBuffer *b, uint count,
+			  ProgramReflection *shader)
+{
+	GLboolean bound = GL_FALSE;
+	GLuint vao = 0;
+	uint i, j;
+
+	assert(NULL != b || 0 == count);
+	assert(NULL != shader);
+
+	for (i = 0; i < count; ++i) {
+		for (j = 0; j < b[i].count; ++j) {
+			const Command *c = &b[i].commands[j];
+
+			switch ( c->type ) {
+			case COMMAND_BIND_VERTEX_ARRAY:
+				if ( !bound || c->u.vao != vao ) {
+					bound = GL_TRUE;
+					vao = c->u.vao;
+					glBindVertexArray(vao);
+				}
+				break;
+			case COMMAND_UNIFORM_MATRIX4:
+				setUniformMatrix4(shader, c->u.uniform.index,
+						  (vec4 *) c->u.uniform.value);
+				break;
+			case COMMAND_UNIFORM_VEC4:
+				setUniformVec4(shader, c->u.vector.index,
+					       c->u.vector.value);
+				break;
+			case COMMAND_DRAW_ELEMENTS:
+				glDrawElements(c->u.draw.mode, c->u.draw.count,
+					       GL_UNSIGNED_INT,
+					       (GLvoid *) (uintptr_t) c->u.draw.offset);
+				break;
+			}
+		}
+	}
+}
+
+void releaseCommandBuffer(CommandBuffer *b)
+{
+	assert(NULL != b);
+
+	free(b->commands);
+	memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,80 @@
+#ifndef __COMMAND_H
+#define __COMMAND_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+# include "reflect.h"
+
+/**
+ * Comandos reservados na primeira gravação de um buffer
+ */
+#define COMMAND_INITIAL_CAPACITY	64
+
+/**
+ * @brief Tipos de comando
+ */
+typedef enum CommandType
+{
+	COMMAND_BIND_VERTEX_ARRAY,	/**< troca o vertex array */
+	COMMAND_UNIFORM_MATRIX4,	/**< muda uma uniform mat4 do programa em uso */
+	COMMAND_UNIFORM_VEC4,		/**< muda uma uniform vec4 do programa em uso */
+	COMMAND_DRAW_ELEMENTS		/**< desenha um intervalo de elementos GL_UNSIGNED_INT */
+} CommandType;
+
+/**
+ * @brief Um comando gravado, sem nenhuma chamada ao OpenGL
+ */
+typedef struct Command
+{
+	CommandType	type;
+	union {
+		GLuint	vao;			/**< COMMAND_BIND_VERTEX_ARRAY */
+		struct {
+			int	index;		/**< índice da variável, de findUniform */
+			mat4x4	value;
+		} uniform;			/**< COMMAND_UNIFORM_MATRIX4 */
+		struct {
+			int	index;		/**< índice da variável, de findUniform */
+			vec4	value;
+		} vector;			/**< COMMAND_UNIFORM_VEC4 */
+		struct {
+			GLenum		mode;
+			GLsizei		count;	/**< quantidade de elementos */
+			GLintptr	offset;	/**< posição no buffer de elementos, em bytes */
+		} draw;				/**< COMMAND_DRAW_ELEMENTS */
+	} u;
+} Command;
+
+/**
+ * @brief Comandos de uma parte da cena, na ordem do envio
+ *
+ * Cada buffer é gravado por uma única thread; somente a thread do OpenGL os
+ * reproduz. Um buffer zerado está vazio, e a memória é reaproveitada de um
+ * quadro para o outro.
+ */
+typedef struct CommandBuffer
+{
+	Command		*commands;
+	uint		count;		/**< comandos gravados */
+	uint		capacity;	/**< comandos que cabem em commands */
+} CommandBuffer;
+
+void resetCommandBuffer(CommandBuffer *b);
+
+void recordBindVertexArray(CommandBuffer *b, GLuint vao);
+
+void recordUniformMatrix4(CommandBuffer *b, int uniform, mat4x4 value);
+
+void recordUniformVec4(CommandBuffer *b, int uniform, const vec4 value);
+
+void recordDrawElements(CommandBuffer *b, GLenum mode, GLsizei count,
+			GLintptr offset);
+
+void replayCommandBuffers(const CommandBuffer *b, uint count,
+			  ProgramReflection *shader);
+
+void releaseCommandBuffer(CommandBuffer *b);
+
+#endif
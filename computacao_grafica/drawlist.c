@@ -0,0 +1,207 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "linmath.h"
+#include "primitive.h"
+#include "instance.h"
+#include "meshlet.h"
+#include "lod.h"
+#include "jobs.h"
+#include "drawlist.h"
+
+/**
+ * Prepara os pacotes das instâncias
+ *
+ * As primitivas e as instâncias devem continuar válidas enquanto a lista for
+ * usada, e a quantidade de faces de cada primitiva não pode mudar.
+ *
+ * @param list Recebe a lista. Liberada com releaseDrawList
+ * @param animated Marca as instâncias giradas pelo shader, cuja matriz é
+ *                 somente a de repouso. Pode ser NULL
+ */
+void initDrawList(DrawList *list, const Primitive *p, const Instance *inst,
+		  uint instanceCount, const GLboolean *animated)
+{
+	uint i, j, packets = 0, ranges = 0;
+
+	assert(NULL != list);
+	assert(NULL != inst || 0 == instanceCount);
+
+	memset(list, 0, sizeof(*list));
+	list->p = p;
+	list->inst = inst;
+	list->instanceCount = instanceCount;
+	list->animated = animated;
+	list->firstPacket = malloc((instanceCount + 1)*sizeof(*list->firstPacket));
+	for (i = 0; i < instanceCount; ++i) {
+		list->firstPacket[i] = packets;
+		packets += p[inst[i].prefab].faceCount;
+	}
+	list->firstPacket[instanceCount] = packets;
+
+	// Uma face dividida desenha no máximo um intervalo por meshlet
+	list->packets = malloc(packets*sizeof(*list->packets));
+	for (i = 0; i < instanceCount; ++i) {
+		const Primitive *prefab = &p[inst[i].prefab];
+
+		for (j = 0; j < prefab->faceCount; ++j) {
+			DrawPacket *pk = &list->packets[list->firstPacket[i] + j];
+			uint meshlets = prefab->faceArray[j].meshletCount;
+
+			pk->face = &prefab->faceArray[j];
+			pk->firstRange = ranges;
+			ranges += meshlets > 0 ? meshlets : 1;
+		}
+	}
+	list->ranges = malloc(ranges*sizeof(*list->ranges));
+}
+
+static void putRange(DrawList *list, DrawPacket *pk, GLsizei count,
+		     GLintptr offset)
+{
+	DrawRange *r = &list->ranges[pk->firstRange + pk->rangeCount++];
+
+	r->count = count;
+	r->offset = offset;
+}
+
+/**
+ * Monta o pacote de uma face
+ *
+ * Se a face possui níveis de detalhe, o nível é escolhido pelo tamanho
+ * projetado, a partir do nível do último quadro; o novo nível só é guardado
+ * na face durante o envio. No nível original, se a face foi dividida em
+ * meshlets, somente os visíveis entram, e meshlets visíveis consecutivos
+ * formam um só intervalo.
+ *
+ * @param transf Matriz que leva a face ao espaço de recorte, sem a
+ *               dequantização
+ * @param cull Se os meshlets podem ser descartados. Uma face girada pelo
+ *             shader está em outra posição: é desenhada inteira
+ */
+static void buildPacket(DrawList *list, DrawPacket *pk, mat4x4 transf,
+			GLboolean cull)
+{
+	const Faces *f = pk->face;
+	MeshletCuller culler;
+	GLuint first = 0, count = 0;
+	uint k;
+
+	pk->rangeCount = 0;
+	pk->lod = f->lodCurrent;
+	if ( f->lodCount > 0 ) {
+		pk->lod = selectLod(f->lods, f->lodCount, f->lodCurrent, transf,
+				    list->viewportHeight);
+		if ( pk->lod > 0 ) {
+			const Lod *lod = &f->lods[pk->lod];
+			putRange(list, pk, lod->count, lod->offset);
+			return;
+		}
+	}
+
+	if ( 0 == f->meshletCount || !cull ) {
+		putRange(list, pk, f->count, f->offset);
+		return;
+	}
+
+	initMeshletCuller(&culler, transf, list->backface);
+	for (k = 0; k < f->meshletCount; ++k) {
+		const Meshlet *m = &f->meshlets[k];
+
+		if ( !meshletVisible(&culler, m) )
+			continue;
+		if ( count > 0 && first + count == m->offset ) {
+			count += m->count;
+			continue;
+		}
+		if ( count > 0 )
+			putRange(list, pk, count, f->offset + first*sizeof(GLuint));
+		first = m->offset;
+		count = m->count;
+	}
+	if ( count > 0 )
+		putRange(list, pk, count, f->offset + first*sizeof(GLuint));
+}
+
+/**
+ * Monta os pacotes de um intervalo de instâncias
+ */
+static void buildPackets(void *arg, uint first, uint count)
+{
+	DrawList *list = arg;
+	uint i, j;
+
+	for (i = first; i < first + count; ++i) {
+		const Primitive *prefab = &list->p[list->inst[i].prefab];
+		DrawPacket *pk = &list->packets[list->firstPacket[i]];
+		GLboolean cull = NULL == list->animated || !list->animated[i];
+
+		for (j = 0; j < prefab->faceCount; ++j, ++pk) {
+			mat4x4 tmp;
+
+			mat4x4_mul(tmp, (vec4 *) list->inst[i].transf, pk->face->transf);
+			// A dequantização das posições vem antes de tudo
+			if ( list->foldDequant )
+				mat4x4_mul(pk->transf, tmp, (vec4 *) prefab->dequant);
+			else
+				mat4x4_dup(pk->transf, tmp);
+			buildPacket(list, pk, tmp, cull);
+		}
+	}
+}
+
+/**
+ * Monta os pacotes do quadro com o sistema de trabalhos
+ *
+ * Os pacotes de uma instância são montados mesmo se a primitiva ainda não
+ * está na memória de vídeo: quem os envia decide.
+ *
+ * @param jobs Sistema de trabalhos. Se NULL, os pacotes são montados na hora
+ * @param foldDequant Se a dequantização das posições é somada à matriz de
+ *                    cada face, quando o shader não a faz
+ * @param backface Se os meshlets de costas são descartados
+ * @param viewportHeight Altura da janela, em pixels, para os níveis de detalhe
+ * @param done Contador dos trabalhos. Os pacotes podem ser usados depois de
+ *             waitJobs
+ * @param after Grupo que deve terminar antes, como a atualização das
+ *              matrizes das instâncias. Pode ser NULL
+ */
+void buildDrawList(DrawList *list, JobSystem *jobs, GLboolean foldDequant,
+		   GLboolean backface, GLfloat viewportHeight, JobCounter *done,
+		   JobCounter *after)
+{
+	assert(NULL != list);
+
+	list->foldDequant = foldDequant;
+	list->backface = backface;
+	list->viewportHeight = viewportHeight;
+	parallelFor(jobs, buildPackets, list, list->instanceCount, DRAWLIST_GRAIN,
+		    done, after);
+}
+
+/**
+ * Pacotes de uma instância, um por face da primitiva
+ *
+ * @param count Recebe a quantidade de pacotes
+ */
+const DrawPacket* getInstancePackets(const DrawList *list, uint instance,
+				     uint *count)
+{
+	assert(NULL != list);
+	assert(instance < list->instanceCount);
+
+	*count = list->firstPacket[instance + 1] - list->firstPacket[instance];
+	return &list->packets[list->firstPacket[instance]];
+}
+
+void releaseDrawList(DrawList *list)
+{
+	assert(NULL != list);
+
+	free(list->ranges);
+	free(list->packets);
+	free(list->firstPacket);
+	memset(list, 0, sizeof(*list));
+}
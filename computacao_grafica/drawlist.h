@@ -0,0 +1,71 @@
+#ifndef __DRAWLIST_H
+#define __DRAWLIST_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+# include "primitive.h"
+# include "instance.h"
+# include "jobs.h"
+
+/**
+ * Instâncias montadas por trabalho
+ */
+#define DRAWLIST_GRAIN	32
+
+/**
+ * @brief Elementos consecutivos desenhados com uma chamada
+ */
+typedef struct DrawRange
+{
+	GLsizei		count;	/**< quantidade de elementos */
+	GLintptr	offset;	/**< posição no buffer de elementos, em bytes */
+} DrawRange;
+
+/**
+ * @brief O que falta enviar ao driver para desenhar uma face de uma instância
+ */
+typedef struct DrawPacket
+{
+	mat4x4		transf;		/**< valor da variável transformation */
+	Faces		*face;
+	uint		lod;		/**< nível de detalhe escolhido */
+	uint		firstRange;	/**< primeiro intervalo de elementos em DrawList.ranges */
+	uint		rangeCount;	/**< intervalos desenhados. 0 se a face está fora de vista */
+} DrawPacket;
+
+/**
+ * @brief Pacotes de desenho de um quadro, montados em paralelo
+ *
+ * Cada face de cada instância tem o seu pacote e o seu espaço de intervalos,
+ * calculados uma vez: os trabalhos escrevem em posições diferentes, sem
+ * trava. Somente o envio dos pacotes fica na thread do OpenGL.
+ */
+typedef struct DrawList
+{
+	const Primitive	*p;		/**< primitivas usadas pelas instâncias */
+	const Instance	*inst;
+	uint		instanceCount;
+	const GLboolean	*animated;	/**< instâncias giradas pelo shader. Pode ser NULL */
+	uint		*firstPacket;	/**< primeiro pacote de cada instância, e o total no fim */
+	DrawPacket	*packets;
+	DrawRange	*ranges;	/**< espaço para todos os meshlets de cada pacote */
+	GLboolean	foldDequant;	/**< se a dequantização entra em transf */
+	GLboolean	backface;	/**< se os meshlets de costas são descartados */
+	GLfloat		viewportHeight;	/**< altura da janela, em pixels */
+} DrawList;
+
+void initDrawList(DrawList *list, const Primitive *p, const Instance *inst,
+		  uint instanceCount, const GLboolean *animated);
+
+void buildDrawList(DrawList *list, JobSystem *jobs, GLboolean foldDequant,
+		   GLboolean backface, GLfloat viewportHeight, JobCounter *done,
+		   JobCounter *after);
+
+const DrawPacket* getInstancePackets(const DrawList *list, uint instance,
+				     uint *count);
+
+void releaseDrawList(DrawList *list);
+
+#endif
@@ -0,0 +1,204 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dynamic.h"
+
+/**
+ * Quantidade de vértices combinados de uma vez por blendMorphTargets
+ */
+#define DYNAMIC_BATCH	256
+
+/**
+ * Cria uma malha dinâmica com a cópia dos vértices
+ *
+ * @param points Vértices originais. NULL deixa a cópia sem inicializar
+ * @param stride Bytes por vértice
+ * @param positionOffset Posição das coordenadas, 3 GLfloat, no vértice
+ * @param elementCount Quantidade de elementos. Não são inicializados
+ */
+DynamicMesh* createDynamicMesh(const GLvoid *points, uint vertexCount,
+			       uint stride, uint positionOffset,
+			       uint elementCount)
+{
+	DynamicMesh *d;
+
+	assert(stride >= positionOffset + 3*sizeof(GLfloat));
+
+	d = calloc(1, sizeof(*d));
+	d->points = malloc((size_t) vertexCount*stride);
+	d->vertexCount = vertexCount;
+	d->stride = stride;
+	d->positionOffset = positionOffset;
+	d->elements = malloc(elementCount*sizeof(*d->elements));
+	d->elementCount = elementCount;
+
+	if ( NULL != points )
+		memcpy(d->points, points, (size_t) vertexCount*stride);
+	return d;
+}
+
+void destroyDynamicMesh(DynamicMesh *d)
+{
+	if ( NULL == d )
+		return;
+	free(d->points);
+	free(d->elements);
+	free(d);
+}
+
+/**
+ * Une os dois intervalos mais próximos da lista
+ */
+static void mergeClosest(DirtyList *list)
+{
+	uint i, best = 0, bestGap = 0;
+
+	assert(list->count > 1);
+
+	for (i = 0; i + 1 < list->count; ++i) {
+		uint gap = list->range[i + 1].first -
+			   (list->range[i].first + list->range[i].count);
+		if ( 0 == i || gap < bestGap ) {
+			best = i;
+			bestGap = gap;
+		}
+	}
+
+	list->range[best].count = list->range[best + 1].first +
+				  list->range[best + 1].count - list->range[best].first;
+	memmove(&list->range[best + 1], &list->range[best + 2],
+		(list->count - best - 2)*sizeof(*list->range));
+	--list->count;
+}
+
+/**
+ * Registra itens alterados
+ *
+ * O intervalo é unido aos que o tocam ou que estão a até DYNAMIC_MERGE_GAP
+ * itens dele. A lista continua ordenada e sem sobreposições.
+ */
+void markDirtyRange(DirtyList *list, uint first, uint count)
+{
+	uint i, j, end = first + count;
+
+	assert(NULL != list);
+
+	if ( 0 == count )
+		return;
+
+	// Intervalos que terminam bem antes do novo ficam como estão
+	for (i = 0; i < list->count; ++i)
+		if ( list->range[i].first + list->range[i].count + DYNAMIC_MERGE_GAP >= first )
+			break;
+
+	// Os seguintes são absorvidos enquanto estiverem próximos
+	for (j = i; j < list->count && list->range[j].first <= end + DYNAMIC_MERGE_GAP; ++j) {
+		if ( list->range[j].first < first )
+			first = list->range[j].first;
+		if ( list->range[j].first + list->range[j].count > end )
+			end = list->range[j].first + list->range[j].count;
+	}
+
+	if ( i == j ) {
+		if ( DYNAMIC_MAX_RANGES == list->count ) {
+			mergeClosest(list);
+			markDirtyRange(list, first, end - first);
+			return;
+		}
+		memmove(&list->range[i + 1], &list->range[i],
+			(list->count - i)*sizeof(*list->range));
+		++list->count;
+	} else {
+		memmove(&list->range[i + 1], &list->range[j],
+			(list->count - j)*sizeof(*list->range));
+		list->count -= j - i - 1;
+	}
+	list->range[i].first = first;
+	list->range[i].count = end - first;
+}
+
+void clearDirtyRanges(DirtyList *list)
+{
+	assert(NULL != list);
+	list->count = 0;
+}
+
+/**
+ * Permite alterar vértices, diretamente na cópia da malha
+ *
+ * Os vértices são marcados como alterados e enviados no próximo quadro.
+ *
+ * @return Primeiro vértice do intervalo, com stride bytes por vértice
+ */
+GLvoid* beginVertexUpdate(DynamicMesh *d, uint first, uint count)
+{
+	assert(NULL != d);
+	assert(first + count <= d->vertexCount);
+
+	markDirtyRange(&d->vertices, first, count);
+	return (char *) d->points + (size_t) first*d->stride;
+}
+
+/**
+ * Permite alterar elementos, diretamente na cópia da malha
+ *
+ * O primeiro elemento de uma face está em face - elements.
+ *
+ * @return Primeiro elemento do intervalo
+ */
+GLuint* beginElementUpdate(DynamicMesh *d, uint first, uint count)
+{
+	assert(NULL != d);
+	assert(first + count <= d->elementCount);
+
+	markDirtyRange(&d->indices, first, count);
+	return &d->elements[first];
+}
+
+/**
+ * Combina alvos de morph nas posições de um intervalo de vértices
+ *
+ * Cada posição recebe base + soma(weights[k]*deltas[k]). Os vetores de
+ * entrada têm 3 GLfloat por vértice, indexados como os vértices da malha.
+ * A soma é feita em blocos contíguos, sem o intervalo entre os vértices, o
+ * que permite ao compilador usar instruções vetoriais; só então o bloco é
+ * copiado para os vértices.
+ *
+ * @param targetCount Quantidade de alvos em deltas e weights
+ */
+void blendMorphTargets(DynamicMesh *d, const GLfloat *base,
+		       const GLfloat *const *deltas, const GLfloat *weights,
+		       uint targetCount, uint first, uint count)
+{
+	GLfloat block[3*DYNAMIC_BATCH];
+	char *out;
+	uint i, j, k;
+
+	assert(NULL != base);
+	assert(NULL != deltas || 0 == targetCount);
+	assert(NULL != weights || 0 == targetCount);
+
+	out = (char *) beginVertexUpdate(d, first, count) + d->positionOffset;
+
+	for (i = 0; i < count; i += DYNAMIC_BATCH) {
+		uint n = count - i < DYNAMIC_BATCH ? count - i : DYNAMIC_BATCH;
+		const GLfloat *b = &base[3*(first + i)];
+
+		memcpy(block, b, 3*n*sizeof(*block));
+		for (k = 0; k < targetCount; ++k) {
+			const GLfloat *restrict delta = &deltas[k][3*(first + i)];
+			GLfloat w = weights[k];
+
+			if ( 0.f == w )
+				continue;
+			for (j = 0; j < 3*n; ++j)
+				block[j] += w*delta[j];
+		}
+
+		for (j = 0; j < n; ++j)
+			memcpy(out + (size_t) (i + j)*d->stride, &block[3*j],
+			       3*sizeof(*block));
+	}
+}
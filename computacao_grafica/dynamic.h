@@ -0,0 +1,73 @@
+#ifndef __DYNAMIC_H
+#define __DYNAMIC_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+/**
+ * Quantidade máxima de intervalos pendentes em uma lista. Acima disso, os
+ * dois intervalos mais próximos são unidos
+ */
+#define DYNAMIC_MAX_RANGES	16
+/**
+ * Intervalos separados por até essa quantidade de itens são enviados juntos:
+ * reenviar alguns itens custa menos que uma chamada a mais
+ */
+#define DYNAMIC_MERGE_GAP	32
+
+/**
+ * @brief Itens consecutivos alterados desde o último envio
+ */
+typedef struct DirtyRange
+{
+	uint		first;	/**< primeiro item alterado */
+	uint		count;	/**< quantidade de itens */
+} DirtyRange;
+
+/**
+ * @brief Intervalos alterados, em ordem, sem sobreposição
+ */
+typedef struct DirtyList
+{
+	DirtyRange	range[DYNAMIC_MAX_RANGES];
+	uint		count;	/**< quantidade de intervalos */
+} DirtyList;
+
+/**
+ * @brief Vértices e elementos alteráveis de uma primitiva
+ *
+ * As alterações são registradas em intervalos e somente eles são enviados
+ * ao driver. Os elementos seguem o layout do buffer de elementos da
+ * primitiva.
+ */
+typedef struct DynamicMesh
+{
+	GLvoid		*points;	/**< cópia gravável dos vértices */
+	uint		vertexCount;	/**< quantidade de vértices */
+	uint		stride;		/**< bytes por vértice */
+	uint		positionOffset;	/**< posição, em bytes, das coordenadas no vértice */
+	GLuint		*elements;	/**< cópia gravável dos elementos */
+	uint		elementCount;	/**< quantidade de elementos */
+	DirtyList	vertices;	/**< vértices alterados desde o último envio */
+	DirtyList	indices;	/**< elementos alterados desde o último envio */
+} DynamicMesh;
+
+DynamicMesh* createDynamicMesh(const GLvoid *points, uint vertexCount,
+			       uint stride, uint positionOffset,
+			       uint elementCount);
+
+void destroyDynamicMesh(DynamicMesh *d);
+
+void markDirtyRange(DirtyList *list, uint first, uint count);
+
+void clearDirtyRanges(DirtyList *list);
+
+GLvoid* beginVertexUpdate(DynamicMesh *d, uint first, uint count);
+
+GLuint* beginElementUpdate(DynamicMesh *d, uint first, uint count);
+
+void blendMorphTargets(DynamicMesh *d, const GLfloat *base,
+		       const GLfloat *const *deltas, const GLfloat *weights,
+		       uint targetCount, uint first, uint count);
+
+#endif
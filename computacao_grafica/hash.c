@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "hash.h"
+
+// Primos do xxHash64
+#define PRIME1	0x9E3779B185EBCA87ull
+#define PRIME2	0xC2B2AE3D27D4EB4Full
+#define PRIME3	0x165667B19E3779F9ull
+#define PRIME4	0x85EBCA77C2B2AE63ull
+#define PRIME5	0x27D4EB2F165667C5ull
+
+static uint64_t rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input*PRIME2;
+	return rotl(acc, 31)*PRIME1;
+}
+
+static uint64_t mergeRound(uint64_t acc, uint64_t lane)
+{
+	acc ^= round64(0, lane);
+	return acc*PRIME1 + PRIME4;
+}
+
+/**
+ * Hash de 64 bits de um bloco de memória, no algoritmo xxHash64
+ *
+ * Os blocos de 32 bytes são consumidos por quatro acumuladores independentes,
+ * sem dependência entre si: o processador os calcula em paralelo e o
+ * compilador pode vetorizá-los. O resultado depende da ordem dos bytes da
+ * máquina; serve para comparar dados na memória, não para gravar em arquivos
+ * trocados entre máquinas diferentes.
+ *
+ * @param seed Valor inicial. Hashes com sementes diferentes são independentes
+ */
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p = data, *end = p + size;
+	uint64_t h;
+
+	assert(NULL != data || 0 == size);
+
+	if ( size >= 32 ) {
+		uint64_t v[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed,
+				  seed - PRIME1 };
+		int k;
+
+		do {
+			for (k = 0; k < 4; ++k)
+				v[k] = round64(v[k], read64(p + 8*k));
+			p += 32;
+		} while ( p + 32 <= end );
+
+		h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+		for (k = 0; k < 4; ++k)
+			h = mergeRound(h, v[k]);
+	} else
+		h = seed + PRIME5;
+
+	h += size;
+	for (; p + 8 <= end; p += 8)
+		h = rotl(h ^ round64(0, read64(p)), 27)*PRIME1 + PRIME4;
+	if ( p + 4 <= end ) {
+		h = rotl(h ^ (read32(p)*PRIME1), 23)*PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		h = rotl(h ^ (*p*PRIME5), 11)*PRIME1;
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,9 @@
+#ifndef __HASH_H
+#define __HASH_H
+
+# include <stdlib.h>
+# include <stdint.h>
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed);
+
+#endif
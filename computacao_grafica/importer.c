@@ -0,0 +1,828 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "primitive.h"
+#include "importer.h"
+#include "jobs.h"
+#include "platform.h"
+
+#define PLY_MAX_ELEMENTS	16
+#define PLY_MAX_PROPERTIES	32
+#define PLY_VERTEX_BATCH	(1u << 16)
+
+/**
+ * Pedaço de um arquivo OBJ, sempre terminando em fim de linha
+ */
+typedef struct ObjChunk
+{
+	const char	*begin, *end;
+	uint		vertices, triangles, groups;		/**< contagens do passo 1 */
+	uint		vertexBase, triangleBase, groupBase;	/**< onde escrever no passo 2 */
+	int		error;
+} ObjChunk;
+
+typedef struct ObjJob
+{
+	MeshData	*mesh;
+	ObjChunk	*chunks;
+	uint		chunkCount;
+	int		pass;
+} ObjJob;
+
+enum { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32,
+       PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+enum { PLY_X, PLY_Y, PLY_Z, PLY_INDICES, PLY_OTHER };
+
+typedef struct PlyProperty
+{
+	int	type;		/**< tipo do valor, ou dos itens da lista */
+	int	countType;	/**< tipo da quantidade de itens. PLY_INVALID se não for lista */
+	int	role;		/**< uso da propriedade na malha */
+} PlyProperty;
+
+typedef struct PlyElement
+{
+	char		name[32];
+	uint		count;
+	PlyProperty	prop[PLY_MAX_PROPERTIES];
+	uint		propCount;
+	const unsigned char *data;	/**< início dos dados no arquivo */
+} PlyElement;
+
+typedef struct PlyVertexJob
+{
+	const unsigned char *data;
+	uint		stride;
+	uint		offset[3];
+	int		type[3];
+	int		swap;
+	GLfloat		*out;
+	uint		count;
+} PlyVertexJob;
+
+/**
+ * Devolve ao sistema as páginas já processadas, limitando a memória residente
+ */
+static void releasePages(const void *begin, const void *end)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t b = ((uintptr_t) begin + page - 1) & ~(page - 1);
+	uintptr_t e = (uintptr_t) end & ~(page - 1);
+
+	if ( e > b )
+		madvise((void *) b, e - b, MADV_DONTNEED);
+}
+
+static const char* skipSpaces(const char *p, const char *end)
+{
+	while ( p < end && (' ' == *p || '\t' == *p || '\r' == *p) )
+		++p;
+	return p;
+}
+
+static int isBlank(char c)
+{
+	return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+static int parseInt(const char **p, const char *end, long *value)
+{
+	const char *s = *p;
+	long v = 0;
+	int neg = 0;
+
+	if ( s < end && ('-' == *s || '+' == *s) )
+		neg = '-' == *s++;
+	if ( s == end || *s < '0' || *s > '9' )
+		return 0;
+	while ( s < end && *s >= '0' && *s <= '9' )
+		v = 10*v + (*s++ - '0');
+	*value = neg ? -v : v;
+	*p = s;
+	return 1;
+}
+
+static int parseFloat(const char **p, const char *end, GLfloat *value)
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+					1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+					1e15, 1e16, 1e17, 1e18 };
+	const char *s = *p;
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0, neg = 0;
+	double v;
+
+	if ( s < end && ('-' == *s || '+' == *s) )
+		neg = '-' == *s++;
+	for (; s < end && *s >= '0' && *s <= '9'; ++s, ++digits)
+		if ( mantissa < 100000000000000000ull )
+			mantissa = 10*mantissa + (*s - '0');
+		else
+			++exponent;
+	if ( s < end && '.' == *s )
+		for (++s; s < end && *s >= '0' && *s <= '9'; ++s, ++digits)
+			if ( mantissa < 100000000000000000ull ) {
+				mantissa = 10*mantissa + (*s - '0');
+				--exponent;
+			}
+	if ( 0 == digits )
+		return 0;
+	if ( s < end && ('e' == *s || 'E' == *s) ) {
+		long e;
+		++s;
+		if ( !parseInt(&s, end, &e) )
+			return 0;
+		exponent += e;
+	}
+
+	v = (double) mantissa;
+	if ( exponent < 0 && -exponent <= 18 )
+		v /= pow10[-exponent];
+	else if ( exponent > 0 && exponent <= 18 )
+		v *= pow10[exponent];
+	else if ( 0 != exponent )
+		v *= pow(10., exponent);
+
+	*value = neg ? -v : v;
+	*p = s;
+	return 1;
+}
+
+/**
+ * Identifica o tipo de linha de um arquivo OBJ
+ *
+ * @return 'v', 'f', 'g' (novo grupo) ou 0 para linhas ignoradas
+ */
+static char objLineType(const char *line, const char *eol)
+{
+	if ( eol - line >= 2 && isBlank(line[1]) ) {
+		if ( 'v' == line[0] || 'f' == line[0] )
+			return line[0];
+		if ( 'g' == line[0] || 'o' == line[0] )
+			return 'g';
+	}
+	if ( eol - line >= 7 && 0 == memcmp(line, "usemtl", 6) && isBlank(line[6]) )
+		return 'g';
+	return 0;
+}
+
+/**
+ * Passo 1: conta vértices, triângulos e grupos de um pedaço
+ */
+static void objCount(ObjChunk *c)
+{
+	const char *p = c->begin;
+
+	while ( p < c->end ) {
+		const char *line = skipSpaces(p, c->end);
+		const char *eol = memchr(line, '\n', c->end - line);
+		char type;
+
+		if ( NULL == eol )
+			eol = c->end;
+		type = objLineType(line, eol);
+		if ( 'v' == type ) {
+			++c->vertices;
+		} else if ( 'g' == type ) {
+			++c->groups;
+		} else if ( 'f' == type ) {
+			const char *s = line + 1;
+			uint n = 0;
+			for (;;) {
+				s = skipSpaces(s, eol);
+				if ( s == eol )
+					break;
+				++n;
+				while ( s < eol && !isBlank(*s) )
+					++s;
+			}
+			if ( n >= 3 )
+				c->triangles += n - 2;
+		}
+		p = eol + 1;
+	}
+}
+
+/**
+ * Passo 2: preenche os vetores da malha com o conteúdo de um pedaço
+ */
+static void objParse(MeshData *mesh, ObjChunk *c)
+{
+	const char *p = c->begin;
+	GLfloat *v = &mesh->vertices[3*c->vertexBase];
+	GLuint *e = &mesh->elements[3*c->triangleBase];
+	uint vertices = c->vertexBase;
+	uint group = c->groupBase;
+
+	while ( p < c->end && !c->error ) {
+		const char *line = skipSpaces(p, c->end);
+		const char *eol = memchr(line, '\n', c->end - line);
+		const char *s = line + 1;
+		char type;
+		int k;
+
+		if ( NULL == eol )
+			eol = c->end;
+		type = objLineType(line, eol);
+		if ( 'v' == type ) {
+			for (k = 0; k < 3; ++k) {
+				s = skipSpaces(s, eol);
+				if ( !parseFloat(&s, eol, &v[k]) )
+					c->error = 1;
+			}
+			v += 3;
+			++vertices;
+		} else if ( 'g' == type ) {
+			mesh->groupOffset[++group] = e - mesh->elements;
+		} else if ( 'f' == type ) {
+			GLuint first = 0, prev = 0;
+			uint n = 0;
+			for (;;) {
+				long idx;
+				s = skipSpaces(s, eol);
+				if ( s == eol )
+					break;
+				if ( !parseInt(&s, eol, &idx) ) {
+					c->error = 1;
+					break;
+				}
+				// Índices negativos são relativos ao último vértice lido
+				idx = idx < 0 ? (long) vertices + idx : idx - 1;
+				if ( idx < 0 || idx >= (long) mesh->vertexCount ) {
+					c->error = 1;
+					break;
+				}
+				while ( s < eol && !isBlank(*s) )
+					++s; // ignora textura e normal
+				if ( 0 == n )
+					first = idx;
+				else if ( n >= 2 ) {
+					e[0] = first;
+					e[1] = prev;
+					e[2] = idx;
+					e += 3;
+				}
+				prev = idx;
+				++n;
+			}
+		}
+		p = eol + 1;
+	}
+}
+
+static void objWorker(void *arg, uint first, uint count)
+{
+	ObjJob *job = arg;
+	uint k;
+
+	for (k = first; k < first + count; ++k) {
+		ObjChunk *c = &job->chunks[k];
+		if ( 0 == job->pass )
+			objCount(c);
+		else
+			objParse(job->mesh, c);
+		releasePages(c->begin, c->end);
+	}
+}
+
+static size_t meshBytes(uint vertices, uint triangles, uint groups)
+{
+	return (size_t) vertices*3*sizeof(GLfloat) +
+	       (size_t) triangles*3*sizeof(GLuint) +
+	       (size_t) (groups + 1)*sizeof(uint);
+}
+
+static int allocMesh(MeshData *mesh, uint vertices, uint triangles,
+		     uint groups, size_t budget)
+{
+	if ( budget > 0 && meshBytes(vertices, triangles, groups) > budget ) {
+		printf("A malha precisa de %zu bytes, acima do limite de %zu\n",
+		       meshBytes(vertices, triangles, groups), budget);
+		return -1;
+	}
+
+	mesh->vertexCount = vertices;
+	mesh->elementCount = 3*triangles;
+	mesh->groupCount = groups;
+	mesh->vertices = malloc((size_t) vertices*3*sizeof(*mesh->vertices));
+	mesh->elements = malloc((size_t) triangles*3*sizeof(*mesh->elements));
+	mesh->groupOffset = malloc((size_t) (groups + 1)*sizeof(*mesh->groupOffset));
+	if ( (vertices > 0 && NULL == mesh->vertices) ||
+	     (triangles > 0 && NULL == mesh->elements) || NULL == mesh->groupOffset ) {
+		printf("Memória insuficiente\n");
+		return -1;
+	}
+	mesh->groupOffset[0] = 0;
+	mesh->groupOffset[groups] = 3*triangles;
+	return 0;
+}
+
+/**
+ * Importa um arquivo OBJ em dois passos paralelos: contagem e preenchimento
+ */
+static int importObj(const char *data, size_t size, size_t budget,
+		     JobSystem *jobs, MeshData *mesh)
+{
+	ObjJob job;
+	JobCounter done = { 0 };
+	uint chunkCount = size / IMPORT_CHUNK_SIZE + 1;
+	uint vertices = 0, triangles = 0, groups = 0;
+	const char *end = data + size;
+	uint k;
+	int result = 0;
+
+	memset(&job, 0, sizeof(job));
+	job.mesh = mesh;
+	job.chunkCount = chunkCount;
+	job.chunks = calloc(chunkCount, sizeof(*job.chunks));
+
+	// Os pedaços começam sempre no início de uma linha
+	job.chunks[0].begin = data;
+	for (k = 1; k < chunkCount; ++k) {
+		const char *b = data + (size_t) k*IMPORT_CHUNK_SIZE;
+		const char *nl = b <= end ? memchr(b - 1, '\n', end - b + 1) : NULL;
+		job.chunks[k].begin = NULL != nl ? nl + 1 : end;
+		if ( job.chunks[k].begin < job.chunks[k - 1].begin )
+			job.chunks[k].begin = job.chunks[k - 1].begin;
+		job.chunks[k - 1].end = job.chunks[k].begin;
+	}
+	job.chunks[chunkCount - 1].end = end;
+
+	parallelFor(jobs, objWorker, &job, chunkCount, 1, &done, NULL);
+	waitJobs(jobs, &done);
+
+	for (k = 0; k < chunkCount; ++k) {
+		ObjChunk *c = &job.chunks[k];
+		c->vertexBase = vertices;
+		c->triangleBase = triangles;
+		c->groupBase = groups;
+		vertices += c->vertices;
+		triangles += c->triangles;
+		groups += c->groups;
+	}
+
+	// O primeiro grupo é implícito
+	if ( allocMesh(mesh, vertices, triangles, groups + 1, budget) ) {
+		result = -1;
+		goto clearMemory;
+	}
+
+	job.pass = 1;
+	parallelFor(jobs, objWorker, &job, chunkCount, 1, &done, NULL);
+	waitJobs(jobs, &done);
+
+	for (k = 0; k < chunkCount; ++k)
+		if ( job.chunks[k].error ) {
+			printf("Arquivo OBJ inválido\n");
+			result = -1;
+		}
+
+clearMemory:
+	free(job.chunks);
+	return result;
+}
+
+static int plyType(const char *name)
+{
+	static const char *names[] = { "char", "uchar", "short", "ushort", "int",
+				       "uint", "float", "double" };
+	static const char *alias[] = { "int8", "uint8", "int16", "uint16",
+				       "int32", "uint32", "float32", "float64" };
+	int i;
+
+	for (i = 0; i < PLY_INVALID; ++i)
+		if ( 0 == strcmp(name, names[i]) || 0 == strcmp(name, alias[i]) )
+			return i;
+	return PLY_INVALID;
+}
+
+static uint plyTypeSize(int type)
+{
+	static const uint size[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+	return size[type];
+}
+
+static double plyValue(const unsigned char *p, int type, int swap)
+{
+	unsigned char b[8];
+	uint n = plyTypeSize(type), i;
+	int8_t i8; uint8_t u8; int16_t i16; uint16_t u16;
+	int32_t i32; uint32_t u32; float f; double d;
+
+	for (i = 0; i < n; ++i)
+		b[i] = swap ? p[n - 1 - i] : p[i];
+
+	switch (type) {
+	case PLY_INT8:	  memcpy(&i8, b, 1);  return i8;
+	case PLY_UINT8:	  memcpy(&u8, b, 1);  return u8;
+	case PLY_INT16:	  memcpy(&i16, b, 2); return i16;
+	case PLY_UINT16:  memcpy(&u16, b, 2); return u16;
+	case PLY_INT32:	  memcpy(&i32, b, 4); return i32;
+	case PLY_UINT32:  memcpy(&u32, b, 4); return u32;
+	case PLY_FLOAT32: memcpy(&f, b, 4);   return f;
+	default:	  memcpy(&d, b, 8);   return d;
+	}
+}
+
+/**
+ * Avança sobre um item de um elemento, validando os limites do arquivo
+ *
+ * @return Início do próximo item, ou NULL se o arquivo terminar antes
+ */
+static const unsigned char* plySkip(const PlyElement *e, const unsigned char *p,
+				    const unsigned char *end, int swap)
+{
+	uint i;
+
+	for (i = 0; i < e->propCount; ++i) {
+		const PlyProperty *prop = &e->prop[i];
+		double n;
+
+		if ( PLY_INVALID == prop->countType ) {
+			p += plyTypeSize(prop->type);
+			continue;
+		}
+		if ( p + plyTypeSize(prop->countType) > end )
+			return NULL;
+		n = plyValue(p, prop->countType, swap);
+		if ( n < 0 )
+			return NULL;
+		p += plyTypeSize(prop->countType) + (size_t) n*plyTypeSize(prop->type);
+	}
+	return p <= end ? p : NULL;
+}
+
+static void plyVertexWorker(void *arg, uint firstBatch, uint batchCount)
+{
+	PlyVertexJob *job = arg;
+	uint batch;
+
+	for (batch = firstBatch; batch < firstBatch + batchCount; ++batch) {
+		uint first = batch*PLY_VERTEX_BATCH;
+		uint last = first + PLY_VERTEX_BATCH < job->count ? first + PLY_VERTEX_BATCH : job->count;
+		uint i;
+		int k;
+
+		for (i = first; i < last; ++i) {
+			const unsigned char *v = job->data + (size_t) i*job->stride;
+			for (k = 0; k < 3; ++k)
+				job->out[3*i + k] = plyValue(v + job->offset[k], job->type[k],
+							     job->swap);
+		}
+		releasePages(job->data + (size_t) first*job->stride,
+			     job->data + (size_t) last*job->stride);
+	}
+}
+
+/**
+ * Importa um arquivo PLY binário
+ *
+ * Os vértices têm tamanho fixo e são convertidos em paralelo. As faces têm
+ * tamanho variável e são percorridas uma vez para contar os triângulos e
+ * outra para preenchê-los.
+ */
+static int importPly(const char *data, size_t size, size_t budget,
+		     JobSystem *jobs, MeshData *mesh)
+{
+	const unsigned char *end = (const unsigned char *) data + size;
+	const unsigned char *p;
+	const char *s = data;
+	PlyElement elem[PLY_MAX_ELEMENTS];
+	PlyElement *vertex = NULL, *face = NULL;
+	uint elemCount = 0, triangles = 0;
+	int swap = -1;
+	uint i, k;
+	const uint16_t one = 1;
+	const int little = *(const unsigned char *) &one;
+
+	// Cabeçalho em texto, terminado por end_header
+	for (;;) {
+		const char *eol = memchr(s, '\n', data + size - s);
+		char line[256], a[64], b[64], c[64], d[64];
+		size_t len;
+
+		if ( NULL == eol ) {
+			printf("Cabeçalho PLY incompleto\n");
+			return -1;
+		}
+		len = eol - s < (long) sizeof(line) - 1 ? (size_t) (eol - s) : sizeof(line) - 1;
+		memcpy(line, s, len);
+		line[len] = '\0';
+		s = eol + 1;
+
+		if ( 0 == strncmp(line, "end_header", 10) )
+			break;
+		if ( 2 == sscanf(line, "format %63s %63s", a, b) ) {
+			if ( 0 == strcmp(a, "binary_little_endian") )
+				swap = !little;
+			else if ( 0 == strcmp(a, "binary_big_endian") )
+				swap = little;
+			else {
+				printf("Somente arquivos PLY binários são suportados\n");
+				return -1;
+			}
+		} else if ( 2 == sscanf(line, "element %31s %63s", a, b) ) {
+			if ( elemCount == PLY_MAX_ELEMENTS )
+				return -1;
+			memset(&elem[elemCount], 0, sizeof(elem[elemCount]));
+			strcpy(elem[elemCount].name, a);
+			elem[elemCount].count = strtoul(b, NULL, 10);
+			++elemCount;
+		} else if ( 0 == strncmp(line, "property", 8) && elemCount > 0 ) {
+			PlyElement *e = &elem[elemCount - 1];
+			PlyProperty *prop = &e->prop[e->propCount];
+			const char *name;
+
+			if ( e->propCount == PLY_MAX_PROPERTIES )
+				return -1;
+			if ( 3 == sscanf(line, "property list %63s %63s %63s", a, b, c) ) {
+				prop->countType = plyType(a);
+				prop->type = plyType(b);
+				name = c;
+			} else if ( 2 == sscanf(line, "property %63s %63s", a, d) ) {
+				prop->countType = PLY_INVALID;
+				prop->type = plyType(a);
+				name = d;
+			} else
+				return -1;
+			if ( PLY_INVALID == prop->type ||
+			     (0 == strncmp(line, "property list", 13) && PLY_INVALID == prop->countType) ) {
+				printf("Tipo PLY desconhecido: %s\n", line);
+				return -1;
+			}
+			prop->role = PLY_OTHER;
+			if ( 0 == strcmp(name, "x") ) prop->role = PLY_X;
+			if ( 0 == strcmp(name, "y") ) prop->role = PLY_Y;
+			if ( 0 == strcmp(name, "z") ) prop->role = PLY_Z;
+			if ( 0 == strcmp(name, "vertex_indices") || 0 == strcmp(name, "vertex_index") )
+				prop->role = PLY_INDICES;
+			++e->propCount;
+		}
+	}
+	if ( -1 == swap ) {
+		printf("Formato PLY não informado\n");
+		return -1;
+	}
+
+	// Passo 1: localiza cada elemento e conta os triângulos
+	p = (const unsigned char *) s;
+	for (i = 0; i < elemCount; ++i) {
+		PlyElement *e = &elem[i];
+		int fixed = 1;
+		uint stride = 0;
+
+		e->data = p;
+		for (k = 0; k < e->propCount; ++k) {
+			if ( PLY_INVALID != e->prop[k].countType )
+				fixed = 0;
+			stride += plyTypeSize(e->prop[k].type);
+		}
+		if ( 0 == strcmp(e->name, "vertex") )
+			vertex = e;
+		if ( 0 == strcmp(e->name, "face") )
+			face = e;
+
+		if ( fixed ) {
+			if ( (size_t) (end - p) / (stride ? stride : 1) < e->count )
+				goto truncated;
+			p += (size_t) e->count*stride;
+			continue;
+		}
+		for (k = 0; k < e->count; ++k) {
+			if ( e == face ) {
+				const unsigned char *q = p;
+				uint j;
+				for (j = 0; j < e->propCount && NULL != q; ++j) {
+					const PlyProperty *prop = &e->prop[j];
+					if ( PLY_INVALID == prop->countType ) {
+						q += plyTypeSize(prop->type);
+						continue;
+					}
+					if ( q + plyTypeSize(prop->countType) > end )
+						goto truncated;
+					if ( PLY_INDICES == prop->role ) {
+						double n = plyValue(q, prop->countType, swap);
+						if ( n >= 3 )
+							triangles += n - 2;
+					}
+					q += plyTypeSize(prop->countType) +
+					     (size_t) plyValue(q, prop->countType, swap)*plyTypeSize(prop->type);
+				}
+			}
+			p = plySkip(e, p, end, swap);
+			if ( NULL == p )
+				goto truncated;
+		}
+	}
+	if ( NULL == vertex ) {
+		printf("Arquivo PLY sem vértices\n");
+		return -1;
+	}
+
+	if ( allocMesh(mesh, vertex->count, triangles, 1, budget) )
+		return -1;
+
+	// Passo 2: vértices em paralelo
+	{
+		PlyVertexJob job;
+		JobCounter done = { 0 };
+
+		memset(&job, 0, sizeof(job));
+		job.data = vertex->data;
+		job.swap = swap;
+		job.out = mesh->vertices;
+		job.count = vertex->count;
+		for (k = 0; k < 3; ++k)
+			job.type[k] = PLY_INVALID;
+		for (k = 0; k < vertex->propCount; ++k) {
+			const PlyProperty *prop = &vertex->prop[k];
+			if ( PLY_INVALID != prop->countType ) {
+				printf("Vértices PLY com listas não são suportados\n");
+				return -1;
+			}
+			if ( prop->role <= PLY_Z ) {
+				job.offset[prop->role] = job.stride;
+				job.type[prop->role] = prop->type;
+			}
+			job.stride += plyTypeSize(prop->type);
+		}
+		for (k = 0; k < 3; ++k)
+			if ( PLY_INVALID == job.type[k] ) {
+				printf("Vértices PLY sem as coordenadas x, y e z\n");
+				return -1;
+			}
+		parallelFor(jobs, plyVertexWorker, &job,
+			    (vertex->count + PLY_VERTEX_BATCH - 1) / PLY_VERTEX_BATCH,
+			    1, &done, NULL);
+		waitJobs(jobs, &done);
+	}
+
+	// Passo 2: faces, triangularizadas em leque
+	if ( NULL != face ) {
+		GLuint *out = mesh->elements;
+
+		p = face->data;
+		for (i = 0; i < face->count; ++i) {
+			for (k = 0; k < face->propCount; ++k) {
+				const PlyProperty *prop = &face->prop[k];
+				uint n, j, size;
+
+				if ( PLY_INVALID == prop->countType ) {
+					p += plyTypeSize(prop->type);
+					continue;
+				}
+				n = plyValue(p, prop->countType, swap);
+				p += plyTypeSize(prop->countType);
+				size = plyTypeSize(prop->type);
+				if ( PLY_INDICES == prop->role )
+					for (j = 0; j < n; ++j) {
+						double idx = plyValue(p + j*size, prop->type, swap);
+						if ( idx < 0 || idx >= mesh->vertexCount ) {
+							printf("Índice PLY fora dos limites\n");
+							return -1;
+						}
+						if ( j >= 2 ) {
+							out[0] = plyValue(p, prop->type, swap);
+							out[1] = plyValue(p + (j - 1)*size, prop->type, swap);
+							out[2] = idx;
+							out += 3;
+						}
+					}
+				p += (size_t) n*size;
+			}
+		}
+		releasePages(face->data, p);
+	}
+
+	return 0;
+
+truncated:
+	printf("Arquivo PLY truncado\n");
+	return -1;
+}
+
+/**
+ * Importa uma malha de um arquivo OBJ ou PLY binário
+ *
+ * O arquivo é mapeado na memória e lido diretamente, sem cópias. Os arquivos
+ * grandes são divididos em pedaços processados em paralelo pelo sistema de
+ * trabalhos. Os vetores da malha são alocados uma única vez, já com o tamanho
+ * final. As páginas do arquivo são liberadas à medida que são processadas. A
+ * vazão da leitura é mostrada ao final.
+ *
+ * @param name Nome do arquivo. O formato é escolhido pela extensão
+ * @param budget Memória máxima, em bytes, para a malha importada. 0 para
+ *               não limitar
+ * @param jobs Sistema de trabalhos. Se NULL, o arquivo é processado na
+ *             thread atual
+ * @param mesh Estrutura que recebe a malha. Deve ser liberada com releaseMesh
+ * @return 0 em caso de sucesso
+ */
+int importMesh(const char *name, size_t budget, JobSystem *jobs,
+	       MeshData *mesh)
+{
+	const char *ext = strrchr(name, '.');
+	struct stat st;
+	void *data;
+	double start = monotonicClock(), elapsed;
+	int fd, result;
+
+	assert(NULL != name);
+	assert(NULL != mesh);
+
+	memset(mesh, 0, sizeof(*mesh));
+	printf("Lendo o arquivo: %s\n", name);
+
+	fd = open(name, O_RDONLY);
+	if ( fd < 0 || fstat(fd, &st) < 0 || 0 == st.st_size ) {
+		printf("Incapaz de abrir ou ler o arquivo %s\n", name);
+		if ( fd >= 0 )
+			close(fd);
+		return -1;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( MAP_FAILED == data ) {
+		printf("Incapaz de mapear o arquivo %s\n", name);
+		return -1;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	if ( NULL != ext && 0 == strcasecmp(ext, ".obj") )
+		result = importObj(data, st.st_size, budget, jobs, mesh);
+	else if ( NULL != ext && 0 == strcasecmp(ext, ".ply") )
+		result = importPly(data, st.st_size, budget, jobs, mesh);
+	else {
+		printf("Formato desconhecido: %s\n", name);
+		result = -1;
+	}
+	munmap(data, st.st_size);
+
+	if ( result ) {
+		releaseMesh(mesh);
+		return result;
+	}
+
+	elapsed = monotonicClock() - start;
+	printf("%u vértices e %u triângulos em %.3f s (%.1f MB/s)\n",
+	       mesh->vertexCount, mesh->elementCount / 3, elapsed,
+	       st.st_size / (1024.*1024.) / (elapsed > 0. ? elapsed : 1e-9));
+	return 0;
+}
+
+/**
+ * Usa uma malha importada como buffer e faces de uma primitiva
+ *
+ * Cada grupo não vazio da malha vira uma face. A primitiva guarda ponteiros
+ * para a malha, que deve continuar válida enquanto a primitiva for usada.
+ */
+void loadPrimitiveFromMesh(Primitive *base, uint position, uint maxCount,
+			   const MeshData *mesh)
+{
+	uint i, faces = 0;
+
+	assert(NULL != mesh);
+
+	setPrimitiveBuffer(base, position, maxCount, mesh->vertices,
+			   (GLsizeiptr) mesh->vertexCount*3*sizeof(GLfloat));
+
+	for (i = 0; i < mesh->groupCount; ++i)
+		if ( mesh->groupOffset[i + 1] > mesh->groupOffset[i] )
+			++faces;
+	initPrimitiveFaceArray(base, position, maxCount, faces);
+
+	for (i = 0, faces = 0; i < mesh->groupCount; ++i) {
+		Faces *f;
+
+		if ( mesh->groupOffset[i + 1] == mesh->groupOffset[i] )
+			continue;
+		f = getPrimitiveFaceElement(base, position, maxCount, faces++);
+		initFace(f);
+		setFace(f, &mesh->elements[mesh->groupOffset[i]],
+			mesh->groupOffset[i + 1] - mesh->groupOffset[i]);
+	}
+}
+
+/**
+ * Libera a memória de uma malha importada
+ */
+void releaseMesh(MeshData *mesh)
+{
+	assert(NULL != mesh);
+
+	free(mesh->vertices);
+	free(mesh->elements);
+	free(mesh->groupOffset);
+	memset(mesh, 0, sizeof(*mesh));
+}
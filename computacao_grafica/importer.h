@@ -0,0 +1,41 @@
+#ifndef __IMPORTER_H
+#define __IMPORTER_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "primitive.h"
+# include "jobs.h"
+
+/**
+ * Tamanho de cada pedaço do arquivo processado por uma thread. Também limita
+ * a quantidade de páginas do arquivo mantidas na memória ao mesmo tempo
+ */
+#define IMPORT_CHUNK_SIZE	(16u << 20)
+
+/**
+ * @brief Malha importada de um arquivo
+ *
+ * Os vértices possuem somente posições, com 3 GLfloat cada. Os triângulos
+ * estão agrupados conforme os grupos do arquivo: o grupo i vai do elemento
+ * groupOffset[i] até groupOffset[i + 1].
+ */
+typedef struct MeshData
+{
+	GLfloat		*vertices;	/**< posições dos vértices */
+	uint		vertexCount;	/**< quantidade de vértices */
+	GLuint		*elements;	/**< triângulos, 3 elementos cada */
+	uint		elementCount;	/**< quantidade de elementos */
+	uint		*groupOffset;	/**< início de cada grupo, mais o final do último */
+	uint		groupCount;	/**< quantidade de grupos */
+} MeshData;
+
+int importMesh(const char *name, size_t budget, JobSystem *jobs,
+	       MeshData *mesh);
+
+void loadPrimitiveFromMesh(Primitive *base, uint position, uint maxCount,
+			   const MeshData *mesh);
+
+void releaseMesh(MeshData *mesh);
+
+#endif
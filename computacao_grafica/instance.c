@@ -0,0 +1,67 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "linmath.h"
+#include "primitive.h"
+#include "instance.h"
+
+/**
+ * Cria instâncias da primeira primitiva, na origem
+ */
+Instance* createInstances(uint instanceCount)
+{
+	Instance *tmp;
+	uint i;
+
+	assert(instanceCount > 0);
+
+	tmp = calloc(instanceCount, sizeof(*tmp));
+	for (i = 0; i < instanceCount; ++i)
+		mat4x4_identity(tmp[i].transf);
+	return tmp;
+}
+
+void destroyInstances(Instance *inst)
+{
+	free(inst);
+}
+
+/**
+ * Cria uma instância de cada primitiva, com a matriz da própria primitiva
+ *
+ * É o equivalente, em instâncias, de desenhar o array de primitivas.
+ *
+ * @return count instâncias, na ordem das primitivas
+ */
+Instance* instantiatePrimitives(Primitive *p, uint count)
+{
+	Instance *inst;
+	uint i;
+
+	assert(NULL != p);
+
+	inst = createInstances(count);
+	for (i = 0; i < count; ++i)
+		setInstance(inst, i, count, i, *getPrimitiveTransformation(p, i, count));
+	return inst;
+}
+
+void setInstance(Instance *base, uint position, uint maxCount, uint prefab,
+		 mat4x4 matrix)
+{
+	assert(position < maxCount);
+	assert(NULL != base);
+
+	base[position].prefab = prefab;
+	mat4x4_dup(base[position].transf, matrix);
+}
+
+mat4x4* getInstanceTransformation(Instance *base, uint position, uint maxCount)
+{
+	assert(position < maxCount);
+	assert(NULL != base);
+
+	return &base[position].transf;
+}
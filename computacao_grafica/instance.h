@@ -0,0 +1,34 @@
+#ifndef __INSTANCE_H
+#define __INSTANCE_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+# include "primitive.h"
+
+/**
+ * @brief Uma ocorrência de uma primitiva na cena
+ *
+ * A primitiva funciona como um modelo (prefab): vértices, faces, meshlets e
+ * níveis de detalhe existem uma única vez, na memória e no driver de vídeo.
+ * Cada instância guarda somente onde a primitiva aparece.
+ */
+typedef struct Instance
+{
+	mat4x4		transf;		/**< Matriz de transformação. Substitui a da primitiva */
+	uint		prefab;		/**< Posição da primitiva no array de primitivas */
+} Instance;
+
+Instance* createInstances(uint instanceCount);
+
+void destroyInstances(Instance *inst);
+
+Instance* instantiatePrimitives(Primitive *p, uint count);
+
+void setInstance(Instance *base, uint position, uint maxCount, uint prefab,
+		 mat4x4 matrix);
+
+mat4x4* getInstanceTransformation(Instance *base, uint position, uint maxCount);
+
+#endif
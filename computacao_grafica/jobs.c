@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "jobs.h"
+#include "platform.h"
+
+/**
+ * Fila da thread atual. NULL fora das threads de um sistema
+ */
+static __thread JobQueue *ownQueue = NULL;
+
+static uint threadCount()
+{
+	uint n = processorCount();
+
+	return n > JOB_MAX_THREADS ? JOB_MAX_THREADS : n;
+}
+
+/**
+ * Fila onde a thread atual insere: a sua, ou a 0 se não pertence ao sistema
+ */
+static JobQueue* currentQueue(JobSystem *js)
+{
+	if ( NULL != ownQueue && ownQueue->system == js )
+		return ownQueue;
+	return &js->queues[0];
+}
+
+static void executeJob(JobSystem *js, Job *job);
+
+/**
+ * Coloca um trabalho pronto na fila da thread atual e acorda uma thread
+ */
+static void pushJob(JobSystem *js, Job *job)
+{
+	JobQueue *q = currentQueue(js);
+
+	pthread_mutex_lock(&q->lock);
+	if ( q->bottom - q->top == JOB_QUEUE_SIZE ) {
+		pthread_mutex_unlock(&q->lock);
+		executeJob(js, job);
+		return;
+	}
+	q->jobs[q->bottom % JOB_QUEUE_SIZE] = *job;
+	++q->bottom;
+	pthread_mutex_unlock(&q->lock);
+
+	// O incremento é uma barreira: ou a thread que vai dormir vê o trabalho,
+	// ou este ponto a vê dormindo
+	__sync_fetch_and_add(&js->queued, 1);
+	if ( js->sleeping > 0 ) {
+		pthread_mutex_lock(&js->lock);
+		pthread_cond_signal(&js->wake);
+		pthread_mutex_unlock(&js->lock);
+	}
+}
+
+/**
+ * Retira um trabalho: o último da própria fila ou, sem nenhum, o primeiro da
+ * fila de outra thread
+ *
+ * @return 1 se encontrou um trabalho
+ */
+static int takeJob(JobSystem *js, Job *job)
+{
+	JobQueue *own = currentQueue(js);
+	uint i;
+
+	if ( 0 == js->queued )
+		return 0;
+
+	pthread_mutex_lock(&own->lock);
+	if ( own->bottom != own->top ) {
+		--own->bottom;
+		*job = own->jobs[own->bottom % JOB_QUEUE_SIZE];
+		pthread_mutex_unlock(&own->lock);
+		__sync_fetch_and_sub(&js->queued, 1);
+		return 1;
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	// Cada thread começa a roubar por uma fila diferente
+	for (i = 1; i < js->threadCount; ++i) {
+		JobQueue *q = &js->queues[(own->index + i) % js->threadCount];
+
+		// Lida sem a trava: somente evita travar filas vazias
+		if ( q->bottom == q->top )
+			continue;
+		pthread_mutex_lock(&q->lock);
+		if ( q->bottom != q->top ) {
+			*job = q->jobs[q->top % JOB_QUEUE_SIZE];
+			++q->top;
+			pthread_mutex_unlock(&q->lock);
+			__sync_fetch_and_sub(&js->queued, 1);
+			return 1;
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	return 0;
+}
+
+/**
+ * Marca um trabalho do grupo como terminado
+ *
+ * O último libera os trabalhos que dependiam do grupo. O decremento é feito
+ * com a trava: waitJobs passa por ela antes de devolver o contador.
+ */
+static void finishJob(JobSystem *js, JobCounter *c)
+{
+	Job released[JOB_COUNTER_WAITING];
+	uint i, count = 0;
+
+	if ( NULL == c )
+		return;
+
+	pthread_mutex_lock(&js->lock);
+	if ( 0 == __sync_sub_and_fetch(&c->pending, 1) ) {
+		count = c->waitingCount;
+		memcpy(released, c->waiting, count*sizeof(*released));
+		c->waitingCount = 0;
+	}
+	pthread_mutex_unlock(&js->lock);
+
+	for (i = 0; i < count; ++i)
+		pushJob(js, &released[i]);
+}
+
+/**
+ * Executa um trabalho
+ *
+ * Intervalos maiores que o grão são divididos ao meio, e a segunda metade
+ * vai para a fila, onde pode ser roubada, até restar um grão.
+ */
+static void executeJob(JobSystem *js, Job *job)
+{
+	while ( job->count > job->grain ) {
+		Job rest = *job;
+		uint half = job->count / 2;
+
+		rest.first = job->first + half;
+		rest.count = job->count - half;
+		job->count = half;
+		if ( NULL != rest.done )
+			__sync_fetch_and_add(&rest.done->pending, 1);
+		pushJob(js, &rest);
+	}
+	job->run(job->arg, job->first, job->count);
+	finishJob(js, job->done);
+}
+
+static void* jobWorker(void *arg)
+{
+	JobQueue *q = arg;
+	JobSystem *js = q->system;
+	Job job;
+
+	ownQueue = q;
+	for (;;) {
+		if ( takeJob(js, &job) ) {
+			executeJob(js, &job);
+			continue;
+		}
+
+		pthread_mutex_lock(&js->lock);
+		__sync_fetch_and_add(&js->sleeping, 1);
+		while ( !js->quit && 0 == js->queued )
+			pthread_cond_wait(&js->wake, &js->lock);
+		__sync_fetch_and_sub(&js->sleeping, 1);
+		if ( js->quit ) {
+			pthread_mutex_unlock(&js->lock);
+			break;
+		}
+		pthread_mutex_unlock(&js->lock);
+	}
+	ownQueue = NULL;
+	return NULL;
+}
+
+/**
+ * Cria as threads de um sistema de trabalhos
+ *
+ * @param threads Quantidade de threads, incluindo a atual. 0 para uma por
+ *                processador
+ * @return 0 em caso de sucesso. Sem threads extras, os trabalhos são
+ *         executados pela thread atual, em waitJobs
+ */
+int initJobSystem(JobSystem *js, uint threads)
+{
+	uint i;
+
+	assert(NULL != js);
+
+	memset(js, 0, sizeof(*js));
+	if ( 0 == threads )
+		threads = threadCount();
+	if ( threads > JOB_MAX_THREADS )
+		threads = JOB_MAX_THREADS;
+
+	js->queues = calloc(threads, sizeof(*js->queues));
+	js->threads = malloc(threads*sizeof(*js->threads));
+	pthread_mutex_init(&js->lock, NULL);
+	pthread_cond_init(&js->wake, NULL);
+
+	// A fila 0 é da thread atual. As demais só existem se a thread for criada
+	for (i = 0; i < threads; ++i) {
+		JobQueue *q = &js->queues[i];
+
+		q->system = js;
+		q->index = i;
+		pthread_mutex_init(&q->lock, NULL);
+		if ( i > 0 && pthread_create(&js->threads[i - 1], NULL, jobWorker, q) ) {
+			printf("Incapaz de criar a thread de trabalho %u\n", i);
+			pthread_mutex_destroy(&q->lock);
+			break;
+		}
+		++js->threadCount;
+	}
+	printf("Sistema de trabalhos com %u threads\n", js->threadCount);
+	return js->threadCount == threads ? 0 : -1;
+}
+
+/**
+ * Cria um trabalho, ou o guarda até o grupo do qual depende terminar
+ */
+static void submitJob(JobSystem *js, Job *job, JobCounter *after)
+{
+	if ( NULL != job->done )
+		__sync_fetch_and_add(&job->done->pending, 1);
+
+	if ( NULL != after ) {
+		pthread_mutex_lock(&js->lock);
+		if ( after->pending > 0 && after->waitingCount < JOB_COUNTER_WAITING ) {
+			after->waiting[after->waitingCount++] = *job;
+			pthread_mutex_unlock(&js->lock);
+			return;
+		}
+		pthread_mutex_unlock(&js->lock);
+		// Sem espaço para esperar: espera aqui
+		waitJobs(js, after);
+	}
+	pushJob(js, job);
+}
+
+/**
+ * Cria um trabalho de um único item
+ *
+ * @param js Sistema de trabalhos. Se NULL, o trabalho é executado na hora
+ * @param done Contador do grupo do trabalho. Pode ser NULL
+ * @param after Grupo que deve terminar antes do trabalho começar. Pode ser
+ *              NULL
+ */
+void runJob(JobSystem *js, JobFunction run, void *arg, JobCounter *done,
+	    JobCounter *after)
+{
+	parallelFor(js, run, arg, 1, 1, done, after);
+}
+
+/**
+ * Divide os itens [0, count) entre as threads
+ *
+ * O intervalo é dividido ao meio enquanto for maior que o grão; as metades
+ * são roubadas pelas threads sem trabalho. A função recebe intervalos de no
+ * máximo grain itens, e pode ser chamada por várias threads ao mesmo tempo.
+ *
+ * @param js Sistema de trabalhos. Se NULL, todos os itens são executados na
+ *           hora, pela thread atual
+ * @param grain Itens executados por uma thread de uma vez. Grãos pequenos
+ *              dividem melhor, mas criam mais trabalhos
+ * @param done Contador do grupo do trabalho. Pode ser NULL
+ * @param after Grupo que deve terminar antes do trabalho começar. Pode ser
+ *              NULL
+ */
+void parallelFor(JobSystem *js, JobFunction run, void *arg, uint count,
+		 uint grain, JobCounter *done, JobCounter *after)
+{
+	Job job;
+
+	assert(NULL != run);
+	assert(grain > 0);
+
+	if ( 0 == count )
+		return;
+	if ( NULL == js ) {
+		uint first;
+
+		assert(NULL == after || 0 == after->pending);
+		for (first = 0; first < count; first += grain)
+			run(arg, first, count - first < grain ? count - first : grain);
+		return;
+	}
+
+	job.run = run;
+	job.arg = arg;
+	job.first = 0;
+	job.count = count;
+	job.grain = grain;
+	job.done = done;
+	submitJob(js, &job, after);
+}
+
+/**
+ * Espera um grupo de trabalhos terminar, executando trabalhos enquanto isso
+ *
+ * Pode ser chamada de dentro de um trabalho. Depois dela, o contador pode ser
+ * reutilizado.
+ */
+void waitJobs(JobSystem *js, JobCounter *counter)
+{
+	Job job;
+
+	assert(NULL != counter);
+
+	if ( NULL == js )
+		return;
+	while ( counter->pending > 0 ) {
+		if ( takeJob(js, &job) )
+			executeJob(js, &job);
+		else
+			sched_yield();
+	}
+	// finishJob pode ainda estar com o contador
+	pthread_mutex_lock(&js->lock);
+	pthread_mutex_unlock(&js->lock);
+}
+
+/**
+ * Encerra as threads. Os trabalhos devem ter terminado
+ */
+void shutdownJobSystem(JobSystem *js)
+{
+	uint i;
+
+	assert(NULL != js);
+
+	if ( NULL == js->queues )
+		return;
+
+	pthread_mutex_lock(&js->lock);
+	js->quit = 1;
+	pthread_cond_broadcast(&js->wake);
+	pthread_mutex_unlock(&js->lock);
+	for (i = 1; i < js->threadCount; ++i)
+		pthread_join(js->threads[i - 1], NULL);
+
+	for (i = 0; i < js->threadCount; ++i)
+		pthread_mutex_destroy(&js->queues[i].lock);
+	pthread_cond_destroy(&js->wake);
+	pthread_mutex_destroy(&js->lock);
+	free(js->threads);
+	free(js->queues);
+	memset(js, 0, sizeof(*js));
+}
@@ -0,0 +1,104 @@
+#ifndef __JOBS_H
+#define __JOBS_H
+
+# include <stdlib.h>
+# include <pthread.h>
+
+/**
+ * Quantidade máxima de threads do sistema, incluindo a que o criou
+ */
+#define JOB_MAX_THREADS		64
+/**
+ * Trabalhos na fila de cada thread. Com a fila cheia, um trabalho novo é
+ * executado na hora, por quem o criou
+ */
+#define JOB_QUEUE_SIZE		1024
+/**
+ * Trabalhos que podem esperar por um mesmo contador
+ */
+#define JOB_COUNTER_WAITING	8
+
+/**
+ * @brief Executa os itens [first, first + count) de um intervalo
+ */
+typedef void (*JobFunction)(void *arg, uint first, uint count);
+
+struct JobCounter;
+
+/**
+ * @brief Um intervalo de itens a ser executado por alguma thread
+ */
+typedef struct Job
+{
+	JobFunction		run;
+	void			*arg;
+	uint			first;	/**< primeiro item */
+	uint			count;	/**< quantidade de itens */
+	uint			grain;	/**< intervalos maiores são divididos antes de executar */
+	struct JobCounter	*done;	/**< decrementado quando o intervalo termina. Pode ser NULL */
+} Job;
+
+/**
+ * @brief Conta os trabalhos ainda não terminados de um grupo
+ *
+ * Deve começar zerado. Trabalhos criados com o contador como dependência só
+ * entram nas filas quando ele chega a zero. O contador deve continuar válido
+ * até waitJobs.
+ */
+typedef struct JobCounter
+{
+	volatile int	pending;			/**< trabalhos não terminados */
+	Job		waiting[JOB_COUNTER_WAITING];	/**< trabalhos que dependem deste grupo */
+	uint		waitingCount;
+} JobCounter;
+
+struct JobSystem;
+
+/**
+ * @brief Fila de uma thread
+ *
+ * A dona insere e retira no fim, o último trabalho primeiro: os dados ainda
+ * estão no cache. As demais roubam do início, os trabalhos mais antigos, que
+ * costumam ser os maiores intervalos.
+ */
+typedef struct JobQueue
+{
+	Job			jobs[JOB_QUEUE_SIZE];	/**< buffer circular */
+	uint			top;			/**< início, onde as outras threads roubam */
+	uint			bottom;			/**< fim, onde a dona insere e retira */
+	struct JobSystem	*system;
+	uint			index;			/**< posição da fila no sistema */
+	pthread_mutex_t		lock;
+} JobQueue;
+
+/**
+ * @brief Grupo de threads com roubo de trabalho
+ *
+ * A thread que cria o sistema usa a fila 0 e executa trabalhos enquanto
+ * espera por eles em waitJobs.
+ */
+typedef struct JobSystem
+{
+	uint		threadCount;	/**< threads, incluindo a que criou o sistema */
+	JobQueue	*queues;	/**< uma por thread */
+	pthread_t	*threads;	/**< threads criadas, threadCount - 1 */
+	volatile int	queued;		/**< trabalhos nas filas */
+	volatile int	sleeping;	/**< threads esperando por trabalho */
+	int		quit;		/**< pede o fim das threads */
+	pthread_mutex_t	lock;		/**< protege sleeping e as esperas dos contadores */
+	pthread_cond_t	wake;
+} JobSystem;
+
+int initJobSystem(JobSystem *js, uint threads);
+
+void runJob(JobSystem *js, JobFunction run, void *arg, JobCounter *done,
+	    JobCounter *after);
+
+void parallelFor(JobSystem *js, JobFunction run, void *arg, uint count,
+		 uint grain, JobCounter *done, JobCounter *after);
+
+void waitJobs(JobSystem *js, JobCounter *counter);
+
+void shutdownJobSystem(JobSystem *js);
+
+#endif
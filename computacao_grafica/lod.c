@@ -0,0 +1,352 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "lod.h"
+
+/**
+ * Quádrica simétrica 4x4: a², ab, ac, ad, b², bc, bd, c², cd, d²
+ */
+typedef struct Quadric
+{
+	double q[10];
+} Quadric;
+
+typedef struct Edge
+{
+	GLuint a, b;
+} Edge;
+
+typedef struct Collapse
+{
+	double cost;
+	GLuint from, to;
+} Collapse;
+
+static void quadricAddPlane(Quadric *Q, double a, double b, double c, double d)
+{
+	Q->q[0] += a*a; Q->q[1] += a*b; Q->q[2] += a*c; Q->q[3] += a*d;
+	Q->q[4] += b*b; Q->q[5] += b*c; Q->q[6] += b*d;
+	Q->q[7] += c*c; Q->q[8] += c*d;
+	Q->q[9] += d*d;
+}
+
+static double quadricEval(const Quadric *A, const Quadric *B, const GLfloat *p)
+{
+	double q[10];
+	double x = p[0], y = p[1], z = p[2];
+	int i;
+
+	for (i = 0; i < 10; ++i)
+		q[i] = A->q[i] + B->q[i];
+
+	return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+	     + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+	     + q[7]*z*z + 2*q[8]*z
+	     + q[9];
+}
+
+static int compareEdge(const void *a, const void *b)
+{
+	const Edge *x = a, *y = b;
+
+	if ( x->a != y->a )
+		return x->a < y->a ? -1 : 1;
+	if ( x->b != y->b )
+		return x->b < y->b ? -1 : 1;
+	return 0;
+}
+
+static int compareCollapse(const void *a, const void *b)
+{
+	const Collapse *x = a, *y = b;
+
+	if ( x->cost != y->cost )
+		return x->cost < y->cost ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Gera as arestas únicas de uma lista de triângulos, ordenadas
+ *
+ * @param border Se não for NULL, recebe 1 nos vértices de arestas de borda
+ * @return Quantidade de arestas únicas
+ */
+static uint buildEdges(const GLuint *tris, uint count, Edge *edges,
+		       unsigned char *border)
+{
+	uint i, n = 0, unique = 0;
+
+	for (i = 0; i < count; ++i) {
+		GLuint a = tris[i];
+		GLuint b = tris[i % 3 == 2 ? i - 2 : i + 1];
+		edges[n].a = a < b ? a : b;
+		edges[n].b = a < b ? b : a;
+		++n;
+	}
+	qsort(edges, n, sizeof(*edges), compareEdge);
+
+	for (i = 0; i < n; ) {
+		uint j = i + 1;
+		while ( j < n && 0 == compareEdge(&edges[i], &edges[j]) )
+			++j;
+		if ( NULL != border && 1 == j - i ) {
+			border[edges[i].a] = 1;
+			border[edges[i].b] = 1;
+		}
+		edges[unique++] = edges[i];
+		i = j;
+	}
+	return unique;
+}
+
+/**
+ * Verifica se mover o vértice from para to inverte algum triângulo vizinho
+ */
+static int collapseFlips(const GLfloat *points, uint stride, const GLuint *tris,
+			 const uint *offset, const uint *adj, GLuint from, GLuint to)
+{
+	uint i;
+
+	for (i = offset[from]; i < offset[from + 1]; ++i) {
+		const GLuint *tri = &tris[3*adj[i]];
+		vec3 e1, e2, before, after;
+		const GLfloat *p[3];
+		int k;
+
+		if ( tri[0] == to || tri[1] == to || tri[2] == to )
+			continue; // vira degenerado e será removido
+
+		for (k = 0; k < 3; ++k)
+			p[k] = &points[stride*tri[k]];
+		vec3_sub(e1, (float *) p[1], (float *) p[0]);
+		vec3_sub(e2, (float *) p[2], (float *) p[0]);
+		vec3_mul_cross(before, e1, e2);
+
+		for (k = 0; k < 3; ++k)
+			if ( tri[k] == from )
+				p[k] = &points[stride*to];
+		vec3_sub(e1, (float *) p[1], (float *) p[0]);
+		vec3_sub(e2, (float *) p[2], (float *) p[0]);
+		vec3_mul_cross(after, e1, e2);
+
+		if ( vec3_mul_inner(before, after) <= 0.f )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Simplifica uma lista de triângulos por métricas de erro quádricas
+ *
+ * Arestas são colapsadas em um dos seus vértices, em ordem crescente de erro,
+ * até atingir a quantidade desejada de elementos. Nenhum vértice novo é
+ * criado, logo o resultado usa o mesmo vetor de vértices. Vértices de borda
+ * são mantidos e colapsos que invertem triângulos são rejeitados.
+ *
+ * @param points Posição do primeiro vértice
+ * @param stride Distância entre dois vértices, em GLfloat
+ * @param tris Lista de triângulos, 3 elementos por triângulo
+ * @param count Quantidade de elementos em tris
+ * @param targetCount Quantidade desejada de elementos
+ * @param out Vetor de saída, com pelo menos count elementos
+ * @param error Recebe o maior erro introduzido, em unidades do objeto
+ * @return Quantidade de elementos escritos em out
+ */
+uint simplifyMesh(const GLfloat *points, uint stride, const GLuint *tris,
+		  uint count, uint targetCount, GLuint *out, GLfloat *error)
+{
+	uint vertexCount = 0;
+	Quadric *quadrics;
+	unsigned char *locked, *touched;
+	GLuint *remap;
+	Edge *edges;
+	Collapse *collapses;
+	uint *offset, *adj;
+	double maxCost = 0.;
+	uint i, n;
+
+	assert(NULL != points);
+	assert(NULL != tris);
+	assert(NULL != out);
+
+	n = count - count % 3;
+	memcpy(out, tris, n*sizeof(*out));
+	if ( NULL != error )
+		*error = 0.f;
+	if ( 0 == n )
+		return 0;
+
+	for (i = 0; i < n; ++i)
+		if ( tris[i] >= vertexCount )
+			vertexCount = tris[i] + 1;
+
+	quadrics = calloc(vertexCount, sizeof(*quadrics));
+	locked = calloc(vertexCount, sizeof(*locked));
+	touched = malloc(vertexCount*sizeof(*touched));
+	remap = malloc(vertexCount*sizeof(*remap));
+	edges = malloc(n*sizeof(*edges));
+	collapses = malloc(n*sizeof(*collapses));
+	offset = malloc((vertexCount + 1)*sizeof(*offset));
+	adj = malloc(n*sizeof(*adj));
+
+	// Quádrica de cada vértice: soma dos planos dos triângulos incidentes
+	for (i = 0; i < n; i += 3) {
+		vec3 e1, e2, nrm;
+		double d;
+		int k;
+
+		vec3_sub(e1, (float *) &points[stride*tris[i + 1]], (float *) &points[stride*tris[i]]);
+		vec3_sub(e2, (float *) &points[stride*tris[i + 2]], (float *) &points[stride*tris[i]]);
+		vec3_mul_cross(nrm, e1, e2);
+		if ( vec3_len(nrm) <= 0.f )
+			continue;
+		vec3_norm(nrm, nrm);
+		d = -vec3_mul_inner(nrm, (float *) &points[stride*tris[i]]);
+		for (k = 0; k < 3; ++k)
+			quadricAddPlane(&quadrics[tris[i + k]], nrm[0], nrm[1], nrm[2], d);
+	}
+	buildEdges(tris, n, edges, locked);
+
+	while ( n > targetCount ) {
+		uint edgeCount, candidates = 0, collapsed = 0;
+		uint limit = (n - targetCount) / 6 + 1;
+		uint *fill;
+
+		for (i = 0; i < vertexCount; ++i)
+			remap[i] = i;
+		memset(touched, 0, vertexCount*sizeof(*touched));
+
+		// Triângulos incidentes em cada vértice
+		memset(offset, 0, (vertexCount + 1)*sizeof(*offset));
+		for (i = 0; i < n; ++i)
+			++offset[out[i] + 1];
+		for (i = 0; i < vertexCount; ++i)
+			offset[i + 1] += offset[i];
+		fill = malloc(vertexCount*sizeof(*fill));
+		memcpy(fill, offset, vertexCount*sizeof(*fill));
+		for (i = 0; i < n; ++i)
+			adj[fill[out[i]]++] = i / 3;
+		free(fill);
+
+		edgeCount = buildEdges(out, n, edges, NULL);
+		for (i = 0; i < edgeCount; ++i) {
+			GLuint a = edges[i].a, b = edges[i].b;
+			double ab = HUGE_VAL, ba = HUGE_VAL;
+
+			if ( a == b )
+				continue;
+			if ( !locked[a] )
+				ab = quadricEval(&quadrics[a], &quadrics[b], &points[stride*b]);
+			if ( !locked[b] )
+				ba = quadricEval(&quadrics[a], &quadrics[b], &points[stride*a]);
+			if ( HUGE_VAL == ab && HUGE_VAL == ba )
+				continue;
+
+			collapses[candidates].cost = ab <= ba ? ab : ba;
+			collapses[candidates].from = ab <= ba ? a : b;
+			collapses[candidates].to = ab <= ba ? b : a;
+			++candidates;
+		}
+		qsort(collapses, candidates, sizeof(*collapses), compareCollapse);
+
+		// Cada vértice participa de no máximo um colapso por passada
+		for (i = 0; i < candidates && collapsed < limit; ++i) {
+			GLuint from = collapses[i].from, to = collapses[i].to;
+			uint j;
+
+			if ( touched[from] || touched[to] )
+				continue;
+			if ( collapseFlips(points, stride, out, offset, adj, from, to) )
+				continue;
+
+			for (j = offset[from]; j < offset[from + 1]; ++j) {
+				const GLuint *tri = &out[3*adj[j]];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			remap[from] = to;
+			for (j = 0; j < 10; ++j)
+				quadrics[to].q[j] += quadrics[from].q[j];
+			if ( collapses[i].cost > maxCost )
+				maxCost = collapses[i].cost;
+			++collapsed;
+		}
+		if ( 0 == collapsed )
+			break;
+
+		// Reescreve os triângulos, descartando os degenerados
+		{
+			uint w = 0;
+			for (i = 0; i < n; i += 3) {
+				GLuint a = remap[out[i]], b = remap[out[i + 1]], c = remap[out[i + 2]];
+				if ( a == b || b == c || a == c )
+					continue;
+				out[w++] = a;
+				out[w++] = b;
+				out[w++] = c;
+			}
+			n = w;
+		}
+	}
+
+	if ( NULL != error )
+		*error = sqrt(maxCost > 0. ? maxCost : 0.);
+
+	free(adj);
+	free(offset);
+	free(collapses);
+	free(edges);
+	free(remap);
+	free(touched);
+	free(locked);
+	free(quadrics);
+
+	return n;
+}
+
+/**
+ * Escolhe o nível de detalhe de uma face para o quadro atual
+ *
+ * O erro de cada nível é projetado na tela usando a maior escala da matriz e
+ * a profundidade da origem do objeto. Para evitar trocas a cada quadro, o
+ * nível atual só é refinado se o erro passar do limite com folga e só fica
+ * mais grosseiro se o próximo nível ficar abaixo do limite com folga.
+ *
+ * @param lods Níveis, do mais detalhado ao mais grosseiro
+ * @param lodCount Quantidade de níveis
+ * @param current Nível usado no quadro anterior
+ * @param transf Matriz que leva a face ao espaço de recorte
+ * @param viewportHeight Altura da janela, em pixels
+ * @return Nível a ser desenhado
+ */
+uint selectLod(const Lod *lods, uint lodCount, uint current, mat4x4 transf,
+	       GLfloat viewportHeight)
+{
+	float scale = 0.f, w;
+	int i;
+
+	assert(NULL != lods);
+
+	if ( lodCount <= 1 )
+		return 0;
+	if ( current >= lodCount )
+		current = lodCount - 1;
+
+	for (i = 0; i < 3; ++i)
+		if ( vec3_len(transf[i]) > scale )
+			scale = vec3_len(transf[i]);
+	w = transf[3][3] > 1e-3f ? transf[3][3] : 1e-3f;
+	scale *= .5f*viewportHeight / w;
+
+	while ( current > 0 &&
+		lods[current].error*scale > LOD_PIXEL_ERROR*(1.f + LOD_HYSTERESIS) )
+		--current;
+	while ( current + 1 < lodCount &&
+		lods[current + 1].error*scale <= LOD_PIXEL_ERROR*(1.f - LOD_HYSTERESIS) )
+		++current;
+
+	return current;
+}
@@ -0,0 +1,45 @@
+#ifndef __LOD_H
+#define __LOD_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+
+/**
+ * Quantidade máxima de níveis de detalhe por face, incluindo o original
+ */
+#define LOD_MAX_LEVELS		5
+/**
+ * Faces com menos triângulos que isso não são simplificadas
+ */
+#define LOD_MIN_TRIANGLES	256
+/**
+ * Erro máximo tolerado na tela, em pixels
+ */
+#define LOD_PIXEL_ERROR		1.f
+/**
+ * Folga relativa usada para evitar trocas de nível a cada quadro
+ */
+#define LOD_HYSTERESIS		.25f
+
+/**
+ * @brief Um nível de detalhe de uma face
+ *
+ * Todos os níveis usam os mesmos vértices. Somente os elementos mudam.
+ */
+typedef struct Lod
+{
+	const GLuint	*face;	/**< elementos deste nível */
+	uint		count;	/**< quantidade de elementos */
+	GLfloat		error;	/**< erro geométrico, no espaço do objeto */
+	GLintptr	offset;	/**< posição dos elementos no buffer de elementos, em bytes */
+} Lod;
+
+uint simplifyMesh(const GLfloat *points, uint stride, const GLuint *tris,
+		  uint count, uint targetCount, GLuint *out, GLfloat *error);
+
+uint selectLod(const Lod *lods, uint lodCount, uint current, mat4x4 transf,
+	       GLfloat viewportHeight);
+
+#endif
@@ -0,0 +1,253 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "meshlet.h"
+
+/**
+ * Determinante da matriz, pela mesma expansão usada em mat4x4_invert
+ */
+static float mat4x4_det(mat4x4 M)
+{
+	float s[6];
+	float c[6];
+	s[0] = M[0][0]*M[1][1] - M[1][0]*M[0][1];
+	s[1] = M[0][0]*M[1][2] - M[1][0]*M[0][2];
+	s[2] = M[0][0]*M[1][3] - M[1][0]*M[0][3];
+	s[3] = M[0][1]*M[1][2] - M[1][1]*M[0][2];
+	s[4] = M[0][1]*M[1][3] - M[1][1]*M[0][3];
+	s[5] = M[0][2]*M[1][3] - M[1][2]*M[0][3];
+
+	c[0] = M[2][0]*M[3][1] - M[3][0]*M[2][1];
+	c[1] = M[2][0]*M[3][2] - M[3][0]*M[2][2];
+	c[2] = M[2][0]*M[3][3] - M[3][0]*M[2][3];
+	c[3] = M[2][1]*M[3][2] - M[3][1]*M[2][2];
+	c[4] = M[2][1]*M[3][3] - M[3][1]*M[2][3];
+	c[5] = M[2][2]*M[3][3] - M[3][2]*M[2][3];
+
+	return s[0]*c[5]-s[1]*c[4]+s[2]*c[3]+s[3]*c[2]-s[4]*c[1]+s[5]*c[0];
+}
+
+/**
+ * Calcula a esfera envolvente e o cone de normais de um meshlet
+ */
+static void computeBounds(Meshlet *m, const GLfloat *points, uint stride,
+			  const GLuint *tris)
+{
+	vec3 lo = { INFINITY, INFINITY, INFINITY };
+	vec3 hi = { -INFINITY, -INFINITY, -INFINITY };
+	vec3 sum = { 0.f, 0.f, 0.f };
+	float r2 = 0.f, mindp = 1.f;
+	uint i, k;
+
+	for (i = m->offset; i < m->offset + m->count; ++i)
+		for (k = 0; k < 3; ++k) {
+			float v = points[stride*tris[i] + k];
+			if ( v < lo[k] )
+				lo[k] = v;
+			if ( v > hi[k] )
+				hi[k] = v;
+		}
+	vec3_add(m->center, lo, hi);
+	vec3_scale(m->center, m->center, .5f);
+
+	for (i = m->offset; i < m->offset + m->count; ++i) {
+		vec3 d;
+		vec3_sub(d, (float *) &points[stride*tris[i]], m->center);
+		if ( vec3_mul_inner(d, d) > r2 )
+			r2 = vec3_mul_inner(d, d);
+	}
+	m->radius = sqrtf(r2);
+
+	// Normal média dos triângulos e o maior desvio em relação a ela
+	for (i = m->offset; i + 2 < m->offset + m->count; i += 3) {
+		vec3 e1, e2, n;
+		vec3_sub(e1, (float *) &points[stride*tris[i + 1]], (float *) &points[stride*tris[i]]);
+		vec3_sub(e2, (float *) &points[stride*tris[i + 2]], (float *) &points[stride*tris[i]]);
+		vec3_mul_cross(n, e1, e2);
+		if ( vec3_len(n) > 0.f ) {
+			vec3_norm(n, n);
+			vec3_add(sum, sum, n);
+		}
+	}
+
+	m->coneCutoff = 1.f;
+	memset(m->coneAxis, 0, sizeof(m->coneAxis));
+	if ( vec3_len(sum) <= 0.f )
+		return;
+	vec3_norm(m->coneAxis, sum);
+
+	for (i = m->offset; i + 2 < m->offset + m->count; i += 3) {
+		vec3 e1, e2, n;
+		vec3_sub(e1, (float *) &points[stride*tris[i + 1]], (float *) &points[stride*tris[i]]);
+		vec3_sub(e2, (float *) &points[stride*tris[i + 2]], (float *) &points[stride*tris[i]]);
+		vec3_mul_cross(n, e1, e2);
+		if ( vec3_len(n) > 0.f ) {
+			vec3_norm(n, n);
+			if ( vec3_mul_inner(n, m->coneAxis) < mindp )
+				mindp = vec3_mul_inner(n, m->coneAxis);
+		}
+	}
+
+	// Cones muito abertos nunca são descartados
+	if ( mindp > .1f )
+		m->coneCutoff = sqrtf(1.f - mindp*mindp);
+}
+
+/**
+ * Divide uma lista de triângulos em meshlets
+ *
+ * Os triângulos são agrupados na ordem em que aparecem, de modo que cada
+ * meshlet é um intervalo contíguo do vetor original. Um novo meshlet começa
+ * quando algum dos limites seria ultrapassado.
+ *
+ * @param points Posição do primeiro vértice
+ * @param stride Distância entre dois vértices, em GLfloat
+ * @param tris Lista de triângulos, 3 elementos por triângulo
+ * @param count Quantidade de elementos em tris
+ * @param maxVertices Quantidade máxima de vértices distintos por meshlet
+ * @param maxTriangles Quantidade máxima de triângulos por meshlet
+ * @param out Recebe o vetor de meshlets alocado. Deve ser liberado com free
+ * @return Quantidade de meshlets gerados
+ */
+GLuint buildMeshlets(const GLfloat *points, uint stride, const GLuint *tris,
+		     uint count, uint maxVertices, uint maxTriangles, Meshlet **out)
+{
+	uint triCount = count / 3;
+	uint vertexCount = 0;
+	uint *stamp;
+	Meshlet *m;
+	GLuint n = 0;
+	uint start = 0, vertices = 0, triangles = 0;
+	uint i, t;
+
+	assert(NULL != points);
+	assert(NULL != tris);
+	assert(NULL != out);
+	assert(maxVertices >= 3 && maxTriangles >= 1);
+
+	*out = NULL;
+	if ( 0 == triCount )
+		return 0;
+
+	for (i = 0; i < 3*triCount; ++i)
+		if ( tris[i] >= vertexCount )
+			vertexCount = tris[i] + 1;
+
+	stamp = malloc(vertexCount*sizeof(*stamp));
+	memset(stamp, 0xff, vertexCount*sizeof(*stamp));
+	m = malloc(triCount*sizeof(*m));
+
+	for (t = 0; t < triCount; ++t) {
+		const GLuint *tri = &tris[3*t];
+		uint added = 0;
+
+		for (i = 0; i < 3; ++i)
+			if ( stamp[tri[i]] != n && (0 == i || tri[i] != tri[0]) &&
+			     (i < 2 || tri[2] != tri[1]) )
+				++added;
+
+		if ( triangles == maxTriangles || vertices + added > maxVertices ) {
+			m[n].offset = 3*start;
+			m[n].count = 3*(t - start);
+			computeBounds(&m[n], points, stride, tris);
+			++n;
+			start = t;
+			vertices = 0;
+			triangles = 0;
+			added = 3 - (tri[1] == tri[0]) - (tri[2] == tri[0] || tri[2] == tri[1]);
+		}
+
+		for (i = 0; i < 3; ++i)
+			stamp[tri[i]] = n;
+		vertices += added;
+		++triangles;
+	}
+
+	m[n].offset = 3*start;
+	m[n].count = 3*(triCount - start);
+	computeBounds(&m[n], points, stride, tris);
+	++n;
+
+	free(stamp);
+	*out = realloc(m, n*sizeof(*m));
+	return n;
+}
+
+/**
+ * Prepara o teste de visibilidade dos meshlets de uma face
+ *
+ * @param c Estrutura a ser preenchida
+ * @param transf Matriz que leva os vértices da face ao espaço de recorte
+ * @param backface GL_TRUE para descartar meshlets completamente de costas.
+ *                 Só faz sentido com GL_CULL_FACE habilitado
+ */
+void initMeshletCuller(MeshletCuller *c, mat4x4 transf, GLboolean backface)
+{
+	vec4 row[4];
+	vec4 eye = { 0.f, 0.f, -1.f, 0.f };
+	vec4 objEye;
+	mat4x4 inv;
+	int i;
+
+	assert(NULL != c);
+
+	for (i = 0; i < 4; ++i)
+		mat4x4_row(row[i], transf, i);
+
+	// Planos do volume de visão, extraídos da própria matriz
+	for (i = 0; i < 3; ++i) {
+		vec4_add(c->planes[2*i], row[3], row[i]);
+		vec4_sub(c->planes[2*i + 1], row[3], row[i]);
+	}
+	for (i = 0; i < 6; ++i) {
+		float len = vec3_len(c->planes[i]);
+		if ( len > 0.f )
+			vec4_scale(c->planes[i], c->planes[i], 1.f/len);
+	}
+
+	// O observador, no espaço de recorte, é o ponto no infinito (0, 0, -1, 0)
+	mat4x4_invert(inv, transf);
+	mat4x4_mul_vec4(objEye, inv, eye);
+	c->ortho = fabsf(objEye[3]) < 1e-6f;
+	if ( c->ortho ) {
+		vec3_scale(c->eye, objEye, -1.f);
+		vec3_norm(c->eye, c->eye);
+	} else {
+		vec3_scale(c->eye, objEye, 1.f/objEye[3]);
+	}
+
+	// Matrizes que invertem a orientação trocam a face da frente
+	c->facing = mat4x4_det(transf) > 0.f ? -1.f : 1.f;
+	c->backface = backface;
+}
+
+/**
+ * Testa se um meshlet pode contribuir para a imagem
+ *
+ * @return GL_FALSE se o meshlet está fora do volume de visão ou, com o teste
+ *         de face traseira habilitado, se todos os triângulos estão de costas
+ */
+GLboolean meshletVisible(const MeshletCuller *c, const Meshlet *m)
+{
+	vec3 axis, d;
+	int i;
+
+	for (i = 0; i < 6; ++i)
+		if ( vec3_mul_inner((float *) c->planes[i], (float *) m->center) +
+		     c->planes[i][3] < -m->radius )
+			return GL_FALSE;
+
+	if ( !c->backface || m->coneCutoff >= 1.f )
+		return GL_TRUE;
+
+	vec3_scale(axis, (float *) m->coneAxis, c->facing);
+	if ( c->ortho )
+		return vec3_mul_inner((float *) c->eye, axis) < m->coneCutoff;
+
+	vec3_sub(d, (float *) m->center, (float *) c->eye);
+	return vec3_mul_inner(d, axis) < m->coneCutoff*vec3_len(d) + m->radius;
+}
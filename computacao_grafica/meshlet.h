@@ -0,0 +1,54 @@
+#ifndef __MESHLET_H
+#define __MESHLET_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+
+/**
+ * Limites usuais de um meshlet
+ */
+#define MESHLET_MAX_VERTICES	64
+#define MESHLET_MAX_TRIANGLES	124
+
+/**
+ * @brief Agrupamento de triângulos contíguos de uma face
+ *
+ * Cada meshlet é um intervalo do vetor de elementos da face, com limites que
+ * permitem descartá-lo antes do desenho: uma esfera envolvente, para o teste
+ * contra o volume de visão, e um cone de normais, para o teste de face traseira.
+ */
+typedef struct Meshlet
+{
+	GLuint		offset;		/**< Primeiro elemento do meshlet no vetor da face */
+	GLuint		count;		/**< Quantidade de elementos. 3 por triângulo */
+	vec3		center;		/**< Centro da esfera envolvente */
+	GLfloat		radius;		/**< Raio da esfera envolvente */
+	vec3		coneAxis;	/**< Direção média das normais */
+	GLfloat		coneCutoff;	/**< Seno da abertura do cone. 1 desabilita o teste */
+} Meshlet;
+
+/**
+ * @brief Dados pré-calculados para testar os meshlets de uma face
+ *
+ * Tudo é expresso no espaço do objeto, a partir da matriz que leva os vértices
+ * diretamente ao espaço de recorte.
+ */
+typedef struct MeshletCuller
+{
+	vec4		planes[6];	/**< Planos do volume de visão */
+	vec3		eye;		/**< Posição do observador, ou direção de visão */
+	GLboolean	ortho;		/**< Se eye é uma direção (projeção ortogonal) */
+	GLboolean	backface;	/**< Se o teste do cone de normais deve ser feito */
+	GLfloat		facing;		/**< 1 ou -1, conforme a orientação da matriz */
+} MeshletCuller;
+
+GLuint buildMeshlets(const GLfloat *points, uint stride, const GLuint *tris,
+		     uint count, uint maxVertices, uint maxTriangles, Meshlet **out);
+
+void initMeshletCuller(MeshletCuller *c, mat4x4 transf, GLboolean backface);
+
+GLboolean meshletVisible(const MeshletCuller *c, const Meshlet *m);
+
+#endif
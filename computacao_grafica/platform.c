@@ -0,0 +1,28 @@
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform.h"
+
+/**
+ * Relógio monotônico do sistema, em segundos
+ *
+ * Usado em todas as medidas de tempo e nos instantes da simulação. É o
+ * relógio CLOCK_MONOTONIC: pode ser usado com clock_nanosleep.
+ */
+double monotonicClock()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+/**
+ * Quantidade de processadores disponíveis, pelo menos 1
+ */
+uint processorCount()
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cpus > 0 ? (uint) cpus : 1;
+}
@@ -0,0 +1,10 @@
+#ifndef __PLATFORM_H
+#define __PLATFORM_H
+
+# include <stdlib.h>
+
+double monotonicClock();
+
+uint processorCount();
+
+#endif
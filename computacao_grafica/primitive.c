@@ -5,6 +5,8 @@
 
 #include "linmath.h"
 #include "primitive.h"
+#include "strip.h"
+#include "quantize.h"
 
 Primitive* createPrimitive(uint primitiveCount)
 {
@@ -17,20 +19,32 @@ Primitive* createPrimitive(uint primitiveCount)
 	tmp = malloc(len);
 	memset(tmp, 0, len);
 	
-	for (i = 0; i < primitiveCount; ++i)
+	for (i = 0; i < primitiveCount; ++i) {
 		mat4x4_identity(tmp[i].transf);
+		mat4x4_identity(tmp[i].dequant);
+		initVertexFormat(&tmp[i].format);
+		addVertexAttribute(&tmp[i].format, ATTRIB_POSITION, 3, GL_FLOAT,
+				   GL_FALSE);
+		tmp[i].gpuFormat = tmp[i].format;
+	}
 	
 	return tmp;
 }
 
 void destroyPrimitive(Primitive *p, uint count)
 {
-	int i, j;
+	int i;
 	
 	assert(NULL != p);
 	
-	for (i = 0; i < count; ++i) 
+	for (i = 0; i < count; ++i) {
 		free(p[i].faceArray);
+		free(p[i].elements);
+		free(p[i].meshletArray);
+		free(p[i].lodArray);
+		free(p[i].lodElements);
+		destroyDynamicMesh(p[i].dynamic);
+	}
 	
 	free(p);
 }
@@ -81,11 +95,484 @@ mat4x4* getPrimitiveTransformation(Primitive *base, uint position, uint maxCount
 	return &base[position].transf;
 }
 
+/**
+ * Define o layout dos vértices do buffer da primitiva
+ * 
+ * O formato padrão possui somente posições, com 3 GLfloat por vértice. A
+ * quantização, se houver, é desfeita.
+ * 
+ * @param fmt Formato dos vértices, com os atributos intercalados
+ */
+void setPrimitiveVertexFormat(Primitive *base, uint position, uint maxCount,
+			      const VertexFormat *fmt)
+{
+	assert(position < maxCount);
+	assert(NULL != base);
+	assert(NULL != fmt && fmt->attrib[ATTRIB_POSITION].size >= 3);
+	
+	base[position].format = *fmt;
+	base[position].gpuFormat = *fmt;
+	mat4x4_identity(base[position].dequant);
+}
+
+/**
+ * Define como as posições dos vértices são armazenadas na memória de vídeo
+ * 
+ * Com GL_SHORT, as posições são quantizadas em SNORM16 em relação à caixa
+ * envolvente da malha, usando metade da memória. A matriz de dequantização
+ * deve ser aplicada antes das demais transformações. O buffer da primitiva
+ * continua em GL_FLOAT: a conversão acontece somente no envio ao driver.
+ * Primitivas dinâmicas não são quantizadas: as alterações poderiam sair da
+ * caixa envolvente.
+ * 
+ * @param type GL_FLOAT ou GL_SHORT
+ */
+void setPrimitiveQuantization(Primitive *base, uint position, uint maxCount,
+			      GLenum type)
+{
+	Primitive *p;
+	const GLfloat *points;
+	uint stride;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	assert(GL_FLOAT == type || GL_SHORT == type);
+	
+	p = &base[position];
+	points = getPrimitivePositions(base, position, maxCount, &stride);
+	if ( GL_SHORT == type && NULL != points && NULL == p->dynamic ) {
+		computeQuantization(points, stride,
+				    getPrimitiveVertexCount(base, position, maxCount),
+				    p->dequant);
+		quantizeVertexFormat(&p->format, &p->gpuFormat);
+	} else {
+		mat4x4_identity(p->dequant);
+		p->gpuFormat = p->format;
+	}
+}
+
+/**
+ * Quantidade de vértices no buffer da primitiva
+ */
+uint getPrimitiveVertexCount(const Primitive *base, uint position, uint maxCount)
+{
+	assert(position < maxCount);
+	assert(NULL != base);
+	
+	return base[position].pSize / base[position].format.stride;
+}
+
+/**
+ * Posições dos vértices, para os algoritmos que rodam na CPU
+ * 
+ * @param stride Recebe a distância entre dois vértices, em GLfloat
+ * @return Posição do primeiro vértice, ou NULL se as posições não forem
+ *         GL_FLOAT
+ */
+const GLfloat* getPrimitivePositions(const Primitive *base, uint position,
+				     uint maxCount, uint *stride)
+{
+	const VertexFormat *fmt;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	assert(NULL != stride);
+	
+	fmt = &base[position].format;
+	*stride = fmt->stride / sizeof(GLfloat);
+	if ( GL_FLOAT != fmt->attrib[ATTRIB_POSITION].type ||
+	     NULL == base[position].points )
+		return NULL;
+	return (const GLfloat *) ((const char *) base[position].points +
+				  fmt->attrib[ATTRIB_POSITION].offset);
+}
+
+/**
+ * Divide as faces grandes de uma primitiva em meshlets
+ * 
+ * Somente faces GL_TRIANGLES com mais de maxTriangles triângulos são
+ * divididas. As posições dos vértices devem ser GL_FLOAT. Os meshlets
+ * pertencem à primitiva e são liberados em destroyPrimitive. Chamadas
+ * repetidas e primitivas dinâmicas não têm efeito.
+ * 
+ * @return Quantidade total de meshlets da primitiva
+ */
+GLuint buildPrimitiveMeshlets(Primitive *base, uint position, uint maxCount,
+			      uint maxVertices, uint maxTriangles)
+{
+	Primitive *p;
+	Meshlet **parts;
+	const GLfloat *points;
+	uint stride;
+	GLuint total = 0;
+	uint i;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	
+	p = &base[position];
+	points = getPrimitivePositions(base, position, maxCount, &stride);
+	if ( NULL != p->meshletArray || 0 == p->faceCount || NULL == points ||
+	     NULL != p->dynamic )
+		return 0;
+	
+	parts = calloc(p->faceCount, sizeof(*parts));
+	for (i = 0; i < p->faceCount; ++i) {
+		Faces *f = &p->faceArray[i];
+		
+		f->meshletCount = 0;
+		if ( GL_TRIANGLES != f->mode || f->count / 3 <= maxTriangles )
+			continue;
+		f->meshletCount = buildMeshlets(points, stride, f->face, f->count,
+						maxVertices, maxTriangles, &parts[i]);
+		total += f->meshletCount;
+	}
+	
+	if ( total > 0 ) {
+		Meshlet *m;
+		
+		p->meshletArray = malloc(sizeof(*p->meshletArray)*total);
+		m = p->meshletArray;
+		for (i = 0; i < p->faceCount; ++i) {
+			Faces *f = &p->faceArray[i];
+			if ( 0 == f->meshletCount )
+				continue;
+			memcpy(m, parts[i], sizeof(*m)*f->meshletCount);
+			f->meshlets = m;
+			m += f->meshletCount;
+		}
+	}
+	
+	for (i = 0; i < p->faceCount; ++i)
+		free(parts[i]);
+	free(parts);
+	
+	return total;
+}
+
+/**
+ * Gera os níveis de detalhe das faces grandes de uma primitiva
+ * 
+ * Somente faces GL_TRIANGLES com pelo menos LOD_MIN_TRIANGLES triângulos são
+ * simplificadas. Cada nível tenta usar metade dos triângulos do anterior; a
+ * cadeia termina antes se a simplificação não reduzir a face o suficiente. As
+ * posições dos vértices devem ser GL_FLOAT. Os níveis pertencem à primitiva e
+ * são liberados em destroyPrimitive. Chamadas repetidas e primitivas
+ * dinâmicas não têm efeito.
+ * 
+ * @param levels Quantidade máxima de níveis, incluindo o original
+ * @return Quantidade de faces simplificadas
+ */
+GLuint buildPrimitiveLods(Primitive *base, uint position, uint maxCount,
+			  uint levels)
+{
+	Primitive *p;
+	uint *lodOffset;
+	GLuint *elements = NULL;
+	const GLfloat *points;
+	uint stride;
+	uint elementCount = 0, lodTotal = 0, simplified = 0;
+	uint i, l;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	
+	p = &base[position];
+	points = getPrimitivePositions(base, position, maxCount, &stride);
+	if ( NULL != p->lodArray || 0 == p->faceCount || levels < 2 ||
+	     NULL == points || NULL != p->dynamic )
+		return 0;
+	if ( levels > LOD_MAX_LEVELS )
+		levels = LOD_MAX_LEVELS;
+	
+	p->lodArray = malloc(sizeof(*p->lodArray)*p->faceCount*levels);
+	lodOffset = malloc(sizeof(*lodOffset)*p->faceCount*levels);
+	
+	for (i = 0; i < p->faceCount; ++i) {
+		Faces *f = &p->faceArray[i];
+		Lod *lod = &p->lodArray[lodTotal];
+		
+		f->lodCount = 0;
+		f->lodCurrent = 0;
+		if ( GL_TRIANGLES != f->mode || f->count / 3 < LOD_MIN_TRIANGLES )
+			continue;
+		
+		lod[0].face = f->face;
+		lod[0].count = f->count;
+		lod[0].error = 0.f;
+		for (l = 1; l < levels; ++l) {
+			uint count;
+			
+			elements = realloc(elements, sizeof(*elements)*(elementCount + lod[l - 1].count));
+			count = simplifyMesh(points, stride,
+					     l > 1 ? &elements[lodOffset[lodTotal + l - 1]] : f->face,
+					     lod[l - 1].count, lod[l - 1].count / 6 * 3,
+					     &elements[elementCount], &lod[l].error);
+			// Não vale a pena manter um nível quase igual ao anterior
+			if ( count > lod[l - 1].count / 10 * 9 )
+				break;
+			lodOffset[lodTotal + l] = elementCount;
+			lod[l].count = count;
+			elementCount += count;
+		}
+		if ( l < 2 )
+			continue;
+		
+		f->lodCount = l;
+		lodTotal += l;
+		++simplified;
+	}
+	
+	// Só agora os endereços dos elementos são definitivos
+	p->lodElements = elements;
+	for (i = 0, l = 0; i < p->faceCount; ++i) {
+		Faces *f = &p->faceArray[i];
+		uint k;
+		
+		if ( 0 == f->lodCount )
+			continue;
+		f->lods = &p->lodArray[l];
+		for (k = 1; k < f->lodCount; ++k)
+			p->lodArray[l + k].face = &elements[lodOffset[l + k]];
+		l += f->lodCount;
+	}
+	
+	free(lodOffset);
+	return simplified;
+}
+
+/**
+ * Converte as faces de uma primitiva em tiras de triângulos
+ * 
+ * As faces desenhadas com GL_TRIANGLES que possuem a mesma matriz de
+ * transformação são concatenadas em uma única face GL_TRIANGLE_STRIP. Assim,
+ * a primitiva passa a usar menos elementos e menos chamadas de desenho. Sem
+ * primitive restart, as tiras só poderiam ser ligadas por triângulos
+ * degenerados, que aparecem como arestas falsas em wireframe: as faces são
+ * somente concatenadas, e continuam GL_TRIANGLES. Os
+ * elementos gerados pertencem à primitiva e são liberados em destroyPrimitive.
+ * Faces já divididas em meshlets ou simplificadas são mantidas. Chamadas repetidas não têm efeito.
+ * Primitivas dinâmicas são mantidas.
+ * 
+ * @param useRestart GL_TRUE se o primitive restart estiver habilitado, com
+ *                   STRIP_RESTART_INDEX como índice
+ * @return Nova quantidade de faces da primitiva
+ */
+GLuint optimizePrimitiveStrips(Primitive *base, uint position, uint maxCount,
+			       GLboolean useRestart)
+{
+	Primitive *p;
+	Faces *faces;
+	GLuint *tris, *strips, *elements;
+	GLuint *stripStart, *stripCount;
+	uint total = 0, stripTotal = 0, newCount = 0;
+	uint i, j;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	
+	p = &base[position];
+	if ( NULL != p->elements || NULL != p->dynamic )
+		return p->faceCount;
+	
+	for (i = 0; i < p->faceCount; ++i)
+		if ( GL_TRIANGLES == p->faceArray[i].mode &&
+		     0 == p->faceArray[i].meshletCount && 0 == p->faceArray[i].lodCount )
+			total += p->faceArray[i].count;
+	if ( 0 == total )
+		return p->faceCount;
+	
+	faces = malloc(sizeof(*faces)*p->faceCount);
+	tris = malloc(sizeof(*tris)*total);
+	strips = malloc(sizeof(*strips)*stripMaxLength(total));
+	stripStart = malloc(sizeof(*stripStart)*p->faceCount);
+	stripCount = calloc(p->faceCount, sizeof(*stripCount));
+	
+	for (i = 0; i < p->faceCount; ++i) {
+		Faces *f = &p->faceArray[i];
+		uint n = 0;
+		
+		if ( GL_TRIANGLES != f->mode || f->meshletCount > 0 || f->lodCount > 0 ) {
+			faces[newCount++] = *f;
+			continue;
+		}
+		if ( 0 == f->count )
+			continue;
+		
+		// Agrupa as faces seguintes com a mesma transformação
+		for (j = i; j < p->faceCount; ++j) {
+			Faces *g = &p->faceArray[j];
+			if ( GL_TRIANGLES != g->mode || 0 == g->count ||
+			     g->meshletCount > 0 || g->lodCount > 0 )
+				continue;
+			if ( j != i && memcmp(g->transf, f->transf, sizeof(mat4x4)) )
+				continue;
+			memcpy(&tris[n], g->face, sizeof(*tris)*g->count);
+			n += g->count;
+			if ( j != i )
+				g->count = 0; // já consumida
+		}
+		
+		faces[newCount] = *f;
+		stripStart[newCount] = stripTotal;
+		if ( useRestart ) {
+			faces[newCount].mode = GL_TRIANGLE_STRIP;
+			stripCount[newCount] = stripifyTriangles(tris, n, GL_TRUE,
+								 &strips[stripTotal]);
+		} else {
+			memcpy(&strips[stripTotal], tris, sizeof(*tris)*n);
+			stripCount[newCount] = n;
+		}
+		faces[newCount].count = stripCount[newCount];
+		stripTotal += stripCount[newCount];
+		++newCount;
+	}
+	
+	elements = malloc(sizeof(*elements)*stripTotal);
+	memcpy(elements, strips, sizeof(*elements)*stripTotal);
+	for (i = 0; i < newCount; ++i)
+		if ( stripCount[i] > 0 )
+			faces[i].face = &elements[stripStart[i]];
+	
+	free(p->faceArray);
+	p->faceArray = faces;
+	p->faceCount = newCount;
+	p->elements = elements;
+	
+	free(stripCount);
+	free(stripStart);
+	free(strips);
+	free(tris);
+	
+	return newCount;
+}
+
+/**
+ * Define a posição de cada vetor de elementos no buffer de elementos
+ * 
+ * As faces vêm primeiro, na ordem do array; faces que usam o mesmo vetor
+ * compartilham a mesma posição. Os níveis de detalhe vêm em seguida. Deve ser
+ * chamada depois de todas as mudanças nas faces.
+ * 
+ * @return Tamanho do buffer de elementos, em bytes
+ */
+GLsizeiptr layoutPrimitiveElements(Primitive *base, uint position, uint maxCount)
+{
+	Primitive *p;
+	GLintptr offset = 0;
+	uint i, j, l = 0;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	
+	p = &base[position];
+	for (i = 0; i < p->faceCount; ++i) {
+		Faces *f = &p->faceArray[i];
+		
+		for (j = 0; j < i; ++j)
+			if ( p->faceArray[j].face == f->face &&
+			     p->faceArray[j].count == f->count )
+				break;
+		if ( j < i ) {
+			f->offset = p->faceArray[j].offset;
+			continue;
+		}
+		f->offset = offset;
+		offset += f->count*sizeof(GLuint);
+	}
+	
+	for (i = 0; i < p->faceCount; ++i) {
+		Faces *f = &p->faceArray[i];
+		uint k;
+		
+		if ( 0 == f->lodCount )
+			continue;
+		p->lodArray[l].offset = f->offset;
+		for (k = 1; k < f->lodCount; ++k) {
+			p->lodArray[l + k].offset = offset;
+			offset += p->lodArray[l + k].count*sizeof(GLuint);
+		}
+		l += f->lodCount;
+	}
+	
+	return offset;
+}
+
+/**
+ * Copia os elementos da primitiva no layout de layoutPrimitiveElements
+ * 
+ * @param out Destino, com o tamanho retornado por layoutPrimitiveElements
+ */
+void packPrimitiveElements(const Primitive *base, uint position, uint maxCount,
+			   GLvoid *out)
+{
+	const Primitive *p;
+	uint i, k;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	assert(NULL != out);
+	
+	p = &base[position];
+	for (i = 0; i < p->faceCount; ++i) {
+		const Faces *f = &p->faceArray[i];
+		
+		memcpy((char *) out + f->offset, f->face, f->count*sizeof(GLuint));
+		for (k = 1; k < f->lodCount; ++k)
+			memcpy((char *) out + f->lods[k].offset, f->lods[k].face,
+			       f->lods[k].count*sizeof(GLuint));
+	}
+}
+
+/**
+ * Torna os vértices e os elementos de uma primitiva alteráveis
+ * 
+ * Os vértices e os elementos das faces são copiados para a malha dinâmica da
+ * primitiva, que passa a usá-los. Os elementos seguem o layout de
+ * layoutPrimitiveElements. As posições devem ser GL_FLOAT e não são
+ * quantizadas. Deve ser chamada depois de definidas as faces e antes de
+ * buildPrimitiveLods, buildPrimitiveMeshlets e optimizePrimitiveStrips, que
+ * ignoram primitivas dinâmicas. Chamadas repetidas não têm efeito.
+ * 
+ * @return Malha dinâmica da primitiva, liberada em destroyPrimitive
+ */
+DynamicMesh* makePrimitiveDynamic(Primitive *base, uint position, uint maxCount)
+{
+	Primitive *p;
+	DynamicMesh *d;
+	GLsizeiptr elementSize;
+	uint i;
+	
+	assert(position < maxCount);
+	assert(NULL != base);
+	
+	p = &base[position];
+	if ( NULL != p->dynamic )
+		return p->dynamic;
+	assert(GL_FLOAT == p->format.attrib[ATTRIB_POSITION].type);
+	assert(NULL == p->lodArray && NULL == p->meshletArray);
+	
+	setPrimitiveQuantization(base, position, maxCount, GL_FLOAT);
+	elementSize = layoutPrimitiveElements(base, position, maxCount);
+	d = createDynamicMesh(p->points, getPrimitiveVertexCount(base, position, maxCount),
+			      p->format.stride, p->format.attrib[ATTRIB_POSITION].offset,
+			      elementSize / sizeof(GLuint));
+	packPrimitiveElements(base, position, maxCount, d->elements);
+	
+	for (i = 0; i < p->faceCount; ++i)
+		p->faceArray[i].face = &d->elements[p->faceArray[i].offset / sizeof(GLuint)];
+	p->points = d->points;
+	p->dynamic = d;
+	
+	return d;
+}
+
 
 void initFace(Faces *face)
 {
 	assert(NULL != face);
 	memset(face, 0, sizeof(*face));
+	face->mode = GL_TRIANGLES;
 	mat4x4_identity(face->transf);
 }
 
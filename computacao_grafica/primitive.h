@@ -5,6 +5,10 @@
 # include <stdlib.h>
 
 # include "linmath.h"
+# include "meshlet.h"
+# include "lod.h"
+# include "vertexformat.h"
+# include "dynamic.h"
 
 /**
  * @brief Define os elementos que compõem uma face
@@ -16,6 +20,13 @@ typedef struct Faces
 {
 	const GLuint	*face;	/**< vetor dos elementos que compõem uma face */
 	uint 		count;	/**< quantidade de elementos nesse vetor */
+	GLenum		mode;	/**< tipo de primitiva OpenGL usada no desenho */
+	const Meshlet	*meshlets;	/**< meshlets da face. NULL se não foi dividida */
+	uint		meshletCount;	/**< quantidade de meshlets */
+	const Lod	*lods;		/**< níveis de detalhe. O primeiro é a própria face */
+	uint		lodCount;	/**< quantidade de níveis. 0 se não foi simplificada */
+	uint		lodCurrent;	/**< nível escolhido no último quadro */
+	GLintptr	offset;	/**< posição de face no buffer de elementos, em bytes */
 	mat4x4		transf;	/**< matriz de transformação para esta face */
 } Faces;
 
@@ -29,11 +40,21 @@ typedef struct Faces
 typedef struct Primitive
 {
 	GLuint		id;		/**< Nome da estrutura no driver de vídeo */
+	GLuint		vao;		/**< Vertex array com os atributos já configurados */
+	GLuint		elementId;	/**< Buffer com os elementos de todas as faces */
 	const GLvoid	*points;	/**< Array para os pontos dos vertexs */
 	GLsizeiptr	pSize;		/**< Tamanho total do array de vertex. Em bytes */
+	VertexFormat	format;		/**< Layout dos vértices em points */
+	VertexFormat	gpuFormat;	/**< Layout dos vértices na memória de vídeo */
+	mat4x4		dequant;	/**< Converte as coordenadas quantizadas nas originais */
 	Faces		*faceArray;	/**< Array de faces. Permite a construção de primitivas mais complexas */
 	GLuint		faceCount;	/**< Quantidade de elementos no array de faces */
-	mat4x4		transf;		/**< Matriz de transformação de toda a primitiva */
+	mat4x4		transf;		/**< Matriz de transformação de toda a primitiva. Inicial das instâncias */
+	GLuint		*elements;	/**< Elementos gerados internamente (ex.: tiras). Pertencem à primitiva */
+	Meshlet		*meshletArray;	/**< Meshlets de todas as faces. Pertencem à primitiva */
+	Lod		*lodArray;	/**< Níveis de detalhe de todas as faces. Pertencem à primitiva */
+	GLuint		*lodElements;	/**< Elementos dos níveis simplificados */
+	DynamicMesh	*dynamic;	/**< Vértices e elementos alteráveis. NULL se a primitiva é estática */
 } Primitive;
 
 // APIs públicas
@@ -58,6 +79,33 @@ void setPrimitiveTransformation(Primitive *base, uint position, uint maxCount,
 
 mat4x4* getPrimitiveTransformation(Primitive *base, uint position, uint maxCount);
 
+void setPrimitiveVertexFormat(Primitive *base, uint position, uint maxCount,
+			      const VertexFormat *fmt);
+
+void setPrimitiveQuantization(Primitive *base, uint position, uint maxCount,
+			      GLenum type);
+
+uint getPrimitiveVertexCount(const Primitive *base, uint position, uint maxCount);
+
+const GLfloat* getPrimitivePositions(const Primitive *base, uint position,
+				     uint maxCount, uint *stride);
+
+GLuint buildPrimitiveMeshlets(Primitive *base, uint position, uint maxCount,
+			      uint maxVertices, uint maxTriangles);
+
+GLuint buildPrimitiveLods(Primitive *base, uint position, uint maxCount,
+			  uint levels);
+
+GLuint optimizePrimitiveStrips(Primitive *base, uint position, uint maxCount,
+			       GLboolean useRestart);
+
+GLsizeiptr layoutPrimitiveElements(Primitive *base, uint position, uint maxCount);
+
+void packPrimitiveElements(const Primitive *base, uint position, uint maxCount,
+			   GLvoid *out);
+
+DynamicMesh* makePrimitiveDynamic(Primitive *base, uint position, uint maxCount);
+
 
 // APIs relacionadas com a estrutura Faces
 
@@ -0,0 +1,459 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "primitive.h"
+#include "procedural.h"
+#include "jobs.h"
+#include "platform.h"
+
+typedef struct ShapeJob
+{
+	const ShapeDesc	*desc;
+	ShapeBatch	*batch;
+} ShapeJob;
+
+static void setPoint(GLfloat *points, uint i, GLfloat x, GLfloat y, GLfloat z)
+{
+	points[3*i] = x;
+	points[3*i + 1] = y;
+	points[3*i + 2] = z;
+}
+
+/**
+ * Grava os dois triângulos de um quadrilátero, na ordem a, b, c, d
+ */
+static GLuint* putQuad(GLuint *e, GLuint a, GLuint b, GLuint c, GLuint d)
+{
+	e[0] = a;
+	e[1] = b;
+	e[2] = c;
+	e[3] = a;
+	e[4] = c;
+	e[5] = d;
+	return e + 6;
+}
+
+static GLuint* putTriangle(GLuint *e, GLuint a, GLuint b, GLuint c)
+{
+	e[0] = a;
+	e[1] = b;
+	e[2] = c;
+	return e + 3;
+}
+
+/**
+ * Um anel de slices vértices ao redor do eixo y. O ângulo decresce, para que
+ * as faces vistas de fora fiquem no sentido anti-horário
+ */
+static void putRing(GLfloat *points, uint first, uint slices, GLfloat radius,
+		    GLfloat y)
+{
+	uint j;
+
+	for (j = 0; j < slices; ++j) {
+		float theta = -2.f*M_PI*j / slices;
+		setPoint(points, first + j, radius*cosf(theta), y,
+			 radius*sinf(theta));
+	}
+}
+
+static void generateSphere(const ShapeDesc *d, GLfloat *points, GLuint *e)
+{
+	uint s = d->slices, t = d->stacks;
+	uint bottom = 1 + s*(t - 1);
+	uint j, k;
+
+	setPoint(points, 0, 0.f, 1.f, 0.f);
+	for (k = 1; k < t; ++k) {
+		float phi = M_PI*k / t;
+		putRing(points, 1 + s*(k - 1), s, sinf(phi), cosf(phi));
+	}
+	setPoint(points, bottom, 0.f, -1.f, 0.f);
+
+	for (j = 0; j < s; ++j) {
+		uint j1 = (j + 1) % s;
+
+		e = putTriangle(e, 0, 1 + j, 1 + j1);
+		for (k = 1; k + 1 < t; ++k) {
+			uint up = 1 + s*(k - 1), down = up + s;
+			e = putQuad(e, up + j, down + j, down + j1, up + j1);
+		}
+		e = putTriangle(e, bottom, 1 + s*(t - 2) + j1, 1 + s*(t - 2) + j);
+	}
+}
+
+static void generateCylinder(const ShapeDesc *d, GLfloat *points, GLuint *e)
+{
+	uint s = d->slices, t = d->stacks;
+	uint bottom = s*(t + 1), top = bottom + 1;
+	uint j, k;
+
+	for (k = 0; k <= t; ++k)
+		putRing(points, s*k, s, 1.f, 1.f - 2.f*k / t);
+	setPoint(points, bottom, 0.f, -1.f, 0.f);
+	setPoint(points, top, 0.f, 1.f, 0.f);
+
+	for (j = 0; j < s; ++j) {
+		uint j1 = (j + 1) % s;
+
+		for (k = 0; k < t; ++k)
+			e = putQuad(e, s*k + j, s*(k + 1) + j, s*(k + 1) + j1,
+				    s*k + j1);
+		e = putTriangle(e, top, j, j1);
+		e = putTriangle(e, bottom, s*t + j1, s*t + j);
+	}
+}
+
+static void generatePipe(const ShapeDesc *d, GLfloat *points, GLuint *e)
+{
+	uint s = d->slices;
+	uint outerTop = 0, outerBottom = s, innerTop = 2*s, innerBottom = 3*s;
+	uint j;
+
+	putRing(points, outerTop, s, 1.f, 1.f);
+	putRing(points, outerBottom, s, 1.f, -1.f);
+	putRing(points, innerTop, s, 1.f - d->thickness, 1.f);
+	putRing(points, innerBottom, s, 1.f - d->thickness, -1.f);
+
+	for (j = 0; j < s; ++j) {
+		uint j1 = (j + 1) % s;
+
+		e = putQuad(e, outerTop + j, outerBottom + j, outerBottom + j1,
+			    outerTop + j1);
+		// A parede interna é vista de dentro
+		e = putQuad(e, innerTop + j1, innerBottom + j1, innerBottom + j,
+			    innerTop + j);
+		e = putQuad(e, innerTop + j, outerTop + j, outerTop + j1,
+			    innerTop + j1);
+		e = putQuad(e, outerBottom + j, innerBottom + j, innerBottom + j1,
+			    outerBottom + j1);
+	}
+}
+
+static void generateTorus(const ShapeDesc *d, GLfloat *points, GLuint *e)
+{
+	uint s = d->slices, t = d->stacks;
+	float ring = 1.f - d->thickness, tube = d->thickness;
+	uint i, k;
+
+	for (i = 0; i < s; ++i) {
+		float theta = -2.f*M_PI*i / s;
+		float cx = cosf(theta), cz = sinf(theta);
+
+		for (k = 0; k < t; ++k) {
+			float phi = 2.f*M_PI*k / t;
+			float r = ring + tube*cosf(phi);
+			setPoint(points, t*i + k, r*cx, tube*sinf(phi), r*cz);
+		}
+	}
+
+	for (i = 0; i < s; ++i) {
+		uint i1 = (i + 1) % s;
+
+		for (k = 0; k < t; ++k) {
+			uint k1 = (k + 1) % t;
+			e = putQuad(e, t*i + k, t*i1 + k, t*i1 + k1, t*i + k1);
+		}
+	}
+}
+
+static float cross2(const GLfloat *a, const GLfloat *b, const GLfloat *c)
+{
+	return (b[0] - a[0])*(c[1] - a[1]) - (b[1] - a[1])*(c[0] - a[0]);
+}
+
+/**
+ * Triangula um polígono simples anti-horário, removendo orelhas
+ *
+ * Perfis degenerados, sem orelhas, terminam em leque.
+ *
+ * @param out Recebe 3*(n - 2) elementos, anti-horários
+ */
+static void triangulate(const GLfloat *profile, uint n, GLuint *out)
+{
+	uint *v = malloc(n*sizeof(*v));
+	uint m = n, i, k;
+
+	for (i = 0; i < n; ++i)
+		v[i] = i;
+
+	while ( m > 3 ) {
+		int found = 0;
+
+		for (i = 0; i < m && !found; ++i) {
+			uint a = v[(i + m - 1) % m], b = v[i], c = v[(i + 1) % m];
+
+			if ( cross2(&profile[2*a], &profile[2*b], &profile[2*c]) <= 0.f )
+				continue;
+			for (k = 0; k < m; ++k) {
+				const GLfloat *p = &profile[2*v[k]];
+
+				if ( v[k] == a || v[k] == b || v[k] == c )
+					continue;
+				if ( cross2(&profile[2*a], &profile[2*b], p) >= 0.f &&
+				     cross2(&profile[2*b], &profile[2*c], p) >= 0.f &&
+				     cross2(&profile[2*c], &profile[2*a], p) >= 0.f )
+					break;
+			}
+			if ( k < m )
+				continue;
+
+			out = putTriangle(out, a, b, c);
+			memmove(&v[i], &v[i + 1], (m - i - 1)*sizeof(*v));
+			--m;
+			found = 1;
+		}
+		if ( !found )
+			break;
+	}
+
+	for (i = 1; i + 1 < m; ++i)
+		out = putTriangle(out, v[0], v[i], v[i + 1]);
+	free(v);
+}
+
+static void generateExtrusion(const ShapeDesc *d, GLfloat *points, GLuint *e)
+{
+	uint n = d->profileCount;
+	uint j;
+
+	for (j = 0; j < n; ++j) {
+		setPoint(points, j, d->profile[2*j], d->profile[2*j + 1], -1.f);
+		setPoint(points, n + j, d->profile[2*j], d->profile[2*j + 1], 1.f);
+	}
+
+	for (j = 0; j < n; ++j) {
+		uint j1 = (j + 1) % n;
+		e = putQuad(e, j, j1, n + j1, n + j);
+	}
+
+	// A tampa de trás é a da frente, invertida
+	triangulate(d->profile, n, e);
+	for (j = 0; j < 3*(n - 2); j += 3) {
+		GLuint a = e[j];
+
+		e[3*(n - 2) + j] = e[j + 2];
+		e[3*(n - 2) + j + 1] = e[j + 1];
+		e[3*(n - 2) + j + 2] = a;
+		e[j] += n;
+		e[j + 1] += n;
+		e[j + 2] += n;
+	}
+}
+
+/**
+ * Quantidade de vértices e de elementos de uma forma
+ *
+ * @return 0 se a descrição é válida
+ */
+int shapeSize(const ShapeDesc *d, uint *vertexCount, uint *elementCount)
+{
+	uint s, t;
+
+	assert(NULL != d);
+	assert(NULL != vertexCount && NULL != elementCount);
+
+	s = d->slices;
+	t = d->stacks;
+	switch ( d->type ) {
+	case SHAPE_SPHERE:
+		if ( s < 3 || t < 2 )
+			return -1;
+		*vertexCount = 2 + s*(t - 1);
+		*elementCount = 6*s*(t - 1);
+		return 0;
+	case SHAPE_CYLINDER:
+		if ( s < 3 || t < 1 )
+			return -1;
+		*vertexCount = s*(t + 1) + 2;
+		*elementCount = 6*s*t + 6*s;
+		return 0;
+	case SHAPE_PIPE:
+		if ( s < 3 || d->thickness <= 0.f || d->thickness >= 1.f )
+			return -1;
+		*vertexCount = 4*s;
+		*elementCount = 24*s;
+		return 0;
+	case SHAPE_TORUS:
+		if ( s < 3 || t < 3 || d->thickness <= 0.f || d->thickness > .5f )
+			return -1;
+		*vertexCount = s*t;
+		*elementCount = 6*s*t;
+		return 0;
+	case SHAPE_EXTRUSION:
+		if ( NULL == d->profile || d->profileCount < 3 )
+			return -1;
+		*vertexCount = 2*d->profileCount;
+		*elementCount = 6*d->profileCount + 6*(d->profileCount - 2);
+		return 0;
+	}
+	return -1;
+}
+
+/**
+ * Gera os vértices e os triângulos de uma forma
+ *
+ * Os triângulos são anti-horários vistos de fora. A descrição deve ser
+ * válida para shapeSize.
+ *
+ * @param points Recebe as posições, com 3 GLfloat por vértice
+ * @param elements Recebe os triângulos, com 3 elementos cada
+ */
+void generateShape(const ShapeDesc *d, GLfloat *points, GLuint *elements)
+{
+	assert(NULL != d);
+	assert(NULL != points && NULL != elements);
+
+	switch ( d->type ) {
+	case SHAPE_SPHERE:
+		generateSphere(d, points, elements);
+		break;
+	case SHAPE_CYLINDER:
+		generateCylinder(d, points, elements);
+		break;
+	case SHAPE_PIPE:
+		generatePipe(d, points, elements);
+		break;
+	case SHAPE_TORUS:
+		generateTorus(d, points, elements);
+		break;
+	case SHAPE_EXTRUSION:
+		generateExtrusion(d, points, elements);
+		break;
+	}
+}
+
+static void shapeWorker(void *arg, uint first, uint count)
+{
+	ShapeJob *job = arg;
+	ShapeBatch *b = job->batch;
+	uint i;
+
+	for (i = first; i < first + count; ++i)
+		generateShape(&job->desc[i], &b->vertices[3*b->vertexOffset[i]],
+			      &b->elements[b->elementOffset[i]]);
+}
+
+/**
+ * Gera várias formas em um único bloco de memória
+ *
+ * Os tamanhos são calculados antes, e cada forma é gerada diretamente na sua
+ * parte do bloco. Lotes grandes são divididos entre as threads do sistema de
+ * trabalhos, uma forma por trabalho.
+ *
+ * @param d Descrições das formas
+ * @param count Quantidade de formas
+ * @param jobs Sistema de trabalhos. Se NULL, as formas são geradas na thread
+ *             atual
+ * @param batch Recebe as formas geradas. Liberado com releaseShapes
+ * @return 0 em caso de sucesso, ou -1 se alguma descrição for inválida
+ */
+int generateShapes(const ShapeDesc *d, uint count, JobSystem *jobs,
+		   ShapeBatch *batch)
+{
+	ShapeJob job;
+	JobCounter done = { 0 };
+	double start = monotonicClock();
+	uint i;
+
+	assert(NULL != d || 0 == count);
+	assert(NULL != batch);
+
+	memset(batch, 0, sizeof(*batch));
+	batch->count = count;
+	batch->vertexOffset = malloc((count + 1)*sizeof(*batch->vertexOffset));
+	batch->elementOffset = malloc((count + 1)*sizeof(*batch->elementOffset));
+	batch->vertexOffset[0] = 0;
+	batch->elementOffset[0] = 0;
+	for (i = 0; i < count; ++i) {
+		uint vertices, elements;
+
+		if ( shapeSize(&d[i], &vertices, &elements) ) {
+			printf("Forma %u: tesselação inválida\n", i);
+			releaseShapes(batch);
+			return -1;
+		}
+		batch->vertexOffset[i + 1] = batch->vertexOffset[i] + vertices;
+		batch->elementOffset[i + 1] = batch->elementOffset[i] + elements;
+	}
+	batch->vertices = malloc((size_t) batch->vertexOffset[count]*3*sizeof(GLfloat));
+	batch->elements = malloc((size_t) batch->elementOffset[count]*sizeof(GLuint));
+
+	job.desc = d;
+	job.batch = batch;
+
+	if ( batch->vertexOffset[count] < PROCEDURAL_PARALLEL_MIN )
+		jobs = NULL;
+	parallelFor(jobs, shapeWorker, &job, count, 1, &done, NULL);
+	waitJobs(jobs, &done);
+
+	printf("%u formas, %u vértices e %u triângulos em %.3f s (%u threads)\n",
+	       count, batch->vertexOffset[count], batch->elementOffset[count] / 3,
+	       monotonicClock() - start, NULL != jobs ? jobs->threadCount : 1);
+	return 0;
+}
+
+/**
+ * Usa uma forma gerada como buffer e face de uma primitiva
+ *
+ * A primitiva guarda ponteiros para o lote, que deve continuar válido
+ * enquanto a primitiva for usada.
+ */
+void loadPrimitiveFromShape(Primitive *base, uint position, uint maxCount,
+			    const ShapeBatch *batch, uint shape)
+{
+	Faces *f;
+	uint first;
+
+	assert(NULL != batch);
+	assert(shape < batch->count);
+
+	first = batch->vertexOffset[shape];
+	setPrimitiveBuffer(base, position, maxCount, &batch->vertices[3*first],
+			   (GLsizeiptr) (batch->vertexOffset[shape + 1] - first) *
+			   3*sizeof(GLfloat));
+
+	initPrimitiveFaceArray(base, position, maxCount, 1);
+	f = getPrimitiveFaceElement(base, position, maxCount, 0);
+	initFace(f);
+	setFace(f, &batch->elements[batch->elementOffset[shape]],
+		batch->elementOffset[shape + 1] - batch->elementOffset[shape]);
+}
+
+void releaseShapes(ShapeBatch *batch)
+{
+	assert(NULL != batch);
+
+	free(batch->vertices);
+	free(batch->elements);
+	free(batch->vertexOffset);
+	free(batch->elementOffset);
+	memset(batch, 0, sizeof(*batch));
+}
+
+/**
+ * Perfil de uma viga H (ou I, girado), centrado na origem
+ *
+ * @param width Largura das mesas
+ * @param height Altura total
+ * @param flange Espessura das mesas
+ * @param web Espessura da alma
+ * @param out Recebe PROFILE_H_POINTS pontos, anti-horários, para SHAPE_EXTRUSION
+ */
+void buildHProfile(GLfloat width, GLfloat height, GLfloat flange, GLfloat web,
+		   GLfloat *out)
+{
+	GLfloat w = .5f*width, h = .5f*height, f = h - flange, t = .5f*web;
+	const GLfloat profile[2*PROFILE_H_POINTS] = {
+		-w, -h,	  w, -h,   w, -f,   t, -f,   t, f,    w, f,
+		w, h,	  -w, h,   -w, f,   -t, f,   -t, -f,  -w, -f
+	};
+
+	assert(NULL != out);
+	memcpy(out, profile, sizeof(profile));
+}
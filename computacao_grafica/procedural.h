@@ -0,0 +1,79 @@
+#ifndef __PROCEDURAL_H
+#define __PROCEDURAL_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "primitive.h"
+# include "jobs.h"
+
+/**
+ * Lotes com menos vértices que isso são gerados em uma única thread
+ */
+#define PROCEDURAL_PARALLEL_MIN	(1u << 16)
+/**
+ * Quantidade de pontos de um perfil H ou I
+ */
+#define PROFILE_H_POINTS	12
+
+/**
+ * @brief Formas geradas
+ *
+ * Todas cabem no cubo [-1, 1], como cubeVertex, e são centradas na origem.
+ * O eixo das formas de revolução é y; as extrusões seguem z.
+ */
+typedef enum ShapeType
+{
+	SHAPE_SPHERE = 0,	/**< esfera de raio 1 */
+	SHAPE_CYLINDER,		/**< cilindro de raio 1, com tampas */
+	SHAPE_PIPE,		/**< tubo de raio externo 1, oco */
+	SHAPE_TORUS,		/**< toro com anel de raio 1 - thickness */
+	SHAPE_EXTRUSION		/**< extrusão de um perfil no plano xy */
+} ShapeType;
+
+/**
+ * @brief Descrição de uma forma e da sua tesselação
+ */
+typedef struct ShapeDesc
+{
+	ShapeType	type;
+	uint		slices;		/**< divisões ao redor do eixo. Pelo menos 3 */
+	uint		stacks;		/**< divisões ao longo do eixo, ou ao redor do tubo do toro */
+	GLfloat		thickness;	/**< espessura da parede do tubo ou raio do tubo do toro */
+	const GLfloat	*profile;	/**< extrusão: polígono simples, anti-horário, 2 GLfloat por ponto */
+	uint		profileCount;	/**< extrusão: quantidade de pontos do perfil */
+} ShapeDesc;
+
+/**
+ * @brief Várias formas geradas em um único bloco de memória
+ *
+ * Os vértices possuem somente posições, com 3 GLfloat cada. A forma i usa os
+ * vértices de vertexOffset[i] até vertexOffset[i + 1] e os elementos de
+ * elementOffset[i] até elementOffset[i + 1]; os elementos de cada forma
+ * começam em 0.
+ */
+typedef struct ShapeBatch
+{
+	GLfloat		*vertices;	/**< posições de todas as formas */
+	GLuint		*elements;	/**< triângulos de todas as formas */
+	uint		*vertexOffset;	/**< primeiro vértice de cada forma, mais o final da última */
+	uint		*elementOffset;	/**< primeiro elemento de cada forma, mais o final da última */
+	uint		count;		/**< quantidade de formas */
+} ShapeBatch;
+
+int shapeSize(const ShapeDesc *d, uint *vertexCount, uint *elementCount);
+
+void generateShape(const ShapeDesc *d, GLfloat *points, GLuint *elements);
+
+int generateShapes(const ShapeDesc *d, uint count, JobSystem *jobs,
+		   ShapeBatch *batch);
+
+void loadPrimitiveFromShape(Primitive *base, uint position, uint maxCount,
+			    const ShapeBatch *batch, uint shape);
+
+void releaseShapes(ShapeBatch *batch);
+
+void buildHProfile(GLfloat width, GLfloat height, GLfloat flange, GLfloat web,
+		   GLfloat *out);
+
+#endif
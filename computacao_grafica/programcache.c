@@ -0,0 +1,202 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "programcache.h"
+
+/**
+ * Tamanho máximo do caminho de um arquivo do cache
+ */
+#define PROGRAM_CACHE_PATH	(sizeof(PROGRAM_CACHE_DIR) + 32)
+
+static GLboolean cacheAvailable()
+{
+	GLint formats = 0;
+
+	if ( !GLEW_ARB_get_program_binary )
+		return GL_FALSE;
+	// Alguns drivers oferecem a extensão sem nenhum formato
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+static void cachePath(uint64_t key, const char *suffix, char *path)
+{
+	snprintf(path, PROGRAM_CACHE_PATH, "%s/%016llx%s", PROGRAM_CACHE_DIR,
+		 (unsigned long long) key, suffix);
+}
+
+static uint64_t hashString(const char *s, uint64_t seed)
+{
+	return hashBytes(NULL != s ? s : "", NULL != s ? strlen(s) : 0, seed);
+}
+
+/**
+ * Chave de um programa no cache
+ *
+ * Combina os códigos fonte, na ordem dada, com o fabricante, o renderizador
+ * e a versão do driver: um binário nunca é oferecido a outro driver, nem
+ * depois de uma atualização. As definições do pré-processador fazem parte
+ * dos códigos fonte.
+ *
+ * @param sources Códigos fonte dos shaders, terminados em '\0'
+ * @param count Quantidade de códigos fonte
+ */
+uint64_t programCacheKey(const char *const *sources, uint count)
+{
+	uint64_t key = count;
+	uint i;
+
+	assert(NULL != sources || 0 == count);
+
+	for (i = 0; i < count; ++i)
+		key = hashString(sources[i], key);
+	key = hashString((const char *) glGetString(GL_VENDOR), key);
+	key = hashString((const char *) glGetString(GL_RENDERER), key);
+	key = hashString((const char *) glGetString(GL_VERSION), key);
+	return key;
+}
+
+/**
+ * Carrega um programa já ligado, guardado por storeCachedProgram
+ *
+ * O driver pode recusar o binário, por exemplo depois de uma atualização
+ * que mantém a versão. Nesse caso o arquivo é apagado e o programa deve ser
+ * compilado dos códigos fonte.
+ *
+ * @return Programa ligado, ou 0 se não houver um binário aceito pelo driver
+ */
+GLuint loadCachedProgram(uint64_t key)
+{
+	char path[PROGRAM_CACHE_PATH];
+	ProgramCacheHeader header;
+	GLuint program = 0;
+	GLint status = GL_FALSE;
+	void *data = NULL;
+	FILE *fp;
+
+	if ( !cacheAvailable() )
+		return 0;
+
+	cachePath(key, ".bin", path);
+	fp = fopen(path, "rb");
+	if ( NULL == fp )
+		return 0;
+
+	if ( 1 != fread(&header, sizeof(header), 1, fp) ||
+	     0 != memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) ||
+	     PROGRAM_CACHE_VERSION != header.version || key != header.key ||
+	     header.size > INT32_MAX ) {
+		printf("Cache de programa inválido: %s\n", path);
+		goto reject;
+	}
+
+	data = malloc(header.size);
+	if ( NULL == data || 1 != fread(data, header.size, 1, fp) ) {
+		printf("Cache de programa truncado: %s\n", path);
+		goto reject;
+	}
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.format, data, (GLsizei) header.size);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if ( GL_FALSE == status ) {
+		printf("Binário recusado pelo driver: %s\n", path);
+		glDeleteProgram(program);
+		program = 0;
+		goto reject;
+	}
+
+	printf("Programa carregado do cache: %s\n", path);
+	free(data);
+	fclose(fp);
+	return program;
+
+reject:
+	free(data);
+	fclose(fp);
+	unlink(path);
+	return 0;
+}
+
+/**
+ * Pede ao driver que mantenha o binário do programa
+ *
+ * Deve ser chamada antes de ligar um programa que será guardado com
+ * storeCachedProgram.
+ */
+void prepareCachedProgram(GLuint program)
+{
+	if ( cacheAvailable() )
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+				    GL_TRUE);
+}
+
+/**
+ * Guarda o binário de um programa ligado
+ *
+ * O arquivo é gravado com outro nome e renomeado no final: outro processo
+ * nunca lê um binário pela metade.
+ *
+ * @return 0 em caso de sucesso
+ */
+int storeCachedProgram(uint64_t key, GLuint program)
+{
+	char path[PROGRAM_CACHE_PATH], tmp[PROGRAM_CACHE_PATH];
+	ProgramCacheHeader header;
+	GLint length = 0;
+	GLenum format;
+	void *data;
+	FILE *fp;
+	int written, result = -1;
+
+	if ( !cacheAvailable() )
+		return -1;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if ( length <= 0 )
+		return -1;
+	data = malloc(length);
+	glGetProgramBinary(program, length, &length, &format, data);
+
+	if ( mkdir(PROGRAM_CACHE_DIR, 0755) && EEXIST != errno ) {
+		printf("Incapaz de criar o diretório %s\n", PROGRAM_CACHE_DIR);
+		free(data);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.format = format;
+	header.key = key;
+	header.size = length;
+
+	cachePath(key, ".bin", path);
+	cachePath(key, ".tmp", tmp);
+	fp = fopen(tmp, "wb");
+	if ( NULL == fp ) {
+		printf("Incapaz de criar o arquivo %s\n", tmp);
+		free(data);
+		return -1;
+	}
+	written = 1 == fwrite(&header, sizeof(header), 1, fp) &&
+		  1 == fwrite(data, length, 1, fp);
+	if ( 0 != fclose(fp) )
+		written = 0;
+	if ( written )
+		result = rename(tmp, path);
+	else
+		printf("Erro ao gravar o arquivo %s\n", tmp);
+	if ( result )
+		unlink(tmp);
+	free(data);
+	return result;
+}
@@ -0,0 +1,38 @@
+#ifndef __PROGRAMCACHE_H
+#define __PROGRAMCACHE_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+# include <stdint.h>
+
+/**
+ * Diretório dos programas já ligados, relativo ao diretório atual
+ */
+#define PROGRAM_CACHE_DIR	".programcache"
+/**
+ * Identificação e versão do arquivo de um programa
+ */
+#define PROGRAM_CACHE_MAGIC	"CGPROG"
+#define PROGRAM_CACHE_VERSION	2
+
+/**
+ * @brief Cabeçalho do arquivo de um programa, seguido pelo binário do driver
+ */
+typedef struct ProgramCacheHeader
+{
+	char		magic[8];	/**< PROGRAM_CACHE_MAGIC */
+	uint32_t	version;	/**< PROGRAM_CACHE_VERSION */
+	uint32_t	format;		/**< formato do binário, de glGetProgramBinary */
+	uint64_t	key;		/**< chave de programCacheKey */
+	uint64_t	size;		/**< bytes do binário */
+} ProgramCacheHeader;
+
+uint64_t programCacheKey(const char *const *sources, uint count);
+
+GLuint loadCachedProgram(uint64_t key);
+
+void prepareCachedProgram(GLuint program);
+
+int storeCachedProgram(uint64_t key, GLuint program);
+
+#endif
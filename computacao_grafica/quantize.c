@@ -0,0 +1,171 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "quantize.h"
+
+/**
+ * Calcula a matriz que converte posições SNORM16 nas posições originais
+ *
+ * As posições são quantizadas em relação à caixa envolvente da malha: o
+ * centro da caixa vai para a origem e cada eixo é escalado para [-1, 1]. A
+ * matriz desfaz essa conversão e pode ser combinada com a transformação do
+ * objeto, dispensando qualquer mudança no shader.
+ *
+ * @param points Posição do primeiro vértice
+ * @param stride Distância entre dois vértices, em GLfloat
+ * @param vertexCount Quantidade de vértices
+ * @param dequant Recebe a matriz de dequantização
+ */
+void computeQuantization(const GLfloat *points, uint stride, uint vertexCount,
+			 mat4x4 dequant)
+{
+	vec3 lo = { INFINITY, INFINITY, INFINITY };
+	vec3 hi = { -INFINITY, -INFINITY, -INFINITY };
+	uint i;
+	int k;
+
+	assert(NULL != points);
+
+	mat4x4_identity(dequant);
+	if ( 0 == vertexCount )
+		return;
+
+	for (i = 0; i < vertexCount; ++i)
+		for (k = 0; k < 3; ++k) {
+			if ( points[stride*i + k] < lo[k] )
+				lo[k] = points[stride*i + k];
+			if ( points[stride*i + k] > hi[k] )
+				hi[k] = points[stride*i + k];
+		}
+
+	for (k = 0; k < 3; ++k) {
+		float extent = .5f*(hi[k] - lo[k]);
+		dequant[k][k] = extent > 0.f ? extent : 1.f;
+		dequant[3][k] = .5f*(hi[k] + lo[k]);
+	}
+}
+
+/**
+ * Gera o formato com as posições quantizadas
+ *
+ * A posição passa a ocupar 4 GLshort normalizados: as 3 coordenadas e um
+ * complemento, mantendo o alinhamento de 4 bytes. Os demais atributos são
+ * mantidos, na mesma ordem.
+ *
+ * @param src Formato original, com posições GL_FLOAT
+ * @param dst Recebe o formato quantizado
+ */
+void quantizeVertexFormat(const VertexFormat *src, VertexFormat *dst)
+{
+	GLuint last = 0;
+	int i;
+
+	assert(NULL != src && NULL != dst);
+	assert(GL_FLOAT == src->attrib[ATTRIB_POSITION].type);
+
+	initVertexFormat(dst);
+	for (;;) {
+		int next = -1;
+
+		// Próximo atributo, na ordem em que aparece no vértice
+		for (i = 0; i < ATTRIB_COUNT; ++i) {
+			const VertexElement *e = &src->attrib[i];
+			if ( 0 == e->size || 0 != dst->attrib[i].size )
+				continue;
+			if ( e->offset < last )
+				continue;
+			if ( -1 == next || e->offset < src->attrib[next].offset )
+				next = i;
+		}
+		if ( -1 == next )
+			break;
+
+		last = src->attrib[next].offset;
+		if ( ATTRIB_POSITION == next )
+			addVertexAttribute(dst, next, 4, GL_SHORT, GL_TRUE);
+		else
+			addVertexAttribute(dst, next, src->attrib[next].size,
+					   src->attrib[next].type,
+					   src->attrib[next].normalized);
+	}
+	// O complemento não é lido pelo shader
+	dst->attrib[ATTRIB_POSITION].size = 3;
+}
+
+/**
+ * Codifica uma coordenada em [-1, 1] como SNORM16
+ *
+ * Antes do OpenGL 4.2, o driver converte um SNORM16 c em (2c + 1)/65535, e
+ * não em c/32767: a codificação segue a conversão do driver, para que a
+ * mesma matriz de dequantização sirva aos dois.
+ *
+ * @param symmetric GL_TRUE se o driver converte c em c/32767
+ */
+static GLshort encodeSnorm16(float c, GLboolean symmetric)
+{
+	if ( symmetric )
+		return (GLshort) lrintf(c*QUANTIZE_SNORM16_MAX);
+	return (GLshort) lrintf(.5f*((2*QUANTIZE_SNORM16_MAX + 1)*c - 1.f));
+}
+
+/**
+ * Converte os vértices para o formato quantizado
+ *
+ * As posições seguem a conversão SNORM16 do contexto atual: o resultado não
+ * deve ser guardado para outro contexto.
+ *
+ * @param src Formato dos vértices em in
+ * @param in Vértices originais
+ * @param vertexCount Quantidade de vértices
+ * @param dequant Matriz calculada por computeQuantization
+ * @param dst Formato gerado por quantizeVertexFormat
+ * @param out Vetor de saída, com vertexCount*dst->stride bytes
+ */
+void quantizeVertices(const VertexFormat *src, const GLvoid *in,
+		      uint vertexCount, mat4x4 dequant, const VertexFormat *dst,
+		      GLvoid *out)
+{
+	GLboolean symmetric = GLEW_VERSION_4_2;
+	uint i;
+	int a, k;
+
+	assert(NULL != src && NULL != dst);
+	assert(NULL != in && NULL != out);
+
+	for (i = 0; i < vertexCount; ++i) {
+		const char *v = (const char *) in + i*src->stride;
+		char *o = (char *) out + i*dst->stride;
+
+		for (a = 0; a < ATTRIB_COUNT; ++a) {
+			const VertexElement *e = &src->attrib[a];
+
+			if ( 0 == e->size )
+				continue;
+			if ( ATTRIB_POSITION != a ) {
+				memcpy(o + dst->attrib[a].offset, v + e->offset,
+				       e->size*vertexTypeSize(e->type));
+				continue;
+			}
+			for (k = 0; k < 4; ++k) {
+				GLshort *q = (GLshort *) (o + dst->attrib[a].offset);
+				float c;
+
+				if ( 3 == k ) {
+					q[k] = 0;
+					continue;
+				}
+				c = ((const GLfloat *) (v + e->offset))[k];
+				c = (c - dequant[3][k]) / dequant[k][k];
+				if ( c > 1.f )
+					c = 1.f;
+				if ( c < -1.f )
+					c = -1.f;
+				q[k] = encodeSnorm16(c, symmetric);
+			}
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef __QUANTIZE_H
+#define __QUANTIZE_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+# include "vertexformat.h"
+
+/**
+ * Maior valor de uma coordenada SNORM16
+ */
+#define QUANTIZE_SNORM16_MAX	32767
+
+void computeQuantization(const GLfloat *points, uint stride, uint vertexCount,
+			 mat4x4 dequant);
+
+void quantizeVertexFormat(const VertexFormat *src, VertexFormat *dst);
+
+void quantizeVertices(const VertexFormat *src, const GLvoid *in,
+		      uint vertexCount, mat4x4 dequant, const VertexFormat *dst,
+		      GLvoid *out);
+
+#endif
@@ -0,0 +1,280 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "hash.h"
+#include "vertexformat.h"
+#include "reflect.h"
+
+/**
+ * Posição de um nome na tabela: a primeira vazia, ou a da variável com o
+ * mesmo nome e tipo
+ */
+static uint findSlot(const ProgramReflection *r, ReflectedKind kind,
+		     const char *name)
+{
+	uint mask = r->tableSize - 1, slot;
+
+	slot = hashBytes(name, strlen(name), kind) & mask;
+	for (; 0 != r->table[slot]; slot = (slot + 1) & mask) {
+		const ReflectedVariable *v = &r->vars[r->table[slot] - 1];
+
+		if ( v->kind == kind && 0 == strcmp(v->name, name) )
+			break;
+	}
+	return slot;
+}
+
+/**
+ * Acrescenta uma variável, com o nome lido do driver
+ *
+ * @param length Tamanho do nome, devolvido pelo driver
+ * @return A variável, ou NULL se o nome não cabe
+ */
+static ReflectedVariable* addVariable(ProgramReflection *r, ReflectedKind kind,
+				      const char *name, GLsizei length)
+{
+	ReflectedVariable *v;
+
+	if ( length >= REFLECT_NAME_MAX - 1 ) {
+		printf("Nome muito longo, ignorado na reflexão: %s\n", name);
+		return NULL;
+	}
+	v = &r->vars[r->count++];
+	memset(v, 0, sizeof(*v));
+	strcpy(v->name, name);
+	v->kind = kind;
+
+	// Arrays aparecem como nome[0]; são procurados sem o índice
+	if ( length > 3 && 0 == strcmp(v->name + length - 3, "[0]") )
+		v->name[length - 3] = '\0';
+	return v;
+}
+
+/**
+ * Lê as variáveis ativas de um programa ligado
+ *
+ * Uniforms, atributos e, se o contexto os oferece, uniform blocks entram em
+ * uma tabela hash pelo nome. Uniforms dentro de blocos não têm location e
+ * ficam somente no bloco. Um atributo conhecido fora da location fixada por
+ * bindVertexAttributes é informado: os vertex arrays não o alimentariam.
+ *
+ * @param r Recebe a reflexão. Liberada com releaseProgramReflection
+ * @param program Programa ligado
+ * @return 0 em caso de sucesso
+ */
+int reflectProgram(ProgramReflection *r, GLuint program)
+{
+	char name[REFLECT_NAME_MAX];
+	GLint uniforms = 0, attributes = 0, blocks = 0, linked = GL_FALSE;
+	GLsizei length;
+	ReflectedVariable *v;
+	uint i, k;
+
+	assert(NULL != r);
+
+	memset(r, 0, sizeof(*r));
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if ( GL_FALSE == linked ) {
+		printf("Reflexão de um programa não ligado\n");
+		return -1;
+	}
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniforms);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &attributes);
+	if ( GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object )
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+
+	r->program = program;
+	r->vars = malloc((uniforms + attributes + blocks + 1)*sizeof(*r->vars));
+
+	for (i = 0; i < (uint) uniforms; ++i) {
+		GLint size;
+		GLenum type;
+
+		glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+		v = addVariable(r, REFLECT_UNIFORM, name, length);
+		if ( NULL == v )
+			continue;
+		v->location = glGetUniformLocation(program, v->name);
+		v->type = type;
+		v->size = size;
+		if ( v->location < 0 )
+			--r->count;
+	}
+
+	for (i = 0; i < (uint) attributes; ++i) {
+		GLint size;
+		GLenum type;
+
+		glGetActiveAttrib(program, i, sizeof(name), &length, &size, &type, name);
+		v = addVariable(r, REFLECT_ATTRIBUTE, name, length);
+		if ( NULL == v )
+			continue;
+		v->location = glGetAttribLocation(program, v->name);
+		v->type = type;
+		v->size = size;
+
+		for (k = 0; k < ATTRIB_COUNT; ++k)
+			if ( 0 == strcmp(v->name, vertexAttributeName(k)) && k != v->location )
+				printf("Atributo %s na location %d, esperada %u\n",
+				       v->name, v->location, k);
+	}
+
+	for (i = 0; i < (uint) blocks; ++i) {
+		glGetActiveUniformBlockName(program, i, sizeof(name), &length, name);
+		v = addVariable(r, REFLECT_BLOCK, name, length);
+		if ( NULL == v )
+			continue;
+		v->location = i;
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &v->size);
+	}
+
+	// No máximo meio cheia
+	r->tableSize = 1;
+	while ( r->tableSize < 2*(r->count + 1) )
+		r->tableSize <<= 1;
+	r->table = calloc(r->tableSize, sizeof(*r->table));
+	for (i = 0; i < r->count; ++i) {
+		uint slot = findSlot(r, r->vars[i].kind, r->vars[i].name);
+
+		// Um nome repetido fica com a primeira variável
+		if ( 0 == r->table[slot] )
+			r->table[slot] = i + 1;
+	}
+	return 0;
+}
+
+static int findVariable(const ProgramReflection *r, ReflectedKind kind,
+			const char *name)
+{
+	assert(NULL != r && NULL != name);
+
+	if ( NULL == r->table )
+		return -1;
+	return (int) r->table[findSlot(r, kind, name)] - 1;
+}
+
+/**
+ * Índice de uma uniform fora de blocos
+ *
+ * Deve ser chamada fora do desenho, e o índice guardado.
+ *
+ * @return Índice usado pelos setters, ou -1 se a uniform não está ativa. Os
+ *         setters ignoram -1, como o OpenGL ignora a location -1
+ */
+int findUniform(const ProgramReflection *r, const char *name)
+{
+	return findVariable(r, REFLECT_UNIFORM, name);
+}
+
+/**
+ * Índice de um atributo ativo. A location fica em r->vars[índice]
+ *
+ * @return Índice do atributo, ou -1 se não está ativo
+ */
+int findAttribute(const ProgramReflection *r, const char *name)
+{
+	return findVariable(r, REFLECT_ATTRIBUTE, name);
+}
+
+/**
+ * Índice de um uniform block ativo. O índice do bloco no programa e o seu
+ * tamanho ficam em r->vars[índice]
+ *
+ * @return Índice do bloco, ou -1 se não está ativo
+ */
+int findUniformBlock(const ProgramReflection *r, const char *name)
+{
+	return findVariable(r, REFLECT_BLOCK, name);
+}
+
+/**
+ * Guarda o valor de uma uniform, se mudou
+ *
+ * @param type Tipo GLSL esperado. 0 aceita qualquer um
+ * @return A variável, se o valor deve ser enviado. NULL se é igual ao último
+ */
+static ReflectedVariable* changeValue(ProgramReflection *r, int uniform,
+				      GLenum type, const void *value, size_t size)
+{
+	ReflectedVariable *v;
+
+	if ( uniform < 0 )
+		return NULL;
+	assert((uint) uniform < r->count);
+	v = &r->vars[uniform];
+	assert(REFLECT_UNIFORM == v->kind && (0 == type || type == v->type));
+
+	if ( v->known && 0 == memcmp(&v->value, value, size) ) {
+		++r->skipped;
+		return NULL;
+	}
+	memcpy(&v->value, value, size);
+	v->known = GL_TRUE;
+	++r->uploads;
+	return v;
+}
+
+/**
+ * Envia um int, ou um sampler, se mudou
+ *
+ * Os setters valem para o programa em uso, que deve ser r->program.
+ *
+ * @param uniform Índice de findUniform
+ */
+void setUniformInt(ProgramReflection *r, int uniform, GLint value)
+{
+	ReflectedVariable *v;
+
+	assert(NULL != r);
+
+	// Samplers e booleanos também recebem um int
+	v = changeValue(r, uniform, 0, &value, sizeof(value));
+	if ( NULL != v )
+		glUniform1i(v->location, value);
+}
+
+void setUniformFloat(ProgramReflection *r, int uniform, GLfloat value)
+{
+	ReflectedVariable *v;
+
+	assert(NULL != r);
+
+	v = changeValue(r, uniform, GL_FLOAT, &value, sizeof(value));
+	if ( NULL != v )
+		glUniform1f(v->location, value);
+}
+
+void setUniformVec4(ProgramReflection *r, int uniform, const vec4 value)
+{
+	ReflectedVariable *v;
+
+	assert(NULL != r);
+
+	v = changeValue(r, uniform, GL_FLOAT_VEC4, value, sizeof(vec4));
+	if ( NULL != v )
+		glUniform4fv(v->location, 1, value);
+}
+
+void setUniformMatrix4(ProgramReflection *r, int uniform, mat4x4 value)
+{
+	ReflectedVariable *v;
+
+	assert(NULL != r);
+
+	v = changeValue(r, uniform, GL_FLOAT_MAT4, value, sizeof(mat4x4));
+	if ( NULL != v )
+		glUniformMatrix4fv(v->location, 1, GL_FALSE, (GLfloat *) value);
+}
+
+void releaseProgramReflection(ProgramReflection *r)
+{
+	assert(NULL != r);
+
+	free(r->table);
+	free(r->vars);
+	memset(r, 0, sizeof(*r));
+}
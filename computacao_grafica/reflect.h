@@ -0,0 +1,77 @@
+#ifndef __REFLECT_H
+#define __REFLECT_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "linmath.h"
+
+/**
+ * Tamanho máximo do nome de uma variável, com o '\0'
+ */
+#define REFLECT_NAME_MAX	64
+
+/**
+ * @brief Tipo de uma variável ativa do programa
+ */
+typedef enum ReflectedKind
+{
+	REFLECT_UNIFORM = 0,	/**< uniform fora de blocos */
+	REFLECT_ATTRIBUTE,	/**< atributo do shader vertex */
+	REFLECT_BLOCK		/**< uniform block */
+} ReflectedKind;
+
+/**
+ * @brief Uma variável ativa, com o último valor enviado se for uma uniform
+ */
+typedef struct ReflectedVariable
+{
+	char		name[REFLECT_NAME_MAX];	/**< nome, sem o sufixo [0] dos arrays */
+	ReflectedKind	kind;
+	GLint		location;	/**< location, ou índice do bloco */
+	GLenum		type;		/**< tipo GLSL. 0 nos blocos */
+	GLint		size;		/**< elementos do array, ou bytes do bloco */
+	GLboolean	known;		/**< se value guarda o valor atual da uniform */
+	union {
+		GLfloat	f[16];
+		GLint	i[16];
+	} value;			/**< último valor enviado, se known */
+} ReflectedVariable;
+
+/**
+ * @brief Variáveis ativas de um programa ligado
+ *
+ * Os nomes são procurados uma vez, em uma tabela hash; no desenho, as
+ * variáveis são usadas pelo índice devolvido. Os setters não chamam o driver
+ * quando o valor não mudou desde o último envio.
+ */
+typedef struct ProgramReflection
+{
+	GLuint			program;
+	ReflectedVariable	*vars;		/**< uniforms, atributos e blocos */
+	uint			count;
+	uint			*table;		/**< índice + 1 de cada variável, por hash do nome. 0 se vazio */
+	uint			tableSize;	/**< potência de 2 */
+	uint			uploads;	/**< valores enviados ao driver */
+	uint			skipped;	/**< valores iguais ao último, não enviados */
+} ProgramReflection;
+
+int reflectProgram(ProgramReflection *r, GLuint program);
+
+int findUniform(const ProgramReflection *r, const char *name);
+
+int findAttribute(const ProgramReflection *r, const char *name);
+
+int findUniformBlock(const ProgramReflection *r, const char *name);
+
+void setUniformInt(ProgramReflection *r, int uniform, GLint value);
+
+void setUniformFloat(ProgramReflection *r, int uniform, GLfloat value);
+
+void setUniformVec4(ProgramReflection *r, int uniform, const vec4 value);
+
+void setUniformMatrix4(ProgramReflection *r, int uniform, mat4x4 value);
+
+void releaseProgramReflection(ProgramReflection *r);
+
+#endif
@@ -0,0 +1,338 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include "variant.h"
+#include "reload.h"
+
+/**
+ * Eventos de um diretório que indicam um código fonte novo: gravado no
+ * lugar, ou gravado com outro nome e renomeado
+ */
+#define RELOAD_EVENTS	(IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/**
+ * Observa o diretório de um código fonte
+ *
+ * O diretório é observado, não o arquivo: editores que gravam uma cópia e a
+ * renomeiam trocam o arquivo, e a observação dele se perderia.
+ *
+ * @param name Recebe o nome do arquivo, sem o diretório
+ * @return Identificador da observação, ou -1 em caso de erro
+ */
+static int watchSource(int notify, const char *path, const char **name)
+{
+	char dir[VARIANT_NAME_MAX];
+	const char *slash = strrchr(path, '/');
+
+	if ( NULL == slash ) {
+		strcpy(dir, ".");
+		*name = path;
+	} else {
+		snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path + 1), path);
+		*name = slash + 1;
+	}
+	return inotify_add_watch(notify, dir, RELOAD_EVENTS);
+}
+
+/**
+ * Lê todos os eventos pendentes
+ *
+ * @return Se algum dos eventos é de um dos códigos fonte
+ */
+static int readEvents(ShaderReload *r)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *e;
+	ssize_t size;
+	int changed = 0, k;
+	char *p;
+
+	while ( (size = read(r->notify, buf, sizeof(buf))) > 0 )
+		for (p = buf; p < buf + size; p += sizeof(*e) + e->len) {
+			e = (const struct inotify_event *) p;
+			if ( 0 == e->len )
+				continue;
+			for (k = 0; k < 2; ++k)
+				if ( e->wd == r->watch[k] && 0 == strcmp(e->name, r->name[k]) )
+					changed = 1;
+		}
+	return changed;
+}
+
+/**
+ * Entrega os programas novos, descartando os ainda não trocados
+ *
+ * Deve ser chamada com a trava.
+ */
+static void publishPrograms(ShaderReload *r, const uint *features, uint count,
+			    const GLuint *program, GLsync fence)
+{
+	uint i;
+
+	for (i = 0; i < SHADER_VARIANT_COUNT; ++i)
+		if ( 0 != r->ready[i] ) {
+			glDeleteProgram(r->ready[i]);
+			r->ready[i] = 0;
+		}
+	if ( NULL != r->fence )
+		glDeleteSync(r->fence);
+
+	for (i = 0; i < count; ++i)
+		r->ready[features[i]] = program[i];
+	r->fence = fence;
+}
+
+/**
+ * Compila de novo todas as variantes em uso
+ *
+ * As máscaras são lidas com a trava, que a thread do OpenGL também usa ao
+ * compilar uma variante nova. Uma variante compilada depois deste ponto já
+ * lê os códigos fonte novos, e fica com o seu programa na troca.
+ *
+ * @param program Recebe os programas novos
+ * @param features Recebe as máscaras das variantes
+ * @param count Recebe a quantidade de variantes
+ * @return 0 se todas compilaram. Senão, nenhum programa novo é entregue
+ */
+static int rebuildPrograms(ShaderReload *r, GLuint *program, uint *features,
+			   uint *count)
+{
+	uint i, n = 0;
+
+	pthread_mutex_lock(&r->lock);
+	for (i = 0; i < SHADER_VARIANT_COUNT; ++i)
+		if ( 0 != r->variants->program[i] )
+			features[n++] = i;
+	pthread_mutex_unlock(&r->lock);
+
+	*count = n;
+	if ( 0 == buildShaderVariants(r->variants, features, n, program) )
+		return 0;
+
+	for (i = 0; i < n; ++i)
+		if ( 0 != program[i] )
+			glDeleteProgram(program[i]);
+	printf("Erro na recarga dos shaders: os programas atuais continuam em uso\n");
+	return -1;
+}
+
+/**
+ * Thread de recarga: espera as gravações dos códigos fonte
+ *
+ * Com um contexto compartilhado, compila os programas novos e publica uma
+ * cerca; sem ele, somente pede a compilação ao próximo quadro.
+ */
+static void* reloadThread(void *arg)
+{
+	ShaderReload *r = arg;
+	struct pollfd fds[2];
+	GLuint program[SHADER_VARIANT_COUNT];
+	uint features[SHADER_VARIANT_COUNT];
+	uint count;
+
+	if ( NULL != r->context )
+		glfwMakeContextCurrent(r->context);
+
+	fds[0].fd = r->notify;
+	fds[0].events = POLLIN;
+	fds[1].fd = r->wakeup[0];
+	fds[1].events = POLLIN;
+	for (;;) {
+		int ready = poll(fds, 2, -1);
+
+		if ( ready < 0 && EINTR == errno )
+			continue;
+		if ( ready < 0 || (fds[1].revents & POLLIN) )
+			break;
+		if ( !readEvents(r) )
+			continue;
+
+		// Espera o editor terminar de gravar
+		while ( (ready = poll(fds, 2, RELOAD_SETTLE_MS)) > 0 &&
+			!(fds[1].revents & POLLIN) )
+			readEvents(r);
+		if ( ready > 0 )
+			break;
+
+		printf("Códigos fonte alterados: recarregando os shaders\n");
+		if ( NULL == r->context ) {
+			pthread_mutex_lock(&r->lock);
+			r->requested = 1;
+			pthread_mutex_unlock(&r->lock);
+			continue;
+		}
+		if ( rebuildPrograms(r, program, features, &count) )
+			continue;
+
+		// Os programas só são usados no outro contexto depois da cerca
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		pthread_mutex_lock(&r->lock);
+		publishPrograms(r, features, count, program, fence);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	if ( NULL != r->context )
+		glfwMakeContextCurrent(NULL);
+	return NULL;
+}
+
+/**
+ * Inicia a observação dos códigos fonte das variantes
+ *
+ * Deve ser chamada na thread do OpenGL, depois de compiladas as variantes
+ * usadas. Sem cercas ou sem um contexto compartilhado, a compilação é feita
+ * na thread do OpenGL, entre os quadros, e o desenho para enquanto isso.
+ *
+ * @param v Variantes recarregadas. Devem continuar válidas até
+ *          stopShaderReload
+ * @param share Janela cujo contexto é compartilhado com a thread de recarga
+ * @return 0 em caso de sucesso. Senão, os shaders não são recarregados
+ */
+int startShaderReload(ShaderReload *r, ShaderVariants *v, GLFWwindow *share)
+{
+	assert(NULL != r);
+	assert(NULL != v);
+
+	memset(r, 0, sizeof(*r));
+	r->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ( r->notify < 0 ) {
+		printf("inotify indisponível: os shaders não serão recarregados\n");
+		return -1;
+	}
+	r->watch[0] = watchSource(r->notify, v->vertex, &r->name[0]);
+	r->watch[1] = watchSource(r->notify, v->fragment, &r->name[1]);
+	if ( r->watch[0] < 0 || r->watch[1] < 0 ) {
+		printf("Incapaz de observar os diretórios dos shaders\n");
+		goto closeNotify;
+	}
+	if ( pipe(r->wakeup) ) {
+		printf("Incapaz de criar o pipe da thread de recarga\n");
+		goto closeNotify;
+	}
+
+	// Sem cercas, a thread do OpenGL não saberia quando os programas estão prontos
+	if ( NULL != share && (GLEW_VERSION_3_2 || GLEW_ARB_sync) ) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		r->context = glfwCreateWindow(1, 1, "", NULL, share);
+		glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+		if ( NULL == r->context )
+			printf("Contexto compartilhado indisponível: shaders recarregados no desenho\n");
+	}
+
+	r->variants = v;
+	pthread_mutex_init(&r->lock, NULL);
+	// As variantes compiladas no desenho passam a ser publicadas com a trava
+	v->lock = &r->lock;
+	if ( pthread_create(&r->thread, NULL, reloadThread, r) ) {
+		printf("Incapaz de criar a thread de recarga\n");
+		if ( NULL != r->context )
+			glfwDestroyWindow(r->context);
+		v->lock = NULL;
+		pthread_mutex_destroy(&r->lock);
+		close(r->wakeup[0]);
+		close(r->wakeup[1]);
+		goto closeNotify;
+	}
+	return 0;
+
+closeNotify:
+	close(r->notify);
+	memset(r, 0, sizeof(*r));
+	return -1;
+}
+
+/**
+ * Troca os programas das variantes pelos recarregados, se estiverem prontos
+ *
+ * Deve ser chamada entre os quadros, na thread do OpenGL. Nunca espera pela
+ * thread de recarga. Os programas antigos são apagados; o driver só os
+ * remove quando deixam de ser usados.
+ *
+ * @return 1 se os programas foram trocados. O programa em uso e as
+ *         localizações das suas variáveis devem ser obtidos de novo
+ */
+int swapReloadedShaders(ShaderReload *r)
+{
+	GLuint program[SHADER_VARIANT_COUNT];
+	uint features[SHADER_VARIANT_COUNT];
+	uint i, count;
+	int swapped = 0;
+
+	assert(NULL != r);
+
+	if ( NULL == r->variants || pthread_mutex_trylock(&r->lock) )
+		return 0;
+
+	if ( r->requested ) {
+		r->requested = 0;
+		pthread_mutex_unlock(&r->lock);
+		if ( rebuildPrograms(r, program, features, &count) )
+			return 0;
+		pthread_mutex_lock(&r->lock);
+		publishPrograms(r, features, count, program, NULL);
+		swapped = 1;
+	} else if ( NULL != r->fence ) {
+		GLenum status = glClientWaitSync(r->fence, 0, 0);
+
+		if ( GL_ALREADY_SIGNALED == status || GL_CONDITION_SATISFIED == status ) {
+			glDeleteSync(r->fence);
+			r->fence = NULL;
+			swapped = 1;
+		}
+	}
+
+	if ( swapped )
+		for (i = 0; i < SHADER_VARIANT_COUNT; ++i) {
+			if ( 0 == r->ready[i] )
+				continue;
+			if ( 0 != r->variants->program[i] )
+				glDeleteProgram(r->variants->program[i]);
+			r->variants->program[i] = r->ready[i];
+			r->ready[i] = 0;
+		}
+	pthread_mutex_unlock(&r->lock);
+
+	if ( swapped )
+		printf("Shaders recarregados\n");
+	return swapped;
+}
+
+/**
+ * Encerra a thread de recarga e descarta os programas não trocados
+ *
+ * Deve ser chamada antes de destroyShaderVariants. Não faz nada se a recarga
+ * não foi iniciada.
+ */
+void stopShaderReload(ShaderReload *r)
+{
+	assert(NULL != r);
+
+	if ( NULL == r->variants )
+		return;
+
+	// Uma compilação em andamento termina antes
+	if ( 1 != write(r->wakeup[1], "", 1) )
+		printf("Incapaz de acordar a thread de recarga\n");
+	pthread_join(r->thread, NULL);
+
+	if ( NULL != r->context )
+		glfwDestroyWindow(r->context);
+	publishPrograms(r, NULL, 0, NULL, NULL);
+
+	r->variants->lock = NULL;
+	pthread_mutex_destroy(&r->lock);
+	close(r->wakeup[0]);
+	close(r->wakeup[1]);
+	close(r->notify);
+	memset(r, 0, sizeof(*r));
+}
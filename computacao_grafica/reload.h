@@ -0,0 +1,48 @@
+#ifndef __RELOAD_H
+#define __RELOAD_H
+
+# include <GL/glew.h>
+# include <GLFW/glfw3.h>
+# include <stdlib.h>
+# include <pthread.h>
+
+# include "variant.h"
+
+/**
+ * Tempo sem novas gravações antes de recompilar, em milissegundos. Editores
+ * costumam gravar um arquivo em várias etapas
+ */
+#define RELOAD_SETTLE_MS	100
+
+/**
+ * @brief Recarga dos shaders quando os códigos fonte mudam
+ *
+ * Uma thread observa, com o inotify, os diretórios dos códigos fonte. Quando
+ * um deles é gravado, as variantes já compiladas são compiladas de novo em
+ * um contexto compartilhado com a janela, sem parar o desenho. Os programas
+ * novos só substituem os atuais entre os quadros, todos juntos, depois que a
+ * cerca deles é sinalizada. Se alguma variante falha, os programas atuais
+ * continuam em uso.
+ */
+typedef struct ShaderReload
+{
+	ShaderVariants	*variants;	/**< variantes recarregadas. NULL se a recarga não foi iniciada */
+	GLFWwindow	*context;	/**< contexto da thread. NULL se a compilação é feita entre os quadros */
+	int		notify;		/**< descritor do inotify */
+	int		watch[2];	/**< diretórios observados, do vertex e do fragment */
+	const char	*name[2];	/**< nomes dos códigos fonte, sem o diretório */
+	int		wakeup[2];	/**< pipe que acorda a thread no encerramento */
+	int		requested;	/**< sem contexto: recarga pedida, feita no próximo quadro */
+	GLuint		ready[SHADER_VARIANT_COUNT];	/**< programas novos, ainda não trocados. 0 se nenhum */
+	GLsync		fence;		/**< sinalizada quando os programas novos estão prontos */
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+} ShaderReload;
+
+int startShaderReload(ShaderReload *r, ShaderVariants *v, GLFWwindow *share);
+
+int swapReloadedShaders(ShaderReload *r);
+
+void stopShaderReload(ShaderReload *r);
+
+#endif
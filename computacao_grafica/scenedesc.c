@@ -0,0 +1,629 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "linmath.h"
+#include "primitive.h"
+#include "importer.h"
+#include "quantize.h"
+#include "scenefile.h"
+#include "scenedesc.h"
+
+enum { ARRAY_VERTICES, ARRAY_ELEMENTS, ARRAY_MESH };
+
+/**
+ * Vetor ou malha declarado na descrição
+ */
+typedef struct NamedArray
+{
+	char		name[SCENEDESC_NAME_MAX];
+	int		kind;		/**< ARRAY_VERTICES, ARRAY_ELEMENTS ou ARRAY_MESH */
+	uint		index;		/**< posição em arrays ou em meshes */
+	uint		count;		/**< quantidade de GLfloat ou de GLuint */
+} NamedArray;
+
+typedef struct FaceDesc
+{
+	uint		array;		/**< vetor de elementos */
+	GLenum		mode;
+	mat4x4		transf;
+} FaceDesc;
+
+typedef struct PrimitiveDesc
+{
+	uint		source;		/**< vetor de vértices ou malha */
+	GLboolean	fit;		/**< se deve ser ajustada ao cubo [-0.5, 0.5] */
+	mat4x4		transf;
+	uint		firstFace;
+	uint		faceCount;
+} PrimitiveDesc;
+
+typedef struct Parser
+{
+	const char	*name;
+	uint		line;
+	char		*cursor, *end;
+	size_t		budget;
+	JobSystem	*jobs;		/**< importa as malhas. Pode ser NULL */
+	NamedArray	*arrays;
+	uint		arrayCount, arrayCapacity;
+	PrimitiveDesc	*prims;
+	uint		primCount, primCapacity;
+	FaceDesc	*faces;
+	uint		faceCount, faceCapacity;
+} Parser;
+
+static const struct
+{
+	const char	*name;
+	GLenum		mode;
+} faceModes[] = {
+	{ "triangles",	GL_TRIANGLES },
+	{ "strip",	GL_TRIANGLE_STRIP },
+	{ "fan",	GL_TRIANGLE_FAN },
+	{ "lines",	GL_LINES },
+};
+
+/**
+ * Garante espaço para mais um item em um vetor que cresce em dobro
+ */
+static void* grow(void *v, uint count, uint *capacity, size_t size)
+{
+	if ( count < *capacity )
+		return v;
+	*capacity = *capacity ? 2 * *capacity : 16;
+	return realloc(v, *capacity*size);
+}
+
+/**
+ * Próxima linha do texto, sem comentário e terminada em '\0'
+ *
+ * @return Linha, ou NULL no fim do texto
+ */
+static char* nextLine(Parser *ps)
+{
+	char *line = ps->cursor, *eol, *comment;
+
+	if ( ps->cursor >= ps->end )
+		return NULL;
+
+	eol = memchr(ps->cursor, '\n', ps->end - ps->cursor);
+	if ( NULL == eol )
+		eol = ps->end;
+	*eol = '\0';
+	ps->cursor = eol + 1;
+	++ps->line;
+
+	comment = strchr(line, '#');
+	if ( NULL != comment )
+		*comment = '\0';
+	return line;
+}
+
+static int parseError(const Parser *ps, const char *message, const char *token)
+{
+	printf("%s:%u: %s%s%s\n", ps->name, ps->line, message,
+	       NULL != token ? ": " : "", NULL != token ? token : "");
+	return -1;
+}
+
+/**
+ * Procura um vetor pelo nome. Elementos têm nomes próprios; vértices e
+ * malhas compartilham os nomes
+ */
+static int findArray(const Parser *ps, const char *name, GLboolean elements)
+{
+	uint i;
+
+	for (i = 0; i < ps->arrayCount; ++i)
+		if ( (ARRAY_ELEMENTS == ps->arrays[i].kind) == elements &&
+		     0 == strcmp(ps->arrays[i].name, name) )
+			return i;
+	return -1;
+}
+
+/**
+ * Registra um nome novo para um vetor ou malha
+ */
+static NamedArray* declareArray(Parser *ps, const char *name, int kind)
+{
+	NamedArray *a;
+
+	if ( NULL == name || '\0' == name[0] ) {
+		parseError(ps, "nome esperado", NULL);
+		return NULL;
+	}
+	if ( strlen(name) >= SCENEDESC_NAME_MAX || findArray(ps, name, ARRAY_ELEMENTS == kind) >= 0 ) {
+		parseError(ps, "nome inválido ou repetido", name);
+		return NULL;
+	}
+
+	ps->arrays = grow(ps->arrays, ps->arrayCount, &ps->arrayCapacity,
+			  sizeof(*ps->arrays));
+	a = &ps->arrays[ps->arrayCount++];
+	memset(a, 0, sizeof(*a));
+	strcpy(a->name, name);
+	a->kind = kind;
+	return a;
+}
+
+/**
+ * Lê um bloco de números até a linha "end"
+ *
+ * @param elements Se os números são elementos (GLuint) ou coordenadas (GLfloat)
+ */
+static int parseBlock(Parser *ps, SceneDescription *desc, NamedArray *a,
+		      GLboolean elements)
+{
+	uint capacity = 0;
+	void *data = NULL;
+	char *line;
+
+	while ( NULL != (line = nextLine(ps)) ) {
+		char *save, *token = strtok_r(line, " \t\r", &save);
+
+		if ( NULL != token && 0 == strcmp(token, "end") ) {
+			desc->arrays = realloc(desc->arrays,
+					       (desc->arrayCount + 1)*sizeof(*desc->arrays));
+			a->index = desc->arrayCount;
+			desc->arrays[desc->arrayCount++] = data;
+			return 0;
+		}
+
+		for (; NULL != token; token = strtok_r(NULL, " \t\r", &save)) {
+			char *stop;
+
+			data = grow(data, a->count, &capacity, sizeof(GLfloat));
+			if ( elements ) {
+				unsigned long v = strtoul(token, &stop, 10);
+				((GLuint *) data)[a->count] = v;
+			} else {
+				((GLfloat *) data)[a->count] = strtof(token, &stop);
+			}
+			if ( '\0' != *stop || stop == token ) {
+				free(data);
+				return parseError(ps, "número inválido", token);
+			}
+			++a->count;
+		}
+	}
+
+	free(data);
+	return parseError(ps, "bloco sem \"end\"", a->name);
+}
+
+/**
+ * Lê três ou quatro números de uma linha de transformação
+ */
+static int parseNumbers(Parser *ps, char **save, float *v, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		char *token = strtok_r(NULL, " \t\r", save), *stop;
+
+		if ( NULL == token )
+			return parseError(ps, "faltam valores", NULL);
+		v[i] = strtof(token, &stop);
+		if ( '\0' != *stop || stop == token )
+			return parseError(ps, "número inválido", token);
+	}
+	return 0;
+}
+
+/**
+ * Lê um bloco "primitive" até a linha "end"
+ *
+ * As transformações são aplicadas na ordem em que aparecem, cada uma no
+ * espaço local da anterior, como em mat4x4_translate_in_place. Antes da
+ * primeira face, valem para a primitiva; depois, para a última face.
+ */
+static int parsePrimitive(Parser *ps, char **save)
+{
+	char *token = strtok_r(NULL, " \t\r", save);
+	PrimitiveDesc *prim;
+	FaceDesc *face = NULL;
+	char *line;
+	int source;
+
+	if ( NULL == token || (source = findArray(ps, token, GL_FALSE)) < 0 )
+		return parseError(ps, "vértices ou malha desconhecidos", token);
+
+	ps->prims = grow(ps->prims, ps->primCount, &ps->primCapacity,
+			 sizeof(*ps->prims));
+	prim = &ps->prims[ps->primCount++];
+	memset(prim, 0, sizeof(*prim));
+	prim->source = source;
+	prim->firstFace = ps->faceCount;
+	mat4x4_identity(prim->transf);
+
+	token = strtok_r(NULL, " \t\r", save);
+	if ( NULL != token && 0 == strcmp(token, "fit") )
+		prim->fit = GL_TRUE;
+	else if ( NULL != token )
+		return parseError(ps, "opção desconhecida", token);
+
+	while ( NULL != (line = nextLine(ps)) ) {
+		mat4x4 *target = NULL != face ? &face->transf : &prim->transf;
+		mat4x4 matrix;
+		float v[4];
+		uint i;
+
+		token = strtok_r(line, " \t\r", save);
+		if ( NULL == token )
+			continue;
+
+		if ( 0 == strcmp(token, "end") ) {
+			return 0;
+		} else if ( 0 == strcmp(token, "scale") ) {
+			if ( parseNumbers(ps, save, v, 3) )
+				return -1;
+			mat4x4_scale_aniso(matrix, *target, v[0], v[1], v[2]);
+			mat4x4_dup(*target, matrix);
+		} else if ( 0 == strcmp(token, "translate") ) {
+			if ( parseNumbers(ps, save, v, 3) )
+				return -1;
+			mat4x4_translate_in_place(*target, v[0], v[1], v[2]);
+		} else if ( 0 == strcmp(token, "rotate") ) {
+			if ( parseNumbers(ps, save, v, 4) )
+				return -1;
+			mat4x4_rotate(matrix, *target, v[0], v[1], v[2],
+				      v[3]*(float) M_PI/180.f);
+			mat4x4_dup(*target, matrix);
+		} else if ( 0 == strcmp(token, "face") ) {
+			int array;
+
+			token = strtok_r(NULL, " \t\r", save);
+			if ( NULL == token || (array = findArray(ps, token, GL_TRUE)) < 0 )
+				return parseError(ps, "elementos desconhecidos", token);
+
+			ps->faces = grow(ps->faces, ps->faceCount, &ps->faceCapacity,
+					 sizeof(*ps->faces));
+			prim = &ps->prims[ps->primCount - 1];
+			face = &ps->faces[ps->faceCount++];
+			++prim->faceCount;
+			face->array = array;
+			face->mode = GL_TRIANGLES;
+			mat4x4_identity(face->transf);
+
+			token = strtok_r(NULL, " \t\r", save);
+			if ( NULL == token )
+				continue;
+			for (i = 0; i < sizeof(faceModes)/sizeof(*faceModes); ++i)
+				if ( 0 == strcmp(token, faceModes[i].name) )
+					break;
+			if ( i == sizeof(faceModes)/sizeof(*faceModes) )
+				return parseError(ps, "modo desconhecido", token);
+			face->mode = faceModes[i].mode;
+		} else {
+			return parseError(ps, "comando desconhecido", token);
+		}
+	}
+
+	return parseError(ps, "primitiva sem \"end\"", NULL);
+}
+
+/**
+ * Interpreta a descrição inteira, sem criar as primitivas
+ */
+static int parseScene(Parser *ps, SceneDescription *desc)
+{
+	char *line;
+
+	while ( NULL != (line = nextLine(ps)) ) {
+		char *save, *token = strtok_r(line, " \t\r", &save);
+		NamedArray *a;
+
+		if ( NULL == token )
+			continue;
+
+		if ( 0 == strcmp(token, "shader") ) {
+			char *vertex = strtok_r(NULL, " \t\r", &save);
+			char *fragment = strtok_r(NULL, " \t\r", &save);
+
+			if ( NULL == vertex || NULL == fragment ||
+			     strlen(vertex) >= SCENE_NAME_MAX ||
+			     strlen(fragment) >= SCENE_NAME_MAX )
+				return parseError(ps, "shader vertex e fragment esperados", NULL);
+			strcpy(desc->vertex, vertex);
+			strcpy(desc->fragment, fragment);
+		} else if ( 0 == strcmp(token, "vertices") ||
+			    0 == strcmp(token, "elements") ) {
+			GLboolean elements = 'e' == token[0];
+
+			a = declareArray(ps, strtok_r(NULL, " \t\r", &save),
+					 elements ? ARRAY_ELEMENTS : ARRAY_VERTICES);
+			if ( NULL == a || parseBlock(ps, desc, a, elements) )
+				return -1;
+			if ( !elements && 0 != a->count % 3 )
+				return parseError(ps, "vértices devem ter 3 coordenadas", a->name);
+		} else if ( 0 == strcmp(token, "mesh") ) {
+			char *file;
+
+			a = declareArray(ps, strtok_r(NULL, " \t\r", &save), ARRAY_MESH);
+			if ( NULL == a )
+				return -1;
+			file = strtok_r(NULL, " \t\r", &save);
+			if ( NULL == file )
+				return parseError(ps, "arquivo da malha esperado", a->name);
+
+			desc->meshes = realloc(desc->meshes,
+					       (desc->meshCount + 1)*sizeof(*desc->meshes));
+			a->index = desc->meshCount;
+			if ( importMesh(file, ps->budget, ps->jobs,
+					&desc->meshes[desc->meshCount]) )
+				return parseError(ps, "malha não importada", file);
+			a->count = 3*desc->meshes[desc->meshCount++].vertexCount;
+		} else if ( 0 == strcmp(token, "primitive") ) {
+			if ( parsePrimitive(ps, &save) )
+				return -1;
+		} else {
+			return parseError(ps, "comando desconhecido", token);
+		}
+	}
+
+	if ( 0 == ps->primCount )
+		return parseError(ps, "nenhuma primitiva definida", NULL);
+	return 0;
+}
+
+/**
+ * Cria as primitivas descritas, verificando os elementos de cada face
+ */
+static int buildScene(Parser *ps, SceneDescription *desc)
+{
+	uint i, j, k;
+
+	desc->count = ps->primCount;
+	desc->primitives = createPrimitive(desc->count);
+
+	for (i = 0; i < desc->count; ++i) {
+		PrimitiveDesc *pd = &ps->prims[i];
+		const NamedArray *src = &ps->arrays[pd->source];
+		const GLfloat *points;
+		uint vertexCount = src->count / 3;
+		mat4x4 matrix;
+
+		if ( ARRAY_MESH == src->kind && 0 == pd->faceCount ) {
+			loadPrimitiveFromMesh(desc->primitives, i, desc->count,
+					      &desc->meshes[src->index]);
+			points = desc->meshes[src->index].vertices;
+		} else {
+			points = ARRAY_MESH == src->kind ? desc->meshes[src->index].vertices
+							 : desc->arrays[src->index];
+			setPrimitiveBuffer(desc->primitives, i, desc->count, points,
+					   (GLsizeiptr) src->count*sizeof(GLfloat));
+		}
+
+		mat4x4_dup(matrix, pd->transf);
+		if ( pd->fit ) {
+			mat4x4 box, fit, half, tmp;
+
+			computeQuantization(points, 3, vertexCount, box);
+			mat4x4_invert(fit, box);
+			mat4x4_identity(half);
+			mat4x4_scale_aniso(half, half, .5f, .5f, .5f);
+			mat4x4_mul(tmp, half, fit);
+			mat4x4_mul(matrix, pd->transf, tmp);
+		}
+		setPrimitiveTransformation(desc->primitives, i, desc->count, matrix);
+
+		if ( 0 == pd->faceCount )
+			continue;
+		initPrimitiveFaceArray(desc->primitives, i, desc->count, pd->faceCount);
+		for (j = 0; j < pd->faceCount; ++j) {
+			const FaceDesc *fd = &ps->faces[pd->firstFace + j];
+			const NamedArray *elem = &ps->arrays[fd->array];
+			const GLuint *face = desc->arrays[elem->index];
+			Faces *f = getPrimitiveFaceElement(desc->primitives, i,
+							   desc->count, j);
+
+			for (k = 0; k < elem->count; ++k)
+				if ( face[k] >= vertexCount ) {
+					printf("%s: elemento %u de %s fora de %s\n",
+					       ps->name, face[k], elem->name, src->name);
+					return -1;
+				}
+
+			initFace(f);
+			setFace(f, face, elem->count);
+			f->mode = fd->mode;
+			setFaceTransformation(f, (vec4 *) fd->transf);
+		}
+	}
+	return 0;
+}
+
+/**
+ * Identifica o conteúdo de uma descrição
+ *
+ * Usa o FNV-1a de 64 bits do texto. Malhas referenciadas entram pelo
+ * tamanho e pela data de modificação, sem serem lidas.
+ */
+static uint64_t sceneKey(const char *text, size_t size)
+{
+	const char *line = text, *end = text + size;
+	uint64_t key = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < size; ++i) {
+		key ^= (unsigned char) text[i];
+		key *= 1099511628211ull;
+	}
+
+	while ( line < end ) {
+		const char *eol = memchr(line, '\n', end - line);
+		char buffer[2*SCENE_NAME_MAX], name[SCENE_NAME_MAX], file[SCENE_NAME_MAX];
+		struct stat st;
+		size_t len;
+
+		if ( NULL == eol )
+			eol = end;
+		len = eol - line < sizeof(buffer) - 1 ? eol - line : sizeof(buffer) - 1;
+		memcpy(buffer, line, len);
+		buffer[len] = '\0';
+		line = eol + 1;
+
+		if ( 2 == sscanf(buffer, " mesh %255s %255s", name, file) &&
+		     0 == stat(file, &st) ) {
+			key ^= (uint64_t) st.st_size;
+			key *= 1099511628211ull;
+			key ^= (uint64_t) st.st_mtime;
+			key *= 1099511628211ull;
+		}
+	}
+	return 0 != key ? key : 1;
+}
+
+/**
+ * Carrega uma cena a partir de uma descrição textual
+ *
+ * A descrição é formada por comandos, um por linha. Tudo após '#' é ignorado.
+ *
+ * - shader <vertex> <fragment>: shaders usados na cena
+ * - vertices <nome>: coordenadas x y z dos vértices, até uma linha "end"
+ * - elements <nome>: elementos das faces, até uma linha "end"
+ * - mesh <nome> <arquivo>: malha OBJ ou PLY, importada com importMesh
+ * - primitive <vértices ou malha> [fit]: primitiva, até uma linha "end".
+ *   Aceita "scale x y z", "translate x y z", "rotate x y z graus" e
+ *   "face <elementos> [triangles|strip|fan|lines]". Uma malha sem faces
+ *   explícitas ganha uma face por grupo. Com fit, a primitiva é antes ajustada
+ *   ao cubo [-0.5, 0.5].
+ *
+ * Na primeira carga, a cena é gravada em um cache binário, <nome>.scn, junto
+ * com a identificação do conteúdo da descrição. Enquanto a descrição e as
+ * malhas não mudarem, as cargas seguintes usam o cache, sem interpretar o
+ * texto nem importar as malhas. Os nomes de arquivo são relativos ao
+ * diretório atual.
+ *
+ * @param name Nome da descrição
+ * @param budget Memória máxima para cada malha importada
+ * @param compress Se o cache deve ser gravado com os vetores codificados
+ * @param jobs Sistema de trabalhos usado na importação das malhas. Pode ser
+ *             NULL
+ * @param desc Recebe a cena. Deve ser liberada com releaseSceneDescription,
+ *             depois de destroyPrimitive
+ * @return 0 em caso de sucesso
+ */
+int loadSceneDescription(const char *name, size_t budget, GLboolean compress,
+			 JobSystem *jobs, SceneDescription *desc)
+{
+	char cacheName[SCENE_NAME_MAX + sizeof(SCENE_EXTENSION)];
+	Parser ps;
+	SceneInfo info;
+	FILE *fp;
+	char *text;
+	long size;
+	int result = -1;
+
+	assert(NULL != name);
+	assert(NULL != desc);
+
+	memset(desc, 0, sizeof(*desc));
+
+	fp = fopen(name, "rb");
+	if ( NULL == fp || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 ) {
+		printf("Incapaz de abrir ou ler o arquivo %s\n", name);
+		if ( NULL != fp )
+			fclose(fp);
+		return -1;
+	}
+	rewind(fp);
+	text = malloc(size + 1);
+	if ( size != fread(text, 1, size, fp) ) {
+		printf("Incapaz de abrir ou ler o arquivo %s\n", name);
+		fclose(fp);
+		free(text);
+		return -1;
+	}
+	fclose(fp);
+	text[size] = '\0';
+
+	memset(&info, 0, sizeof(info));
+	info.key = sceneKey(text, size);
+	snprintf(cacheName, sizeof(cacheName), "%s" SCENE_EXTENSION, name);
+
+	// Cache válido: nada a interpretar
+	if ( 0 == access(cacheName, R_OK) ) {
+		desc->primitives = loadScene(cacheName, &desc->cache, &desc->count);
+		if ( NULL != desc->primitives && info.key == desc->cache.info.key ) {
+			strcpy(desc->vertex, desc->cache.info.vertex);
+			strcpy(desc->fragment, desc->cache.info.fragment);
+			printf("Cena lida do cache %s\n", cacheName);
+			free(text);
+			return 0;
+		}
+		if ( NULL != desc->primitives )
+			destroyPrimitive(desc->primitives, desc->count);
+		closeScene(&desc->cache);
+		desc->primitives = NULL;
+		desc->count = 0;
+	}
+
+	memset(&ps, 0, sizeof(ps));
+	ps.name = name;
+	ps.cursor = text;
+	ps.end = text + size;
+	ps.budget = budget;
+	ps.jobs = jobs;
+
+	if ( parseScene(&ps, desc) || buildScene(&ps, desc) ) {
+		if ( NULL != desc->primitives )
+			destroyPrimitive(desc->primitives, desc->count);
+		releaseSceneDescription(desc);
+		goto cleanup;
+	}
+
+	strcpy(info.vertex, desc->vertex);
+	strcpy(info.fragment, desc->fragment);
+	saveScene(cacheName, desc->primitives, desc->count, compress, &info);
+	result = 0;
+
+cleanup:
+	free(ps.faces);
+	free(ps.prims);
+	free(ps.arrays);
+	free(text);
+	return result;
+}
+
+/**
+ * Libera os vetores, malhas e cache de uma cena
+ *
+ * As primitivas não são liberadas: use destroyPrimitive antes.
+ */
+void releaseSceneDescription(SceneDescription *desc)
+{
+	uint i;
+
+	assert(NULL != desc);
+
+	for (i = 0; i < desc->arrayCount; ++i)
+		free(desc->arrays[i]);
+	for (i = 0; i < desc->meshCount; ++i)
+		releaseMesh(&desc->meshes[i]);
+	free(desc->arrays);
+	free(desc->meshes);
+	closeScene(&desc->cache);
+	memset(desc, 0, sizeof(*desc));
+}
+
+/**
+ * Verifica, pela extensão, se o nome é de uma descrição textual de cena
+ */
+GLboolean isSceneDescription(const char *name)
+{
+	const char *ext;
+
+	assert(NULL != name);
+
+	ext = strrchr(name, '.');
+	return NULL != ext && 0 == strcasecmp(ext, SCENEDESC_EXTENSION);
+}
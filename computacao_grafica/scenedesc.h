@@ -0,0 +1,47 @@
+#ifndef __SCENEDESC_H
+#define __SCENEDESC_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+# include "primitive.h"
+# include "importer.h"
+# include "scenefile.h"
+# include "jobs.h"
+
+/**
+ * Extensão usada para as descrições textuais de cena
+ */
+#define SCENEDESC_EXTENSION	".scene"
+/**
+ * Tamanho máximo dos nomes dados aos vetores na descrição
+ */
+#define SCENEDESC_NAME_MAX	64
+
+/**
+ * @brief Cena carregada de uma descrição textual
+ *
+ * As primitivas apontam para os vetores e malhas mantidos aqui ou para o
+ * arquivo de cache. Tudo deve continuar válido enquanto elas forem usadas.
+ */
+typedef struct SceneDescription
+{
+	Primitive	*primitives;	/**< primitivas da cena */
+	uint		count;		/**< quantidade de primitivas */
+	char		vertex[SCENE_NAME_MAX];		/**< shader vertex */
+	char		fragment[SCENE_NAME_MAX];	/**< shader fragment */
+	void		**arrays;	/**< vetores lidos do texto */
+	uint		arrayCount;	/**< quantidade de vetores */
+	MeshData	*meshes;	/**< malhas importadas */
+	uint		meshCount;	/**< quantidade de malhas */
+	SceneFile	cache;		/**< cache binário, se a cena veio dele */
+} SceneDescription;
+
+int loadSceneDescription(const char *name, size_t budget, GLboolean compress,
+			 JobSystem *jobs, SceneDescription *desc);
+
+void releaseSceneDescription(SceneDescription *desc);
+
+GLboolean isSceneDescription(const char *name);
+
+#endif
@@ -0,0 +1,705 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "primitive.h"
+#include "scenefile.h"
+#include "codec.h"
+#include "platform.h"
+
+#define SCENE_BYTE_ORDER	0x01020304u
+
+/**
+ * Como um vetor está guardado no arquivo
+ */
+enum { SCENE_RAW = 0, SCENE_DELTA_VARINT };
+
+/**
+ * Cabeçalho do arquivo. Todos os deslocamentos são contados a partir do
+ * início do arquivo, em bytes, na ordem de bytes da máquina que o gravou
+ */
+typedef struct SceneHeader
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byteOrder;	/**< SCENE_BYTE_ORDER, para detectar a troca de bytes */
+	uint32_t	primitiveCount;
+	uint32_t	faceCount;
+	uint64_t	primitiveTable;	/**< início do vetor de ScenePrimitive */
+	uint64_t	faceTable;	/**< início do vetor de SceneFace */
+	uint64_t	size;		/**< tamanho total do arquivo */
+	uint64_t	key;		/**< SceneInfo.key */
+	char		vertex[SCENE_NAME_MAX];
+	char		fragment[SCENE_NAME_MAX];
+} SceneHeader;
+
+typedef struct SceneAttrib
+{
+	int32_t		size;
+	uint32_t	type;
+	uint32_t	normalized;
+	uint32_t	offset;
+} SceneAttrib;
+
+typedef struct ScenePrimitive
+{
+	uint64_t	vertexOffset;	/**< início dos vértices */
+	uint64_t	vertexSize;	/**< tamanho dos vértices, em bytes */
+	uint64_t	encodedSize;	/**< tamanho dos vértices no arquivo */
+	uint32_t	firstFace;	/**< primeira face no vetor de SceneFace */
+	uint32_t	faceCount;
+	uint32_t	stride;
+	uint32_t	encoding;	/**< SCENE_RAW ou SCENE_DELTA_VARINT */
+	SceneAttrib	attrib[ATTRIB_COUNT];
+	float		transf[16];
+} ScenePrimitive;
+
+typedef struct SceneFace
+{
+	uint64_t	elementOffset;	/**< início dos elementos */
+	uint64_t	encodedSize;	/**< tamanho dos elementos no arquivo */
+	uint32_t	count;		/**< quantidade de elementos */
+	uint32_t	mode;
+	uint32_t	encoding;	/**< SCENE_RAW ou SCENE_DELTA_VARINT */
+	uint32_t	reserved;
+	float		transf[16];
+} SceneFace;
+
+/**
+ * Vetor a ser gravado no arquivo. Vetores compartilhados são gravados uma vez
+ */
+typedef struct SceneBlob
+{
+	const void	*data;
+	uint64_t	size;
+	uint32_t	encoding;	/**< codificação desejada */
+	uint32_t	stride;		/**< distância entre vértices, em bytes. 0 para elementos */
+	unsigned char	*encoded;	/**< dados codificados. NULL se gravado sem codificação */
+	uint64_t	encodedSize;	/**< tamanho gravado no arquivo */
+	uint64_t	offset;
+} SceneBlob;
+
+/**
+ * Vetor já decodificado na carga, para não decodificar duas vezes
+ */
+typedef struct SceneDecoded
+{
+	uint64_t	offset;
+	const void	*data;
+} SceneDecoded;
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + SCENE_ALIGN - 1) & ~(uint64_t) (SCENE_ALIGN - 1);
+}
+
+/**
+ * Registra um vetor a ser gravado, reaproveitando um idêntico já registrado
+ *
+ * @return Índice do vetor, ou -1 se o vetor é vazio
+ */
+static int addBlob(SceneBlob *blobs, uint *blobCount, const void *data,
+		   uint64_t size, uint32_t encoding, uint32_t stride)
+{
+	uint i;
+
+	if ( NULL == data || 0 == size )
+		return -1;
+
+	for (i = 0; i < *blobCount; ++i)
+		if ( blobs[i].data == data && blobs[i].size == size &&
+		     blobs[i].encoding == encoding && blobs[i].stride == stride )
+			return i;
+
+	memset(&blobs[*blobCount], 0, sizeof(*blobs));
+	blobs[*blobCount].data = data;
+	blobs[*blobCount].size = size;
+	blobs[*blobCount].encoding = encoding;
+	blobs[*blobCount].stride = stride;
+	return (*blobCount)++;
+}
+
+/**
+ * Codifica um vetor, se pedido, e decide onde ele fica no arquivo
+ *
+ * A codificação só é mantida se reduzir o tamanho do vetor.
+ */
+static void placeBlob(SceneBlob *blob, uint64_t *end)
+{
+	size_t size = 0;
+
+	if ( SCENE_DELTA_VARINT == blob->encoding && 0 == blob->stride ) {
+		uint count = blob->size / sizeof(GLuint);
+		blob->encoded = malloc(encodeIndicesBound(count));
+		size = encodeIndices(blob->data, count, blob->encoded);
+	} else if ( SCENE_DELTA_VARINT == blob->encoding ) {
+		uint count = blob->size / blob->stride;
+		blob->encoded = malloc(encodeVerticesBound(count));
+		size = encodeVertices(blob->data, blob->stride / sizeof(GLfloat),
+				      count, blob->encoded);
+	}
+
+	if ( NULL != blob->encoded && size >= blob->size ) {
+		free(blob->encoded);
+		blob->encoded = NULL;
+	}
+	if ( NULL == blob->encoded )
+		blob->encoding = SCENE_RAW;
+	blob->encodedSize = NULL != blob->encoded ? size : blob->size;
+
+	blob->offset = alignOffset(*end);
+	*end = blob->offset + blob->encodedSize;
+}
+
+/**
+ * Verifica se os vértices podem ser codificados por encodeVertices, que
+ * guarda somente as posições
+ */
+static GLboolean encodableFormat(const VertexFormat *fmt)
+{
+	int k;
+
+	if ( 3 != fmt->attrib[ATTRIB_POSITION].size ||
+	     GL_FLOAT != fmt->attrib[ATTRIB_POSITION].type ||
+	     0 != fmt->attrib[ATTRIB_POSITION].offset ||
+	     0 != fmt->stride % sizeof(GLfloat) )
+		return GL_FALSE;
+	for (k = 0; k < ATTRIB_COUNT; ++k)
+		if ( ATTRIB_POSITION != k && 0 != fmt->attrib[k].size )
+			return GL_FALSE;
+	return GL_TRUE;
+}
+
+static int writePadding(FILE *fp, uint64_t from, uint64_t to)
+{
+	static const char zero[SCENE_ALIGN];
+
+	assert(to >= from && to - from < SCENE_ALIGN);
+	return to == from || 1 == fwrite(zero, to - from, 1, fp) ? 0 : -1;
+}
+
+/**
+ * Verifica se o intervalo [offset, offset + size) está dentro do arquivo
+ */
+static int inside(const SceneFile *file, uint64_t offset, uint64_t size)
+{
+	return offset <= file->size && size <= file->size - offset;
+}
+
+/**
+ * Grava as primitivas em um arquivo binário de cena
+ *
+ * O arquivo guarda, para cada primitiva, o formato dos vértices, a matriz de
+ * transformação e as faces, com os respectivos modos e matrizes. Os vetores
+ * de vértices e de elementos ficam alinhados em SCENE_ALIGN bytes, prontos
+ * para serem usados diretamente do mapeamento por loadScene. Meshlets, níveis
+ * de detalhe e quantização não são gravados: são recalculados após a carga.
+ * Por isso, as primitivas devem ser gravadas antes de optimizePrimitiveStrips.
+ *
+ * Com compress, elementos e posições são gravados com a codificação de
+ * codec.h, ao custo de uma decodificação na carga. As posições passam a ter
+ * a precisão de SNORM16. Vértices com outros atributos e vetores que não
+ * diminuem continuam sem codificação.
+ *
+ * @param name Nome do arquivo a ser criado
+ * @param p Array de primitivas
+ * @param count Quantidade de elementos do array
+ * @param compress GL_TRUE para codificar os vetores
+ * @param info Informações gravadas junto com a cena. Pode ser NULL
+ * @return 0 em caso de sucesso
+ */
+int saveScene(const char *name, const Primitive *p, uint count,
+	      GLboolean compress, const SceneInfo *info)
+{
+	SceneHeader header;
+	ScenePrimitive *prims;
+	SceneFace *faces;
+	SceneBlob *blobs;
+	int *primBlob, *faceBlob;
+	uint32_t encoding = compress ? SCENE_DELTA_VARINT : SCENE_RAW;
+	uint faceCount = 0, blobCount = 0;
+	uint64_t end, written, raw = 0;
+	uint i, j, k;
+	FILE *fp;
+	int result = -1;
+
+	assert(NULL != name);
+	assert(NULL != p || 0 == count);
+
+	for (i = 0; i < count; ++i)
+		faceCount += p[i].faceCount;
+
+	prims = calloc(count + 1, sizeof(*prims));
+	faces = calloc(faceCount + 1, sizeof(*faces));
+	blobs = calloc(count + faceCount + 1, sizeof(*blobs));
+	primBlob = malloc((count + 1)*sizeof(*primBlob));
+	faceBlob = malloc((faceCount + 1)*sizeof(*faceBlob));
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+	header.version = SCENE_VERSION;
+	header.byteOrder = SCENE_BYTE_ORDER;
+	header.primitiveCount = count;
+	header.faceCount = faceCount;
+	if ( NULL != info ) {
+		header.key = info->key;
+		// O cabeçalho zerado termina os nomes
+		memcpy(header.vertex, info->vertex,
+		       strnlen(info->vertex, SCENE_NAME_MAX - 1));
+		memcpy(header.fragment, info->fragment,
+		       strnlen(info->fragment, SCENE_NAME_MAX - 1));
+	}
+	header.primitiveTable = alignOffset(sizeof(header));
+	header.faceTable = alignOffset(header.primitiveTable + count*sizeof(*prims));
+	end = header.faceTable + faceCount*sizeof(*faces);
+
+	// Monta as tabelas e registra cada vetor
+	for (i = 0, faceCount = 0; i < count; ++i) {
+		ScenePrimitive *sp = &prims[i];
+		GLboolean encodable = encodableFormat(&p[i].format);
+
+		sp->vertexSize = p[i].pSize;
+		primBlob[i] = addBlob(blobs, &blobCount, p[i].points, p[i].pSize,
+				      encodable ? encoding : SCENE_RAW,
+				      p[i].format.stride);
+		sp->firstFace = faceCount;
+		sp->faceCount = p[i].faceCount;
+		sp->stride = p[i].format.stride;
+		for (k = 0; k < ATTRIB_COUNT; ++k) {
+			sp->attrib[k].size = p[i].format.attrib[k].size;
+			sp->attrib[k].type = p[i].format.attrib[k].type;
+			sp->attrib[k].normalized = p[i].format.attrib[k].normalized;
+			sp->attrib[k].offset = p[i].format.attrib[k].offset;
+		}
+		memcpy(sp->transf, p[i].transf, sizeof(sp->transf));
+
+		for (j = 0; j < p[i].faceCount; ++j, ++faceCount) {
+			const Faces *f = &p[i].faceArray[j];
+			SceneFace *sf = &faces[faceCount];
+
+			sf->count = f->count;
+			sf->mode = f->mode;
+			faceBlob[faceCount] = addBlob(blobs, &blobCount, f->face,
+						      (uint64_t) f->count*sizeof(GLuint),
+						      encoding, 0);
+			memcpy(sf->transf, f->transf, sizeof(sf->transf));
+		}
+	}
+
+	// Codifica e posiciona os vetores, em ordem crescente
+	for (i = 0; i < blobCount; ++i) {
+		placeBlob(&blobs[i], &end);
+		raw += blobs[i].size;
+	}
+	for (i = 0; i < count; ++i)
+		if ( primBlob[i] >= 0 ) {
+			const SceneBlob *blob = &blobs[primBlob[i]];
+			prims[i].vertexOffset = blob->offset;
+			prims[i].encodedSize = blob->encodedSize;
+			prims[i].encoding = blob->encoding;
+		}
+	for (i = 0; i < faceCount; ++i)
+		if ( faceBlob[i] >= 0 ) {
+			const SceneBlob *blob = &blobs[faceBlob[i]];
+			faces[i].elementOffset = blob->offset;
+			faces[i].encodedSize = blob->encodedSize;
+			faces[i].encoding = blob->encoding;
+		}
+	header.size = end;
+
+	fp = fopen(name, "wb");
+	if ( NULL == fp ) {
+		printf("Incapaz de criar o arquivo %s\n", name);
+		goto cleanup;
+	}
+
+	written = 0;
+	if ( 1 != fwrite(&header, sizeof(header), 1, fp) )
+		goto error;
+	written += sizeof(header);
+
+	if ( writePadding(fp, written, header.primitiveTable) ||
+	     count != fwrite(prims, sizeof(*prims), count, fp) )
+		goto error;
+	written = header.primitiveTable + count*sizeof(*prims);
+
+	if ( writePadding(fp, written, header.faceTable) ||
+	     faceCount != fwrite(faces, sizeof(*faces), faceCount, fp) )
+		goto error;
+	written = header.faceTable + faceCount*sizeof(*faces);
+
+	for (i = 0; i < blobCount; ++i) {
+		const void *data = NULL != blobs[i].encoded ? blobs[i].encoded
+							    : blobs[i].data;
+		if ( writePadding(fp, written, blobs[i].offset) ||
+		     1 != fwrite(data, blobs[i].encodedSize, 1, fp) )
+			goto error;
+		written = blobs[i].offset + blobs[i].encodedSize;
+	}
+
+	if ( 0 == fclose(fp) ) {
+		printf("Cena gravada em %s (%.1f MB, vetores com %.1f MB)\n", name,
+		       header.size / (1024.*1024.), raw / (1024.*1024.));
+		result = 0;
+	} else {
+		printf("Erro ao gravar o arquivo %s\n", name);
+		unlink(name);
+	}
+	goto cleanup;
+
+error:
+	printf("Erro ao gravar o arquivo %s\n", name);
+	fclose(fp);
+	unlink(name);
+
+cleanup:
+	for (i = 0; i < blobCount; ++i)
+		free(blobs[i].encoded);
+	free(faceBlob);
+	free(primBlob);
+	free(blobs);
+	free(faces);
+	free(prims);
+	return result;
+}
+
+/**
+ * Verifica o formato dos vértices de uma primitiva lida do arquivo
+ *
+ * Cada atributo presente deve ter um tipo conhecido e caber no vértice, e a
+ * posição, sempre presente, deve ser GL_FLOAT.
+ */
+static GLboolean validFormat(const ScenePrimitive *sp)
+{
+	uint k;
+
+	if ( 0 == sp->stride || 0 != sp->vertexSize % sp->stride ||
+	     sp->attrib[ATTRIB_POSITION].size < 3 ||
+	     GL_FLOAT != sp->attrib[ATTRIB_POSITION].type )
+		return GL_FALSE;
+	for (k = 0; k < ATTRIB_COUNT; ++k) {
+		const SceneAttrib *a = &sp->attrib[k];
+
+		if ( 0 == a->size )
+			continue;
+		if ( a->size < 0 || a->size > 4 || 0 == vertexTypeSize(a->type) ||
+		     a->offset > sp->stride ||
+		     (uint64_t) a->size*vertexTypeSize(a->type) > sp->stride - a->offset )
+			return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+/**
+ * Verifica se o modo de uma face é um dos gravados por saveScene
+ */
+static GLboolean validMode(uint32_t mode)
+{
+	switch (mode) {
+	case GL_TRIANGLES:
+	case GL_TRIANGLE_STRIP:
+	case GL_TRIANGLE_FAN:
+	case GL_LINES:
+		return GL_TRUE;
+	}
+	return GL_FALSE;
+}
+
+/**
+ * Verifica se todos os elementos apontam para vértices existentes
+ *
+ * @param vertexCount Quantidade de vértices da primitiva
+ */
+static GLboolean validElements(const GLuint *elements, uint count,
+			       uint64_t vertexCount)
+{
+	uint i;
+
+	for (i = 0; i < count; ++i)
+		if ( elements[i] >= vertexCount )
+			return GL_FALSE;
+	return GL_TRUE;
+}
+
+/**
+ * Obtém um vetor decodificado, decodificando-o se for a primeira referência
+ *
+ * @param decoded Vetores já decodificados
+ * @param decodedCount Quantidade de vetores em decoded
+ * @param next Próxima posição livre na área de decodificação
+ * @return Vetor decodificado, ou NULL se os dados forem inválidos
+ */
+static const void* decodeBlob(const SceneFile *file, SceneDecoded *decoded,
+			      uint *decodedCount, char **next, uint64_t offset,
+			      uint64_t encodedSize, uint64_t size, uint stride)
+{
+	const unsigned char *in = (const unsigned char *) file->data + offset;
+	void *out = *next;
+	uint i;
+	int error;
+
+	for (i = 0; i < *decodedCount; ++i)
+		if ( decoded[i].offset == offset )
+			return decoded[i].data;
+
+	if ( 0 == stride )
+		error = decodeIndices(in, encodedSize, out, size / sizeof(GLuint));
+	else
+		error = decodeVertices(in, encodedSize, out, stride / sizeof(GLfloat),
+				       size / stride);
+	if ( error )
+		return NULL;
+
+	decoded[*decodedCount].offset = offset;
+	decoded[(*decodedCount)++].data = out;
+	*next += size;
+	return out;
+}
+
+/**
+ * Carrega as primitivas de um arquivo binário de cena
+ *
+ * O arquivo é mapeado na memória e os vetores gravados sem codificação não
+ * são copiados nem interpretados: as primitivas e faces apontam diretamente
+ * para o mapeamento. As tabelas são validadas, e os elementos são conferidos
+ * contra a quantidade de vértices, de modo que o custo da carga é
+ * essencialmente o das faltas de página no primeiro acesso. Vetores
+ * codificados são decodificados uma única vez, em uma área mantida junto com
+ * o mapeamento, e os seus elementos são conferidos depois da decodificação.
+ *
+ * @param name Nome do arquivo
+ * @param file Recebe o mapeamento. Deve ser fechado com closeScene, depois de
+ *             destroyPrimitive
+ * @param count Recebe a quantidade de primitivas
+ * @return Array de primitivas, ou NULL em caso de erro
+ */
+Primitive* loadScene(const char *name, SceneFile *file, uint *count)
+{
+	const SceneHeader *header;
+	const ScenePrimitive *prims;
+	const SceneFace *faces;
+	Primitive *p = NULL;
+	SceneDecoded *decoded = NULL;
+	uint decodedCount = 0;
+	uint64_t decodedSize = 0;
+	char *next;
+	struct stat st;
+	double start;
+	uint i, j, k;
+	int fd;
+
+	assert(NULL != name);
+	assert(NULL != file);
+	assert(NULL != count);
+
+	memset(file, 0, sizeof(*file));
+	*count = 0;
+
+	fd = open(name, O_RDONLY);
+	if ( fd < 0 || fstat(fd, &st) < 0 || st.st_size < sizeof(*header) ) {
+		printf("Incapaz de abrir ou ler o arquivo %s\n", name);
+		if ( fd >= 0 )
+			close(fd);
+		return NULL;
+	}
+	file->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( MAP_FAILED == file->data ) {
+		printf("Incapaz de mapear o arquivo %s\n", name);
+		file->data = NULL;
+		return NULL;
+	}
+	file->size = st.st_size;
+
+	header = file->data;
+	if ( 0 != memcmp(header->magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) ||
+	     SCENE_VERSION != header->version ||
+	     SCENE_BYTE_ORDER != header->byteOrder ) {
+		printf("%s não é um arquivo de cena compatível\n", name);
+		goto error;
+	}
+	if ( header->size != file->size || 0 == header->primitiveCount ||
+	     !inside(file, header->primitiveTable,
+		     (uint64_t) header->primitiveCount*sizeof(*prims)) ||
+	     !inside(file, header->faceTable,
+		     (uint64_t) header->faceCount*sizeof(*faces)) ||
+	     0 != header->primitiveTable % sizeof(uint64_t) ||
+	     0 != header->faceTable % sizeof(uint64_t) )
+		goto corrupt;
+
+	file->info.key = header->key;
+	memcpy(file->info.vertex, header->vertex, SCENE_NAME_MAX);
+	memcpy(file->info.fragment, header->fragment, SCENE_NAME_MAX);
+	file->info.vertex[SCENE_NAME_MAX - 1] = '\0';
+	file->info.fragment[SCENE_NAME_MAX - 1] = '\0';
+
+	prims = (const ScenePrimitive *) ((const char *) file->data + header->primitiveTable);
+	faces = (const SceneFace *) ((const char *) file->data + header->faceTable);
+
+	// Valida as tabelas antes de criar qualquer primitiva
+	for (i = 0; i < header->primitiveCount; ++i) {
+		const ScenePrimitive *sp = &prims[i];
+
+		if ( !inside(file, sp->vertexOffset, sp->encodedSize) ||
+		     !validFormat(sp) || sp->firstFace > header->faceCount ||
+		     sp->faceCount > header->faceCount - sp->firstFace )
+			goto corrupt;
+		if ( SCENE_RAW == sp->encoding ) {
+			if ( sp->encodedSize != sp->vertexSize ||
+			     0 != sp->vertexOffset % sizeof(GLfloat) )
+				goto corrupt;
+		} else if ( SCENE_DELTA_VARINT == sp->encoding ) {
+			if ( 0 != sp->stride % sizeof(GLfloat) )
+				goto corrupt;
+			decodedSize += sp->vertexSize;
+		} else {
+			goto corrupt;
+		}
+
+		for (j = 0; j < sp->faceCount; ++j) {
+			const SceneFace *sf = &faces[sp->firstFace + j];
+
+			if ( !inside(file, sf->elementOffset, sf->encodedSize) ||
+			     !validMode(sf->mode) )
+				goto corrupt;
+			if ( SCENE_RAW == sf->encoding ) {
+				if ( sf->encodedSize != (uint64_t) sf->count*sizeof(GLuint) ||
+				     0 != sf->elementOffset % sizeof(GLuint) ||
+				     !validElements((const GLuint *) ((const char *) file->data +
+								      sf->elementOffset),
+						    sf->count, sp->vertexSize / sp->stride) )
+					goto corrupt;
+			} else if ( SCENE_DELTA_VARINT == sf->encoding ) {
+				decodedSize += (uint64_t) sf->count*sizeof(GLuint);
+			} else {
+				goto corrupt;
+			}
+		}
+	}
+
+	if ( decodedSize > 0 ) {
+		file->decoded = malloc(decodedSize);
+		decoded = malloc((header->primitiveCount + header->faceCount)*sizeof(*decoded));
+		if ( NULL == file->decoded || NULL == decoded ) {
+			printf("Memória insuficiente para decodificar %s\n", name);
+			goto error;
+		}
+	}
+	next = file->decoded;
+	start = monotonicClock();
+
+	*count = header->primitiveCount;
+	p = createPrimitive(*count);
+
+	for (i = 0; i < *count; ++i) {
+		const ScenePrimitive *sp = &prims[i];
+		const void *points = (const char *) file->data + sp->vertexOffset;
+		VertexFormat fmt;
+		mat4x4 matrix;
+
+		if ( SCENE_RAW != sp->encoding && 0 != sp->vertexSize ) {
+			points = decodeBlob(file, decoded, &decodedCount, &next,
+					    sp->vertexOffset, sp->encodedSize,
+					    sp->vertexSize, sp->stride);
+			if ( NULL == points )
+				goto corrupt;
+		}
+
+		initVertexFormat(&fmt);
+		for (k = 0; k < ATTRIB_COUNT; ++k) {
+			fmt.attrib[k].size = sp->attrib[k].size;
+			fmt.attrib[k].type = sp->attrib[k].type;
+			fmt.attrib[k].normalized = sp->attrib[k].normalized;
+			fmt.attrib[k].offset = sp->attrib[k].offset;
+		}
+		fmt.stride = sp->stride;
+		setPrimitiveVertexFormat(p, i, *count, &fmt);
+
+		setPrimitiveBuffer(p, i, *count, points, sp->vertexSize);
+		memcpy(matrix, sp->transf, sizeof(matrix));
+		setPrimitiveTransformation(p, i, *count, matrix);
+
+		if ( 0 == sp->faceCount )
+			continue;
+		initPrimitiveFaceArray(p, i, *count, sp->faceCount);
+		for (j = 0; j < sp->faceCount; ++j) {
+			const SceneFace *sf = &faces[sp->firstFace + j];
+			Faces *f = getPrimitiveFaceElement(p, i, *count, j);
+			const void *elements = (const char *) file->data + sf->elementOffset;
+
+			if ( SCENE_RAW != sf->encoding && 0 != sf->count ) {
+				elements = decodeBlob(file, decoded, &decodedCount,
+						      &next, sf->elementOffset,
+						      sf->encodedSize,
+						      (uint64_t) sf->count*sizeof(GLuint), 0);
+				if ( NULL == elements ||
+				     !validElements(elements, sf->count,
+						    sp->vertexSize / sp->stride) )
+					goto corrupt;
+			}
+
+			initFace(f);
+			setFace(f, elements, sf->count);
+			f->mode = sf->mode;
+			memcpy(matrix, sf->transf, sizeof(matrix));
+			setFaceTransformation(f, matrix);
+		}
+	}
+
+	if ( decodedCount > 0 ) {
+		double elapsed = monotonicClock() - start;
+		printf("%.1f MB decodificados em %.3f s (%.1f MB/s)\n",
+		       (next - (char *) file->decoded) / (1024.*1024.), elapsed,
+		       (next - (char *) file->decoded) / (1024.*1024.) /
+		       (elapsed > 0. ? elapsed : 1e-9));
+	}
+	free(decoded);
+
+	// Os dados serão lidos na criação dos buffers, em ordem
+	madvise(file->data, file->size, MADV_WILLNEED);
+	return p;
+
+corrupt:
+	printf("Arquivo de cena corrompido: %s\n", name);
+error:
+	if ( NULL != p )
+		destroyPrimitive(p, *count);
+	*count = 0;
+	free(decoded);
+	closeScene(file);
+	return NULL;
+}
+
+/**
+ * Desfaz o mapeamento de um arquivo de cena
+ */
+void closeScene(SceneFile *file)
+{
+	assert(NULL != file);
+
+	if ( NULL != file->data )
+		munmap(file->data, file->size);
+	free(file->decoded);
+	memset(file, 0, sizeof(*file));
+}
+
+/**
+ * Verifica, pela extensão, se o nome é de um arquivo de cena
+ */
+GLboolean isSceneFile(const char *name)
+{
+	const char *ext;
+
+	assert(NULL != name);
+
+	ext = strrchr(name, '.');
+	return NULL != ext && 0 == strcasecmp(ext, SCENE_EXTENSION);
+}
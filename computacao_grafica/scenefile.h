@@ -0,0 +1,62 @@
+#ifndef __SCENEFILE_H
+#define __SCENEFILE_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+# include <stdint.h>
+
+# include "primitive.h"
+
+/**
+ * Identificação e versão do formato binário de cena
+ */
+#define SCENE_MAGIC		"CGSCENE"
+#define SCENE_VERSION		3
+/**
+ * Alinhamento, em bytes, dos vetores de vértices e de elementos no arquivo
+ */
+#define SCENE_ALIGN		64
+/**
+ * Extensão usada para os arquivos de cena
+ */
+#define SCENE_EXTENSION		".scn"
+/**
+ * Tamanho máximo dos nomes de arquivo guardados na cena
+ */
+#define SCENE_NAME_MAX		256
+
+/**
+ * @brief Informações gerais de uma cena, gravadas junto com as primitivas
+ */
+typedef struct SceneInfo
+{
+	uint64_t	key;				/**< identifica o conteúdo que gerou a cena. 0 se não houver */
+	char		vertex[SCENE_NAME_MAX];		/**< shader vertex. Vazio se não definido */
+	char		fragment[SCENE_NAME_MAX];	/**< shader fragment. Vazio se não definido */
+} SceneInfo;
+
+/**
+ * @brief Arquivo de cena mapeado na memória
+ *
+ * As primitivas carregadas apontam diretamente para o mapeamento, ou para os
+ * vetores decodificados, que devem continuar válidos enquanto elas forem
+ * usadas.
+ */
+typedef struct SceneFile
+{
+	void		*data;		/**< início do mapeamento. NULL se fechado */
+	size_t		size;		/**< tamanho do mapeamento, em bytes */
+	void		*decoded;	/**< vetores decodificados na carga */
+	SceneInfo	info;		/**< informações gravadas com a cena */
+} SceneFile;
+
+int saveScene(const char *name, const Primitive *p, uint count,
+	      GLboolean compress, const SceneInfo *info);
+
+Primitive* loadScene(const char *name, SceneFile *file, uint *count);
+
+void closeScene(SceneFile *file);
+
+GLboolean isSceneFile(const char *name);
+
+#endif
@@ -3,11 +3,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sched.h>
 
+#include "programcache.h"
+#include "vertexformat.h"
 #include "shader.h"
 
-static const size_t PAGE = 1024;
-
 /**
  * Permite criar shaders que estão na memória
  * 
@@ -54,6 +57,85 @@ end:
 	return shader;
 }
 
+/**
+ * Lê um arquivo inteiro, terminado em '\0'
+ * 
+ * O arquivo é lido de uma só vez e entregue ao driver como uma única string.
+ * 
+ * @return Conteúdo do arquivo, liberado com free. NULL se não puder ser lido
+ */
+static char* readShaderFile(const char *name)
+{
+	FILE *fp;
+	long size;
+	char *text = NULL;
+
+	printf("Lendo o arquivo: %s\n", name);
+
+	fp = fopen(name, "rb");
+	if ( NULL == fp || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 ||
+	     fseek(fp, 0, SEEK_SET) ) {
+		printf("Incapaz de abrir ou ler o arquivo shader %s\n", name);
+		goto end;
+	}
+
+	text = malloc(size + 1);
+	if ( NULL == text || (size > 0 && 1 != fread(text, size, 1, fp)) ) {
+		printf("Incapaz de abrir ou ler o arquivo shader %s\n", name);
+		free(text);
+		text = NULL;
+		goto end;
+	}
+	text[size] = '\0';
+
+end:
+	if ( NULL != fp )
+		fclose(fp);
+	return text;
+}
+
+/**
+ * Insere a versão e as definições no início de um código fonte
+ * 
+ * Se o código já começa com #version, ela é mantida e as definições entram
+ * logo depois. A diretiva #line mantém os números de linha dos erros iguais
+ * aos do arquivo.
+ * 
+ * @param text Código fonte. Liberado aqui, se um novo for criado
+ * @return Código fonte completo, liberado com free
+ */
+static char* prepareSource(char *text, uint version, const char *defines)
+{
+	const char *body = text;
+	char *out;
+	size_t size;
+	uint line = 1;
+
+	if ( 0 == version && NULL == defines )
+		return text;
+	if ( NULL == defines )
+		defines = "";
+
+	if ( 0 == strncmp(text, "#version", 8) ) {
+		body = strchr(text, '\n');
+		body = NULL != body ? body + 1 : text + strlen(text);
+		line = 2;
+	}
+
+	size = (body - text) + strlen(defines) + strlen(body) + 64;
+	out = malloc(size);
+	if ( body != text )
+		snprintf(out, size, "%.*s%s#line %u\n%s", (int) (body - text), text,
+			 defines, line, body);
+	else if ( 0 != version )
+		snprintf(out, size, "#version %u\n%s#line %u\n%s", version, defines,
+			 line, body);
+	else
+		snprintf(out, size, "%s#line %u\n%s", defines, line, body);
+	free(text);
+	return out;
+}
+
 /**
  * Carrega um shader que está em disco e o coloca na memória principal
  * 
@@ -65,123 +147,269 @@ end:
 GLuint loadAndCompileShaderFromFile(GLenum shaderType, const char *name)
 {
 	GLuint shader = 0; // valor retornado. Default: teve erro
-	int i = 0;
-	
-	FILE *fp = NULL;
-	ssize_t read = 0; // quantidade de bytes lido do arquivo
-	size_t bufferLen = 0; // necessário para a função getline
-	
-	int line = 0; // número de linhas do arquivo fonte
-	char **source = NULL; // conteúdo de cada linha
-	size_t sourceLen = line / PAGE + 1; // usado para administrar o tamanho do buffer
+	char *source = readShaderFile(name);
 
-	printf("Lendo o arquivo: %s\n", name);
+	if ( NULL != source )
+		shader = loadAndCompileShaderFromMemory(shaderType, 1,
+							(const GLchar **) &source);
+	free(source);
+	return shader;
+}
+
+/**
+ * Mostra o log de compilação de um shader que falhou
+ * 
+ * @param name Nome do arquivo do shader, usado na mensagem
+ * @return GL_TRUE se o shader compilou
+ */
+static GLboolean checkShader(GLuint shader, const char *name)
+{
+	GLint params = 0;
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &params);
+	if ( GL_FALSE == params ) {
+		GLint logLength;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+		char *log = malloc((logLength + 1)*sizeof(*log));
+		glGetShaderInfoLog(shader, logLength, NULL, log);
+		log[logLength] = '\0';
+		printf("Erro na compilação de %s: %s", name, log);
+		free(log);
+		return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+/**
+ * Liga o programa, mostrando os erros do driver
+ * 
+ * @return GL_TRUE em caso de sucesso
+ */
+static GLboolean linkProgram(GLuint program)
+{
+	GLint params = 0;
 	
-	source  = calloc(sourceLen*PAGE, sizeof(char*));
+	glLinkProgram(program);
 	
-	// Carrega o arquivo fonte na memória
-	fp = fopen(name, "r");
-	if ( NULL == fp ) {
-		printf("Incapaz de abrir ou ler o arquivo shader %s\n", name);
-		goto clearMemory;
+	glGetProgramiv(program, GL_LINK_STATUS, &params);
+	if ( GL_FALSE == params ) {
+		GLint logLength;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+		char *log = malloc((logLength + 1)*sizeof(*log));
+		glGetProgramInfoLog(program, logLength, NULL, log);
+		log[logLength] = '\0';
+		printf("Output error: %s", log);
+		free(log);
+		return GL_FALSE;
 	}
-	while ( (read = getline(&source[line], &bufferLen, fp)) != -1 ) {
-		++line;
-		bufferLen = 0;
-		if ( (line / PAGE + 1) > sourceLen ) {
-			++sourceLen;
-			char **tmp = calloc(sourceLen*PAGE, sizeof(char*));
-			if ( NULL == tmp ) {
-				printf("Memória insuficiente\n");
-				goto closeFile;
-			}
-			for (i = 0; i < line; ++i)
-				tmp[i] = source[i];
-			free(source);
-			source = tmp;
+	return GL_TRUE;
+}
+
+/**
+ * @brief Um programa do lote, enquanto é instalado
+ */
+typedef struct ProgramBuild
+{
+	char		*source[2];	/**< códigos fonte do vertex e do fragment */
+	uint64_t	key;		/**< chave do programa no cache */
+	GLuint		shader[2];	/**< shaders compilados. 0 se veio do cache */
+	GLboolean	done;		/**< se o resultado já foi verificado */
+} ProgramBuild;
+
+/**
+ * Verifica o resultado da ligação de um programa do lote
+ * 
+ * Só aqui o driver é consultado: a compilação e a ligação já foram pedidas
+ * para todos os programas. Os programas ligados vão para o cache.
+ * 
+ * @return Programa ligado, ou 0 em caso de erro
+ */
+static GLuint finishProgram(const ProgramSource *src, ProgramBuild *b,
+			    GLuint program)
+{
+	GLint params = 0;
+	GLboolean compiled;
+
+	glGetProgramiv(program, GL_LINK_STATUS, &params);
+	if ( GL_FALSE != params ) {
+		storeCachedProgram(b->key, program);
+		glDeleteShader(b->shader[0]);
+		glDeleteShader(b->shader[1]);
+		return program;
+	}
+
+	// A ligação falha se algum shader não compilou: mostra o erro dele
+	compiled = checkShader(b->shader[0], src->vertex);
+	compiled = checkShader(b->shader[1], src->fragment) && compiled;
+	if ( compiled ) {
+		GLint logLength;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+		char *log = malloc((logLength + 1)*sizeof(*log));
+		glGetProgramInfoLog(program, logLength, NULL, log);
+		log[logLength] = '\0';
+		printf("Output error: %s", log);
+		free(log);
+	}
+	printf("Erro na instalação do programa %s, %s\n", src->vertex,
+	       src->fragment);
+	glDeleteShader(b->shader[0]);
+	glDeleteShader(b->shader[1]);
+	glDeleteProgram(program);
+	return 0;
+}
+
+/**
+ * Instala vários programas de uma vez
+ * 
+ * Os programas já ligados vêm do cache de binários. Os demais têm todos os
+ * shaders compilados, as locations dos atributos fixadas por
+ * bindVertexAttributes, e são ligados antes de qualquer consulta ao driver, que
+ * pode então trabalhar neles ao mesmo tempo. Com
+ * GL_KHR_parallel_shader_compile, o driver usa várias threads e os programas
+ * são verificados na ordem em que ficam prontos; sem ela, na ordem do lote.
+ * 
+ * @param src Nomes dos shaders de cada programa, com a versão e as definições
+ *            inseridas nos códigos
+ * @param count Quantidade de programas
+ * @param program Recebe os programas ligados. 0 nos que falharam
+ * @return Quantidade de programas que falharam
+ */
+int installPrograms(const ProgramSource *src, uint count, GLuint *program)
+{
+	static const GLenum type[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	ProgramBuild *b;
+	GLboolean parallel = GLEW_KHR_parallel_shader_compile ||
+			     GLEW_ARB_parallel_shader_compile;
+	uint i, k, pending = 0;
+	int failed = 0;
+
+	assert(NULL != src || 0 == count);
+	assert(NULL != program || 0 == count);
+
+	if ( GLEW_KHR_parallel_shader_compile )
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else if ( GLEW_ARB_parallel_shader_compile )
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	b = calloc(count, sizeof(*b));
+	for (i = 0; i < count; ++i) {
+		b[i].source[0] = readShaderFile(src[i].vertex);
+		b[i].source[1] = readShaderFile(src[i].fragment);
+		program[i] = 0;
+		b[i].done = GL_TRUE;
+		if ( NULL == b[i].source[0] || NULL == b[i].source[1] ) {
+			++failed;
+			continue;
 		}
+		for (k = 0; k < 2; ++k)
+			b[i].source[k] = prepareSource(b[i].source[k], src[i].version,
+						       src[i].defines);
+
+		b[i].key = programCacheKey((const char *const *) b[i].source, 2);
+		program[i] = loadCachedProgram(b[i].key);
+		if ( 0 != program[i] )
+			continue;
+
+		// Somente pede a compilação: o resultado é consultado depois
+		for (k = 0; k < 2; ++k) {
+			b[i].shader[k] = glCreateShader(type[k]);
+			glShaderSource(b[i].shader[k], 1,
+				       (const GLchar **) &b[i].source[k], NULL);
+			glCompileShader(b[i].shader[k]);
+		}
+		b[i].done = GL_FALSE;
 	}
-	
-	shader = loadAndCompileShaderFromMemory(shaderType, line, (const GLchar **) source);
 
-closeFile:
-	fclose(fp);
-clearMemory:
-	for (i = 0; i < line; ++i)
-		free(source[i]);
-	free(source);
-	
-	return shader;
+	for (i = 0; i < count; ++i) {
+		if ( b[i].done )
+			continue;
+		program[i] = glCreateProgram();
+		glAttachShader(program[i], b[i].shader[0]);
+		glAttachShader(program[i], b[i].shader[1]);
+		bindVertexAttributes(program[i]);
+		prepareCachedProgram(program[i]);
+		glLinkProgram(program[i]);
+		++pending;
+	}
+	if ( pending > 0 )
+		printf("Compilando %u de %u programas%s\n", pending, count,
+		       parallel ? " em paralelo" : "");
+
+	while ( pending > 0 ) {
+		uint finished = 0;
+
+		for (i = 0; i < count; ++i) {
+			GLint complete = GL_TRUE;
+
+			if ( b[i].done )
+				continue;
+			if ( parallel )
+				glGetProgramiv(program[i], GL_COMPLETION_STATUS_KHR,
+					       &complete);
+			if ( GL_FALSE == complete )
+				continue;
+
+			program[i] = finishProgram(&src[i], &b[i], program[i]);
+			if ( 0 == program[i] )
+				++failed;
+			b[i].done = GL_TRUE;
+			--pending;
+			++finished;
+		}
+		if ( 0 == finished )
+			sched_yield();
+	}
+
+	for (i = 0; i < count; ++i) {
+		free(b[i].source[0]);
+		free(b[i].source[1]);
+	}
+	free(b);
+	return failed;
 }
 
 /**
  * Instala os shaders em um novo programa, no driver de vídeo
  * 
- * Instalar os shaders, compila e associa a um novo programa. Sinaliza para 
- * o driver de vídeo que eles podem ser apagador. Assim, na remoção do programa,
+ * O programa já ligado é procurado no cache de binários, pela chave dos
+ * códigos fonte e do driver. Se não estiver lá, ou se o driver recusar o
+ * binário, os shaders são compilados, associados ao programa e ligados, e o
+ * binário é guardado para as próximas execuções. Sinaliza para o driver de
+ * vídeo que os shaders podem ser apagados. Assim, na remoção do programa,
  * eles são automaticamente apagados.
  * 
  * @param vertex Nome do shader vertex, no sistema de arquivo
  * @param fragment Nome do shader fragment, no sistema de arquivo
- * @return Identificador do programa que foi instalado. Retorna 0 se não for
- *         sucedido
+ * @return Identificador do programa que foi instalado, já ligado. Em caso
+ *         de erro, encerra a aplicação
  */
 GLuint installShaders(const char *vertex, const char *fragment)
 {
-	GLuint program = 0;
-	GLuint vtx, frag;
-	
-	program = glCreateProgram();
-	
-	vtx = loadAndCompileShaderFromFile(GL_VERTEX_SHADER, vertex);
-	if ( 0 == vtx ) {
-		printf("Erro no carregamento do shader vertex: %s\n", vertex);
-		goto deleteProgram;
-	}
-	glAttachShader(program, vtx);
-	
-	frag = loadAndCompileShaderFromFile(GL_FRAGMENT_SHADER, fragment);
-	if ( 0 == frag ) {
-		printf("Erro no carregamento do shader fragment: %s\n", fragment);
-		goto deleteVertex;
-	}
-	glAttachShader(program, frag);
-	
-	// Depois que foi anexado, pode-se apagar os shaders. Somente serão
-	// efetivados após a destruição do programa
-	glDeleteShader(vtx);
-	glDeleteShader(frag);
+	ProgramSource src;
+	GLuint program;
+
+	memset(&src, 0, sizeof(src));
+	src.vertex = vertex;
+	src.fragment = fragment;
+	if ( installPrograms(&src, 1, &program) )
+		exit(EXIT_FAILURE);
 	return program;
-	
-deleteVertex:
-	glDeleteShader(vtx);
-deleteProgram:
-	glDeleteProgram(program);
-	exit(EXIT_FAILURE);
 }
 
 /**
  * Executa o programa
  * 
+ * Programas ainda não ligados são ligados aqui.
+ * 
  * @param program Identificador do programa que deve ser ativado
  */
 void runProgram(GLuint program)
 {
 	GLint params = 0;
 	
-	glLinkProgram(program);
-	
 	glGetProgramiv(program, GL_LINK_STATUS, &params);
-	if ( GL_FALSE == params ) {
-		GLint logLength;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
-		char *log = malloc((logLength + 1)*sizeof(*log));
-		glGetProgramInfoLog(program, logLength, NULL, log);
-		log[logLength] = '\0';
-		printf("Output error: %s", log);
-		free(log);
+	if ( GL_FALSE == params && !linkProgram(program) )
 		goto deleteProgram;
-	}
 	
 	glUseProgram(program);
 	printf("Programa criado com sucesso\n");
@@ -2,9 +2,22 @@
 #define __SHADER_H
 
 #include <GL/glew.h>
+#include <stdlib.h>
+
+/**
+ * @brief Shaders de um programa, no sistema de arquivo
+ */
+typedef struct ProgramSource
+{
+	const char	*vertex;	/**< nome do shader vertex */
+	const char	*fragment;	/**< nome do shader fragment */
+	uint		version;	/**< #version inserida nos códigos sem ela. 0 para nenhuma */
+	const char	*defines;	/**< diretivas inseridas depois da versão. NULL para nenhuma */
+} ProgramSource;
 
 GLuint loadAndCompileShaderFromMemory(GLenum shaderType, GLsizei lines, const GLchar **source);
 GLuint loadAndCompileShaderFromFile(GLenum shaderType, const char *name);
+int installPrograms(const ProgramSource *src, uint count, GLuint *program);
 GLuint installShaders(const char *vertex, const char *fragment);
 void runProgram(GLuint program);
 
@@ -1,6 +0,0 @@
-#version 120
-
-void main()
-{
-	gl_FragColor = vec4(1.0, 1.0, 1.0, 1.0);
-}
\ No newline at end of file
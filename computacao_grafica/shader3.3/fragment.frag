@@ -1,8 +0,0 @@
-#version 330
-
-out vec3 frag;
-
-void main()
-{
-	frag = vec3(1.0, 1.0, 1.0);
-}
\ No newline at end of file
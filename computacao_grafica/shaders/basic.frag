@@ -0,0 +1,13 @@
+// A versão é inserida por variant.c, conforme o contexto
+
+#if __VERSION__ >= 130
+out vec4 fragColor;
+# define FRAG_COLOR fragColor
+#else
+# define FRAG_COLOR gl_FragColor
+#endif
+
+void main()
+{
+	FRAG_COLOR = vec4(1.0, 1.0, 1.0, 1.0);
+}
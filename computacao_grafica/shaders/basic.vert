@@ -0,0 +1,68 @@
+// A versão e as definições INSTANCING, QUANTIZED, UBO_TRANSFORMS e ANIMATED
+// são inseridas por variant.c, conforme o contexto e a variante pedida
+
+#if __VERSION__ >= 130
+# define ATTRIBUTE in
+#else
+# define ATTRIBUTE attribute
+#endif
+
+#if __VERSION__ >= 330
+layout(location = 0) ATTRIBUTE vec3 position;
+#else
+ATTRIBUTE vec3 position;
+#endif
+
+#ifdef INSTANCING
+# if __VERSION__ >= 330
+layout(location = 4) ATTRIBUTE mat4 instanceTransformation;
+# else
+ATTRIBUTE mat4 instanceTransformation;
+# endif
+#elif defined(UBO_TRANSFORMS)
+layout(std140) uniform Transforms
+{
+	mat4 transformation;
+};
+#else
+uniform mat4 transformation;
+#endif
+
+#ifdef QUANTIZED
+uniform mat4 dequant;
+#endif
+
+#ifdef ANIMATED
+uniform float time;	// segundos
+uniform vec4 spin;	// eixo unitário e velocidade, em radianos por segundo
+uniform mat4 model;	// matriz da face, aplicada antes do giro
+
+// Rotação de angle radianos em torno de axis
+mat4 rotation(vec3 axis, float angle)
+{
+	float s = sin(angle);
+	float c = cos(angle);
+	vec3 t = (1.0 - c)*axis;
+
+	return mat4(t.x*axis.x + c, t.x*axis.y + s*axis.z, t.x*axis.z - s*axis.y, 0.0,
+		    t.y*axis.x - s*axis.z, t.y*axis.y + c, t.y*axis.z + s*axis.x, 0.0,
+		    t.z*axis.x + s*axis.y, t.z*axis.y - s*axis.x, t.z*axis.z + c, 0.0,
+		    0.0, 0.0, 0.0, 1.0);
+}
+#endif
+
+void main()
+{
+	vec4 p = vec4(position, 1.0);
+#ifdef QUANTIZED
+	p = dequant * p;
+#endif
+#ifdef ANIMATED
+	p = rotation(spin.xyz, spin.w*time) * (model * p);
+#endif
+#ifdef INSTANCING
+	gl_Position = instanceTransformation * p;
+#else
+	gl_Position = transformation * p;
+#endif
+}
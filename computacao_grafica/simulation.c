@@ -0,0 +1,246 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "linmath.h"
+#include "instance.h"
+#include "jobs.h"
+#include "platform.h"
+#include "simulation.h"
+
+/**
+ * Marca o buffer compartilhado como um passo ainda não visto por quem desenha
+ */
+#define SNAPSHOT_FRESH	4
+
+static void sleepUntil(double t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) t;
+	ts.tv_nsec = (long) ((t - ts.tv_sec)*1e9);
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/**
+ * Troca o buffer da simulação pelo compartilhado, marcado como passo novo
+ *
+ * A troca é uma barreira completa: as matrizes do passo são vistas antes do
+ * buffer.
+ */
+static void publishSnapshot(Simulation *sim)
+{
+	int old;
+
+	do {
+		old = sim->shared;
+	} while ( !__sync_bool_compare_and_swap(&sim->shared, old,
+						sim->back | SNAPSHOT_FRESH) );
+	sim->back = old & ~SNAPSHOT_FRESH;
+}
+
+/**
+ * Executa um passo e publica as matrizes antes e depois dele
+ */
+static void simulateStep(Simulation *sim)
+{
+	SceneSnapshot *s = &sim->slot[sim->back];
+	uint i;
+
+	for (i = 0; i < sim->count; ++i)
+		mat4x4_dup(s->previous[i], (vec4 *) sim->inst[i].transf);
+	sim->step(sim->arg, sim->inst, sim->count, sim->dt);
+	for (i = 0; i < sim->count; ++i)
+		mat4x4_dup(s->current[i], (vec4 *) sim->inst[i].transf);
+
+	++sim->steps;
+	s->step = sim->steps;
+	s->time = sim->start + sim->steps*sim->dt;
+	publishSnapshot(sim);
+}
+
+/**
+ * Executa os passos cujo instante já chegou
+ *
+ * O passo n é executado a partir do instante do passo n - 1: o estado
+ * publicado está sempre um passo à frente do relógio.
+ *
+ * @return Instante em que o próximo passo pode ser executado
+ */
+static double advanceSimulation(Simulation *sim)
+{
+	double t = monotonicClock(), due = sim->start + sim->steps*sim->dt;
+
+	// Depois de uma pausa, os passos atrasados são descartados
+	if ( t - due > SIMULATION_MAX_CATCHUP*sim->dt ) {
+		uint late = (uint) ((t - due)/sim->dt);
+
+		sim->dropped += late;
+		sim->start += late*sim->dt;
+		due += late*sim->dt;
+	}
+	while ( due <= t && !sim->quit ) {
+		simulateStep(sim);
+		due += sim->dt;
+	}
+	return due;
+}
+
+static void* simulationThread(void *arg)
+{
+	Simulation *sim = arg;
+
+	while ( !sim->quit )
+		sleepUntil(advanceSimulation(sim));
+	return NULL;
+}
+
+/**
+ * Copia as instâncias e começa a simulação em uma thread própria
+ *
+ * As instâncias passadas continuam de quem desenha, e recebem as matrizes
+ * interpoladas; a simulação trabalha na sua cópia. Sem a thread, os passos
+ * são executados por quem desenha, em acquireSnapshot.
+ *
+ * @param rate Passos por segundo
+ * @param step Executa um passo. Chamada sempre pela mesma thread
+ * @return 0 se a thread foi criada
+ */
+int startSimulation(Simulation *sim, const Instance *inst, uint count,
+		    double rate, SimulationStep step, void *arg)
+{
+	uint i, j;
+
+	assert(NULL != sim);
+	assert(NULL != inst || 0 == count);
+	assert(rate > 0.);
+	assert(NULL != step);
+
+	memset(sim, 0, sizeof(*sim));
+	sim->inst = createInstances(count);
+	memcpy(sim->inst, inst, count*sizeof(*inst));
+	sim->count = count;
+	sim->dt = 1./rate;
+	sim->step = step;
+	sim->arg = arg;
+	sim->start = monotonicClock();
+
+	// Até o primeiro passo, todos os buffers guardam a cena parada
+	for (i = 0; i < 3; ++i) {
+		SceneSnapshot *s = &sim->slot[i];
+
+		s->previous = malloc(2*count*sizeof(mat4x4));
+		s->current = s->previous + count;
+		s->time = sim->start;
+		for (j = 0; j < count; ++j) {
+			mat4x4_dup(s->previous[j], (vec4 *) inst[j].transf);
+			mat4x4_dup(s->current[j], (vec4 *) inst[j].transf);
+		}
+	}
+	sim->front = 0;
+	sim->shared = 1;
+	sim->back = 2;
+
+	if ( pthread_create(&sim->thread, NULL, simulationThread, sim) ) {
+		printf("Incapaz de criar a thread da simulação. Os passos seguem os quadros\n");
+		return -1;
+	}
+	sim->threaded = 1;
+	printf("Simulação com %.0f passos por segundo\n", rate);
+	return 0;
+}
+
+/**
+ * Último passo publicado
+ *
+ * O passo devolvido não muda até a próxima chamada, feita sempre pela mesma
+ * thread.
+ */
+const SceneSnapshot* acquireSnapshot(Simulation *sim)
+{
+	int old;
+
+	assert(NULL != sim);
+
+	if ( !sim->threaded )
+		advanceSimulation(sim);
+	if ( sim->shared & SNAPSHOT_FRESH ) {
+		do {
+			old = sim->shared;
+		} while ( !__sync_bool_compare_and_swap(&sim->shared, old,
+							sim->front) );
+		sim->front = old & ~SNAPSHOT_FRESH;
+	}
+	return &sim->slot[sim->front];
+}
+
+/**
+ * Interpola as matrizes de um intervalo de instâncias
+ *
+ * A interpolação é linear, elemento a elemento: nas rotações de um único
+ * passo, a diferença para uma rotação interpolada não aparece.
+ */
+static void interpolate(void *arg, uint first, uint count)
+{
+	Simulation *sim = arg;
+	const SceneSnapshot *s = sim->sample;
+	uint i, c, r;
+
+	for (i = first; i < first + count; ++i)
+		for (c = 0; c < 4; ++c)
+			for (r = 0; r < 4; ++r)
+				sim->out[i].transf[c][r] = s->previous[i][c][r] +
+					sim->alpha*(s->current[i][c][r] - s->previous[i][c][r]);
+}
+
+/**
+ * Escreve nas instâncias de quem desenha as matrizes do instante atual
+ *
+ * O instante fica entre as duas matrizes do último passo publicado. Se a
+ * simulação atrasou, as instâncias ficam no último passo.
+ *
+ * @param out Instâncias dadas a startSimulation. Não podem ser usadas até o
+ *            grupo terminar
+ * @param jobs Sistema de trabalhos. Se NULL, as matrizes são interpoladas na
+ *             hora
+ * @param done Contador dos trabalhos
+ */
+void interpolateInstances(Simulation *sim, Instance *out, JobSystem *jobs,
+			  JobCounter *done)
+{
+	GLfloat alpha;
+
+	assert(NULL != sim);
+
+	sim->sample = acquireSnapshot(sim);
+	alpha = (GLfloat) ((monotonicClock() - sim->sample->time)/sim->dt + 1.);
+	sim->alpha = alpha < 0.f ? 0.f : alpha > 1.f ? 1.f : alpha;
+	sim->out = out;
+	parallelFor(jobs, interpolate, sim, sim->count, SIMULATION_GRAIN, done,
+		    NULL);
+}
+
+/**
+ * Encerra a thread e libera os buffers. Aceita uma simulação zerada
+ */
+void stopSimulation(Simulation *sim)
+{
+	uint i;
+
+	assert(NULL != sim);
+
+	if ( NULL == sim->inst )
+		return;
+
+	sim->quit = 1;
+	if ( sim->threaded )
+		pthread_join(sim->thread, NULL);
+	for (i = 0; i < 3; ++i)
+		free(sim->slot[i].previous);
+	destroyInstances(sim->inst);
+	memset(sim, 0, sizeof(*sim));
+}
@@ -0,0 +1,86 @@
+#ifndef __SIMULATION_H
+#define __SIMULATION_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+# include <pthread.h>
+
+# include "linmath.h"
+# include "instance.h"
+# include "jobs.h"
+
+/**
+ * Passos atrasados além desse limite são descartados: depois de uma pausa
+ * longa, a simulação não tenta alcançar o relógio
+ */
+#define SIMULATION_MAX_CATCHUP	8
+/**
+ * Instâncias interpoladas por trabalho
+ */
+#define SIMULATION_GRAIN	256
+
+/**
+ * @brief Avança a simulação de um passo fixo
+ *
+ * @param arg Argumento dado a startSimulation
+ * @param inst Instâncias da simulação. Somente as matrizes devem mudar
+ * @param count Quantidade de instâncias
+ * @param dt Duração do passo, em segundos
+ */
+typedef void (*SimulationStep)(void *arg, Instance *inst, uint count, double dt);
+
+/**
+ * @brief Matrizes das instâncias em dois passos seguidos
+ *
+ * Nunca muda enquanto está com quem desenha.
+ */
+typedef struct SceneSnapshot
+{
+	double		time;		/**< instante de current, no relógio de monotonicClock */
+	uint		step;		/**< passo que gerou current */
+	mat4x4		*previous;	/**< matrizes no passo anterior */
+	mat4x4		*current;	/**< matrizes depois do passo */
+} SceneSnapshot;
+
+/**
+ * @brief Simulação em passos fixos, em uma thread própria
+ *
+ * Cada passo é publicado em um buffer triplo sem travas: a simulação grava
+ * sempre no seu buffer, e troca-o pelo compartilhado com uma operação
+ * atômica. Quem desenha troca o seu pelo compartilhado quando há um passo
+ * novo, e interpola entre as duas matrizes do passo, um passo atrás do
+ * relógio: o desenho nunca espera pela simulação, nem o contrário.
+ */
+typedef struct Simulation
+{
+	Instance	*inst;		/**< cópia das instâncias, da simulação */
+	uint		count;		/**< quantidade de instâncias */
+	double		dt;		/**< duração de um passo, em segundos */
+	double		start;		/**< instante do passo 0 */
+	uint		steps;		/**< passos executados */
+	SimulationStep	step;
+	void		*arg;		/**< argumento de step */
+	SceneSnapshot	slot[3];	/**< buffer triplo */
+	volatile int	shared;		/**< buffer compartilhado, com o bit de passo novo */
+	int		back;		/**< buffer da simulação */
+	int		front;		/**< buffer de quem desenha */
+	volatile int	quit;		/**< pede o fim da thread */
+	uint		dropped;	/**< passos descartados por atraso */
+	pthread_t	thread;
+	int		threaded;	/**< se a thread foi criada */
+	const SceneSnapshot	*sample;	/**< passo sendo interpolado */
+	GLfloat		alpha;		/**< posição entre previous e current */
+	Instance	*out;		/**< recebe as matrizes interpoladas */
+} Simulation;
+
+int startSimulation(Simulation *sim, const Instance *inst, uint count,
+		    double rate, SimulationStep step, void *arg);
+
+const SceneSnapshot* acquireSnapshot(Simulation *sim);
+
+void interpolateInstances(Simulation *sim, Instance *out, JobSystem *jobs,
+			  JobCounter *done);
+
+void stopSimulation(Simulation *sim);
+
+#endif
@@ -0,0 +1,1296 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "linmath.h"
+#include "primitive.h"
+#include "meshlet.h"
+#include "quantize.h"
+#include "vertexformat.h"
+#include "dynamic.h"
+#include "hash.h"
+#include "platform.h"
+#include "jobs.h"
+#include "command.h"
+#include "stream.h"
+
+#define STREAM_PAGE_SIZE	4096
+// Bytes gerados de uma vez no hash e na comparação dos conteúdos
+#define STREAM_HASH_BLOCK	4096
+
+// Caixa [-1, 1] desenhada no lugar de um pedaço ausente
+static const GLfloat placeholderVertex[] = {
+	-1.f, -1.f, -1.f,
+	1.f, -1.f, -1.f,
+	1.f, 1.f, -1.f,
+	-1.f, 1.f, -1.f,
+	-1.f, -1.f, 1.f,
+	1.f, -1.f, 1.f,
+	1.f, 1.f, 1.f,
+	-1.f, 1.f, 1.f
+};
+
+static const GLuint placeholderElem[] = { // são 12 arestas
+	0, 1, 1, 2, 2, 3, 3, 0,
+	4, 5, 5, 6, 6, 7, 7, 4,
+	0, 4, 1, 5, 2, 6, 3, 7
+};
+
+static int compareRequest(const void *a, const void *b)
+{
+	const StreamRequest *x = a, *y = b;
+
+	if ( x->distance != y->distance )
+		return x->distance < y->distance ? -1 : 1;
+	return x->chunk < y->chunk ? -1 : x->chunk > y->chunk;
+}
+
+/**
+ * Lê uma posição por página, trazendo os dados para a memória
+ */
+static void prefault(const void *data, size_t size)
+{
+	const volatile unsigned char *c = data;
+	size_t i;
+
+	if ( NULL == data )
+		return;
+	for (i = 0; i < size; i += STREAM_PAGE_SIZE)
+		(void) c[i];
+	if ( size > 0 )
+		(void) c[size - 1];
+}
+
+/**
+ * Caixa envolvente da primitiva, já com as transformações das faces
+ */
+static void computeChunkBounds(Primitive *p, StreamChunk *c)
+{
+	vec3 lo = { INFINITY, INFINITY, INFINITY };
+	vec3 hi = { -INFINITY, -INFINITY, -INFINITY };
+	vec3 boxLo, boxHi;
+	const GLfloat *points;
+	uint stride, vertexCount, i, j;
+	int k;
+
+	points = getPrimitivePositions(p, 0, 1, &stride);
+	vertexCount = getPrimitiveVertexCount(p, 0, 1);
+	if ( NULL == points || 0 == vertexCount || NULL != p->dynamic ) {
+		// Sem posições conhecidas, ou que podem mudar: sempre visível
+		memset(c->center, 0, sizeof(c->center));
+		c->half[0] = c->half[1] = c->half[2] = 1.f;
+		c->radius = INFINITY;
+		return;
+	}
+
+	for (i = 0; i < vertexCount; ++i)
+		for (k = 0; k < 3; ++k) {
+			if ( 0 == i || points[stride*i + k] < boxLo[k] )
+				boxLo[k] = points[stride*i + k];
+			if ( 0 == i || points[stride*i + k] > boxHi[k] )
+				boxHi[k] = points[stride*i + k];
+		}
+
+	// Os 8 cantos da caixa, levados por cada face
+	for (j = 0; j < (p->faceCount > 0 ? p->faceCount : 1); ++j) {
+		mat4x4 identity, *transf = &identity;
+
+		mat4x4_identity(identity);
+		if ( p->faceCount > 0 )
+			transf = &p->faceArray[j].transf;
+
+		for (i = 0; i < 8; ++i) {
+			vec4 corner = { i & 1 ? boxHi[0] : boxLo[0],
+					i & 2 ? boxHi[1] : boxLo[1],
+					i & 4 ? boxHi[2] : boxLo[2], 1.f };
+			vec4 out;
+
+			mat4x4_mul_vec4(out, *transf, corner);
+			for (k = 0; k < 3; ++k) {
+				if ( out[k] < lo[k] )
+					lo[k] = out[k];
+				if ( out[k] > hi[k] )
+					hi[k] = out[k];
+			}
+		}
+	}
+
+	for (k = 0; k < 3; ++k) {
+		c->center[k] = .5f*(hi[k] + lo[k]);
+		c->half[k] = .5f*(hi[k] - lo[k]);
+	}
+	c->radius = vec3_len(c->half);
+}
+
+/**
+ * Escreve os vértices de um pedaço no formato de vídeo
+ */
+static void writeVertices(Primitive *p, GLvoid *out)
+{
+	uint vertexCount = getPrimitiveVertexCount(p, 0, 1);
+
+	if ( p->gpuFormat.stride != p->format.stride )
+		quantizeVertices(&p->format, p->points, vertexCount, p->dequant,
+				 &p->gpuFormat, out);
+	else
+		memcpy(out, p->points, (size_t) vertexCount*p->format.stride);
+}
+
+/**
+ * Escreve o conteúdo de um dos buffers de um pedaço
+ *
+ * @param elements GL_TRUE para os elementos, GL_FALSE para os vértices
+ */
+static void writeBlob(Primitive *p, GLvoid *out, GLboolean elements)
+{
+	if ( elements )
+		packPrimitiveElements(p, 0, 1, out);
+	else
+		writeVertices(p, out);
+}
+
+/**
+ * Copia os vértices e os elementos de uma primitiva dinâmica
+ *
+ * Executado na thread do OpenGL, quando o pedaço é pedido, fora das
+ * alterações da malha: a thread de carga lê somente a cópia. Os intervalos
+ * alterados até aqui já estão na cópia.
+ */
+static void snapshotDynamicChunk(Primitive *p, StreamChunk *c)
+{
+	c->staging = malloc(c->gpuSize - c->elementSize);
+	writeBlob(p, c->staging, GL_FALSE);
+	if ( c->elementSize > 0 ) {
+		c->elementStaging = malloc(c->elementSize);
+		writeBlob(p, c->elementStaging, GL_TRUE);
+	}
+	clearDirtyRanges(&p->dynamic->vertices);
+	clearDirtyRanges(&p->dynamic->indices);
+}
+
+/**
+ * Prepara os vértices e os elementos de um pedaço para o envio ao driver
+ *
+ * Executado pela thread de carga, sem contexto OpenGL, somente para os
+ * buffers que o pedaço preenche. As posições quantizadas e os elementos são
+ * gerados em buffers intermediários; os vértices originais são somente
+ * trazidos para a memória, para que o envio não espere pelo disco. As
+ * primitivas dinâmicas já chegam copiadas.
+ */
+static void stageChunk(Primitive *p, StreamChunk *c)
+{
+	if ( NULL != p->dynamic )
+		return;
+
+	if ( c->fillsVertices ) {
+		if ( p->gpuFormat.stride != p->format.stride ) {
+			c->staging = malloc(c->gpuSize - c->elementSize);
+			writeVertices(p, c->staging);
+		} else {
+			prefault(p->points, p->pSize);
+		}
+	}
+
+	if ( c->fillsElements ) {
+		c->elementStaging = malloc(c->elementSize);
+		packPrimitiveElements(p, 0, 1, c->elementStaging);
+	}
+}
+
+static GLenum bufferUsage(const Primitive *p)
+{
+	return NULL != p->dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+}
+
+/**
+ * Cria um buffer na memória de vídeo e o preenche com os dados do pedaço
+ *
+ * Os dados são escritos diretamente no buffer mapeado. Se o mapeamento
+ * falhar, passam por um buffer intermediário.
+ *
+ * @param elements GL_TRUE para os elementos, GL_FALSE para os vértices
+ * @param staged Conteúdo já preparado, ou NULL para gerá-lo da primitiva
+ * @return Nome do buffer
+ */
+static GLuint fillBuffer(Primitive *p, GLsizeiptr size, GLboolean elements,
+			 const GLvoid *staged)
+{
+	GLuint id;
+	GLvoid *data;
+
+	glGenBuffers(1, &id);
+	glBindBuffer(GL_ARRAY_BUFFER, id);
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, bufferUsage(p));
+
+	if ( NULL != staged ) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, staged);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return id;
+	}
+
+	data = size > 0 ? glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY) : NULL;
+	if ( NULL != data ) {
+		writeBlob(p, data, elements);
+		// O conteúdo pode se perder durante o mapeamento
+		if ( glUnmapBuffer(GL_ARRAY_BUFFER) ) {
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			return id;
+		}
+	}
+
+	data = malloc(size);
+	writeBlob(p, data, elements);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+	free(data);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return id;
+}
+
+/**
+ * Envia um pedaço ao driver a partir da thread de carga
+ *
+ * Executado com o contexto compartilhado, somente para os buffers que o
+ * pedaço preenche. As primitivas dinâmicas são enviadas da sua cópia. A
+ * cerca avisa a thread do OpenGL quando os buffers podem ser usados.
+ *
+ * @return Bytes enviados
+ */
+static size_t loadChunk(StreamManager *s, uint i)
+{
+	StreamChunk *c = &s->chunks[i];
+	Primitive *p = &s->p[i];
+	size_t uploaded = 0;
+
+	if ( c->fillsVertices ) {
+		StreamBuffer *b = &s->buffers[c->vertexBuffer];
+		b->id = fillBuffer(p, b->size, GL_FALSE, c->staging);
+		uploaded += b->size;
+	}
+	if ( c->fillsElements ) {
+		StreamBuffer *b = &s->buffers[c->elementBuffer];
+		b->id = fillBuffer(p, b->size, GL_TRUE, c->elementStaging);
+		uploaded += b->size;
+	}
+	free(c->staging);
+	free(c->elementStaging);
+	c->staging = NULL;
+	c->elementStaging = NULL;
+	if ( 0 == uploaded )
+		return 0;
+
+	c->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// Sem o flush, a cerca pode nunca chegar ao driver
+	glFlush();
+	return uploaded;
+}
+
+/**
+ * Reserva para o pedaço os seus buffers que ninguém preenche
+ *
+ * Chamado com o lock. Os demais buffers já estão na memória de vídeo ou
+ * estão sendo preenchidos por outro pedaço.
+ */
+static void claimChunkBuffers(StreamManager *s, uint i)
+{
+	StreamChunk *c = &s->chunks[i];
+	StreamBuffer *b = &s->buffers[c->vertexBuffer];
+
+	c->fillsVertices = BUFFER_ABSENT == b->state;
+	if ( c->fillsVertices ) {
+		b->state = BUFFER_LOADING;
+		b->loader = i;
+	}
+
+	c->fillsElements = GL_FALSE;
+	if ( STREAM_NO_BUFFER == c->elementBuffer )
+		return;
+	b = &s->buffers[c->elementBuffer];
+	c->fillsElements = BUFFER_ABSENT == b->state;
+	if ( c->fillsElements ) {
+		b->state = BUFFER_LOADING;
+		b->loader = i;
+	}
+}
+
+/**
+ * Thread de carga: atende os pedidos na ordem de prioridade
+ */
+static void* streamThread(void *arg)
+{
+	StreamManager *s = arg;
+
+	if ( NULL != s->context )
+		glfwMakeContextCurrent(s->context);
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		StreamChunk *c;
+		size_t uploaded = 0;
+		double start;
+		uint i;
+
+		while ( !s->quit && s->queueNext == s->queueCount )
+			pthread_cond_wait(&s->wake, &s->lock);
+		if ( s->quit )
+			break;
+
+		i = s->queue[s->queueNext++].chunk;
+		c = &s->chunks[i];
+		c->state = CHUNK_LOADING;
+		claimChunkBuffers(s, i);
+		pthread_mutex_unlock(&s->lock);
+
+		start = monotonicClock();
+		if ( NULL != s->context )
+			uploaded = loadChunk(s, i);
+		else
+			stageChunk(&s->p[i], c);
+
+		pthread_mutex_lock(&s->lock);
+		if ( NULL != s->context ) {
+			s->stats.uploaded += uploaded;
+			s->stats.uploadTime += monotonicClock() - start;
+		}
+		c->state = CHUNK_READY;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	if ( NULL != s->context )
+		glfwMakeContextCurrent(NULL);
+	return NULL;
+}
+
+/**
+ * Bytes que um pedaço ainda precisa enviar ao driver
+ */
+static size_t chunkUploadSize(const StreamManager *s, const StreamChunk *c)
+{
+	size_t size = 0;
+
+	if ( c->fillsVertices )
+		size += s->buffers[c->vertexBuffer].size;
+	if ( c->fillsElements )
+		size += s->buffers[c->elementBuffer].size;
+	return size;
+}
+
+/**
+ * Envia os buffers intermediários de um pedaço ao driver
+ *
+ * Somente os buffers que o pedaço preenche são enviados.
+ */
+static void uploadChunk(StreamManager *s, uint i)
+{
+	StreamChunk *c = &s->chunks[i];
+	Primitive *p = &s->p[i];
+	StreamBuffer *b;
+
+	if ( c->fillsVertices ) {
+		b = &s->buffers[c->vertexBuffer];
+		glGenBuffers(1, &b->id);
+		glBindBuffer(GL_ARRAY_BUFFER, b->id);
+		glBufferData(GL_ARRAY_BUFFER, b->size,
+			     NULL != c->staging ? c->staging : p->points,
+			     bufferUsage(p));
+	}
+
+	if ( c->fillsElements ) {
+		b = &s->buffers[c->elementBuffer];
+		glGenBuffers(1, &b->id);
+		glBindBuffer(GL_ARRAY_BUFFER, b->id);
+		glBufferData(GL_ARRAY_BUFFER, b->size, c->elementStaging,
+			     bufferUsage(p));
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	free(c->staging);
+	free(c->elementStaging);
+	c->staging = NULL;
+	c->elementStaging = NULL;
+}
+
+/**
+ * Marca como prontos os buffers que o pedaço preencheu
+ *
+ * Chamado com o lock, depois do envio ou da cerca.
+ */
+static void publishChunkBuffers(StreamManager *s, StreamChunk *c)
+{
+	if ( c->fillsVertices )
+		s->buffers[c->vertexBuffer].state = BUFFER_PRESENT;
+	if ( c->fillsElements )
+		s->buffers[c->elementBuffer].state = BUFFER_PRESENT;
+	c->fillsVertices = GL_FALSE;
+	c->fillsElements = GL_FALSE;
+}
+
+/**
+ * Garante que um buffer do pedaço está na memória de vídeo
+ *
+ * Um buffer abandonado por quem o preenchia é enviado aqui mesmo, a partir
+ * da primitiva do pedaço, que tem o mesmo conteúdo. Chamado com o lock, que
+ * é solto durante o envio: o buffer fica reservado ao pedaço, como os da
+ * thread de carga.
+ *
+ * @param uploaded Recebe, somados, os bytes enviados
+ * @return 0 se o buffer está pronto, ou -1 se outro pedaço ainda o preenche
+ */
+static int requireBuffer(StreamManager *s, uint i, uint buffer, size_t *uploaded)
+{
+	StreamBuffer *b;
+
+	if ( STREAM_NO_BUFFER == buffer )
+		return 0;
+	b = &s->buffers[buffer];
+	if ( BUFFER_LOADING == b->state )
+		return -1;
+	if ( BUFFER_ABSENT == b->state ) {
+		b->state = BUFFER_LOADING;
+		b->loader = i;
+		pthread_mutex_unlock(&s->lock);
+		b->id = fillBuffer(&s->p[i], b->size, b->elements, NULL);
+		pthread_mutex_lock(&s->lock);
+		b->state = BUFFER_PRESENT;
+		*uploaded += b->size;
+	}
+	return 0;
+}
+
+/**
+ * Cria o vertex array de um pedaço já enviado
+ *
+ * Vertex arrays não são compartilhados entre contextos: são sempre criados
+ * na thread do OpenGL. Os buffers podem ser de outros pedaços com o mesmo
+ * conteúdo.
+ */
+static void bindChunk(StreamManager *s, uint i)
+{
+	Primitive *p = &s->p[i];
+	const StreamChunk *c = &s->chunks[i];
+
+	p->id = s->buffers[c->vertexBuffer].id;
+	p->elementId = STREAM_NO_BUFFER != c->elementBuffer ?
+		       s->buffers[c->elementBuffer].id : 0;
+
+	glGenVertexArrays(1, &p->vao);
+	glBindVertexArray(p->vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, p->id);
+	setupVertexFormat(&p->gpuFormat);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p->elementId);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Envia somente os intervalos alterados de uma primitiva dinâmica
+ *
+ * Chamado para os pedaços na memória de vídeo. Enquanto o pedaço está fora
+ * dela, os intervalos são mantidos: as alterações feitas depois da cópia
+ * entregue à thread de carga são enviadas quando o pedaço fica residente.
+ *
+ * @return Bytes enviados
+ */
+static size_t uploadDynamicRanges(Primitive *p)
+{
+	DynamicMesh *d = p->dynamic;
+	size_t uploaded = 0;
+	uint k;
+
+	assert(p->gpuFormat.stride == d->stride);
+
+	glBindBuffer(GL_ARRAY_BUFFER, p->id);
+	for (k = 0; k < d->vertices.count; ++k) {
+		const DirtyRange *r = &d->vertices.range[k];
+
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) r->first*d->stride,
+				(GLsizeiptr) r->count*d->stride,
+				(const char *) d->points + (size_t) r->first*d->stride);
+		uploaded += (size_t) r->count*d->stride;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, p->elementId);
+	for (k = 0; k < d->indices.count; ++k) {
+		const DirtyRange *r = &d->indices.range[k];
+
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) r->first*sizeof(GLuint),
+				(GLsizeiptr) r->count*sizeof(GLuint),
+				&d->elements[r->first]);
+		uploaded += r->count*sizeof(GLuint);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	clearDirtyRanges(&d->vertices);
+	clearDirtyRanges(&d->indices);
+	return uploaded;
+}
+
+/**
+ * Bytes que um pedaço acrescenta à memória de vídeo: os dos buffers que
+ * nenhum outro pedaço pedido ou residente usa
+ */
+static size_t chunkNewSize(const StreamManager *s, const StreamChunk *c)
+{
+	size_t size = 0;
+
+	if ( 0 == s->buffers[c->vertexBuffer].refs )
+		size += s->buffers[c->vertexBuffer].size;
+	if ( STREAM_NO_BUFFER != c->elementBuffer &&
+	     0 == s->buffers[c->elementBuffer].refs )
+		size += s->buffers[c->elementBuffer].size;
+	return size;
+}
+
+static void acquireBuffer(StreamManager *s, uint buffer)
+{
+	StreamBuffer *b;
+
+	if ( STREAM_NO_BUFFER == buffer )
+		return;
+	b = &s->buffers[buffer];
+	if ( 0 == b->refs++ )
+		s->used += b->size;
+}
+
+/**
+ * Solta um buffer do pedaço i
+ *
+ * Se o pedaço o preenchia, outro pedaço poderá preenchê-lo. O último pedaço
+ * a soltá-lo o remove da memória de vídeo. Chamado com o lock, na thread do
+ * OpenGL.
+ */
+static void releaseBuffer(StreamManager *s, uint i, uint buffer)
+{
+	StreamBuffer *b;
+
+	if ( STREAM_NO_BUFFER == buffer )
+		return;
+	b = &s->buffers[buffer];
+	assert(b->refs > 0);
+
+	if ( BUFFER_LOADING == b->state && i == b->loader )
+		b->state = BUFFER_ABSENT;
+	if ( 0 == --b->refs ) {
+		glDeleteBuffers(1, &b->id);
+		b->id = 0;
+		b->state = BUFFER_ABSENT;
+		s->used -= b->size;
+	}
+}
+
+static void acquireChunkBuffers(StreamManager *s, uint i)
+{
+	acquireBuffer(s, s->chunks[i].vertexBuffer);
+	acquireBuffer(s, s->chunks[i].elementBuffer);
+}
+
+static void releaseChunkBuffers(StreamManager *s, uint i)
+{
+	releaseBuffer(s, i, s->chunks[i].vertexBuffer);
+	releaseBuffer(s, i, s->chunks[i].elementBuffer);
+	s->chunks[i].fillsVertices = GL_FALSE;
+	s->chunks[i].fillsElements = GL_FALSE;
+}
+
+static void evictChunk(StreamManager *s, uint i)
+{
+	Primitive *p = &s->p[i];
+
+	glDeleteVertexArrays(1, &p->vao);
+	p->vao = 0;
+	p->id = 0;
+	p->elementId = 0;
+
+	releaseChunkBuffers(s, i);
+	s->chunks[i].state = CHUNK_UNLOADED;
+	++s->stats.evictions;
+}
+
+/**
+ * Libera espaço no orçamento, removendo os pedaços usados há mais tempo
+ *
+ * Pedaços visíveis no quadro atual nunca são removidos. Um pedaço removido
+ * só libera os buffers que nenhum outro pedaço usa.
+ *
+ * @return GL_TRUE se os buffers novos do pedaço cabem no orçamento
+ */
+static GLboolean makeRoom(StreamManager *s, const StreamChunk *chunk)
+{
+	while ( s->used + chunkNewSize(s, chunk) > s->budget ) {
+		uint i, victim = s->count;
+
+		for (i = 0; i < s->count; ++i) {
+			const StreamChunk *c = &s->chunks[i];
+			if ( CHUNK_RESIDENT == c->state && c->lastUsed < s->frame &&
+			     (victim == s->count || c->lastUsed < s->chunks[victim].lastUsed) )
+				victim = i;
+		}
+		if ( victim == s->count )
+			return GL_FALSE;
+		evictChunk(s, victim);
+	}
+	return GL_TRUE;
+}
+
+/**
+ * Copia a parte de um vetor de elementos que cai no bloco
+ *
+ * @param start Posição do vetor no buffer de elementos, em bytes
+ */
+static void copyElementBlock(GLvoid *out, GLintptr offset, GLsizeiptr size,
+			     GLintptr start, const GLuint *face, uint count)
+{
+	GLintptr end = start + (GLintptr) (count*sizeof(GLuint));
+	GLintptr lo = start > offset ? start : offset;
+	GLintptr hi = end < offset + size ? end : offset + size;
+
+	if ( lo < hi )
+		memcpy((char *) out + (lo - offset),
+		       (const char *) face + (lo - start), hi - lo);
+}
+
+/**
+ * Lê um bloco do conteúdo de um dos buffers de um pedaço
+ *
+ * Somente o bloco é gerado, em scratch, que deve ter STREAM_HASH_BLOCK bytes
+ * mais dois vértices no formato de vídeo. Vértices que não mudam de formato
+ * são lidos da própria primitiva.
+ *
+ * @param elements GL_TRUE para os elementos, GL_FALSE para os vértices
+ * @return Início do bloco
+ */
+static const GLvoid* readBlobBlock(Primitive *p, GLboolean elements,
+				   GLintptr offset, GLsizeiptr size,
+				   GLvoid *scratch)
+{
+	uint stride = p->gpuFormat.stride, first, last, i, k;
+
+	if ( elements ) {
+		for (i = 0; i < p->faceCount; ++i) {
+			const Faces *f = &p->faceArray[i];
+
+			copyElementBlock(scratch, offset, size, f->offset,
+					 f->face, f->count);
+			for (k = 1; k < f->lodCount; ++k)
+				copyElementBlock(scratch, offset, size,
+						 f->lods[k].offset, f->lods[k].face,
+						 f->lods[k].count);
+		}
+		return scratch;
+	}
+
+	if ( (GLsizei) stride == p->format.stride )
+		return (const char *) p->points + offset;
+
+	// Os vértices que cobrem o bloco, inteiros
+	first = offset / stride;
+	last = (offset + size + stride - 1) / stride;
+	quantizeVertices(&p->format,
+			 (const char *) p->points + (size_t) first*p->format.stride,
+			 last - first, p->dequant, &p->gpuFormat, scratch);
+	return (const char *) scratch + (offset - (GLintptr) first*stride);
+}
+
+static GLsizeiptr blockSize(GLsizeiptr size, GLintptr offset)
+{
+	return size - offset < STREAM_HASH_BLOCK ? size - offset : STREAM_HASH_BLOCK;
+}
+
+/**
+ * Hash do conteúdo de um dos buffers de um pedaço, gerado bloco a bloco
+ */
+static uint64_t hashBlob(Primitive *p, GLsizeiptr size, GLboolean elements,
+			 GLvoid *scratch)
+{
+	uint64_t hash = elements;
+	GLintptr offset;
+
+	for (offset = 0; offset < size; offset += STREAM_HASH_BLOCK) {
+		GLsizeiptr n = blockSize(size, offset);
+
+		hash = hashBytes(readBlobBlock(p, elements, offset, n, scratch),
+				 n, hash);
+	}
+	return hash;
+}
+
+/**
+ * Verifica se o conteúdo de um buffer é igual ao do pedaço i
+ *
+ * Os hashes já são iguais: os dois conteúdos são gerados de novo, bloco a
+ * bloco, somente para confirmar.
+ *
+ * @param scratch Dois blocos, como em readBlobBlock
+ */
+static GLboolean sameBlob(StreamManager *s, const StreamBuffer *b, uint i,
+			  GLvoid *scratch[2])
+{
+	GLintptr offset;
+
+	for (offset = 0; offset < b->size; offset += STREAM_HASH_BLOCK) {
+		GLsizeiptr size = blockSize(b->size, offset);
+
+		if ( memcmp(readBlobBlock(&s->p[b->owner], b->elements, offset,
+					  size, scratch[0]),
+			    readBlobBlock(&s->p[i], b->elements, offset, size,
+					  scratch[1]), size) )
+			return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+/**
+ * Encontra o buffer com o conteúdo de um pedaço, ou cria um novo
+ *
+ * @param table Tabela de hash aberta, com os buffers já criados
+ * @param mask Tamanho da tabela menos 1. O tamanho é uma potência de 2
+ * @param scratch Dois blocos, como em readBlobBlock
+ * @return Posição do buffer em s->buffers
+ */
+static uint shareBuffer(StreamManager *s, uint *table, uint mask, uint i,
+			GLsizeiptr size, GLboolean elements, GLvoid *scratch[2])
+{
+	Primitive *p = &s->p[i];
+	StreamBuffer *b;
+	uint64_t hash = 0;
+	uint slot = 0, k;
+
+	// Primitivas dinâmicas mudam depois da carga: nunca compartilham
+	if ( NULL == p->dynamic && size > 0 ) {
+		hash = hashBlob(p, size, elements, scratch[0]);
+
+		for (slot = hash & mask; STREAM_NO_BUFFER != table[slot]; slot = (slot + 1) & mask) {
+			b = &s->buffers[table[slot]];
+			if ( b->hash == hash && b->size == size && b->elements == elements &&
+			     sameBlob(s, b, i, scratch) ) {
+				++b->users;
+				return table[slot];
+			}
+		}
+		table[slot] = s->bufferCount;
+	}
+
+	k = s->bufferCount++;
+	b = &s->buffers[k];
+	memset(b, 0, sizeof(*b));
+	b->size = size;
+	b->elements = elements;
+	b->hash = hash;
+	b->owner = i;
+	b->users = 1;
+	return k;
+}
+
+/**
+ * Agrupa os pedaços com vértices ou elementos idênticos
+ *
+ * Os vértices, já no formato de vídeo, e os elementos de cada pedaço são
+ * comparados pelo hash do conteúdo. Conteúdos repetidos usam o mesmo buffer.
+ * O conteúdo é gerado em blocos pequenos, nunca inteiro.
+ */
+static void dedupChunkBuffers(StreamManager *s)
+{
+	uint *table, size = 1, i, blobs = 0;
+	GLsizei stride = 0;
+	GLvoid *scratch[2];
+	size_t saved = 0;
+
+	// Até dois buffers por pedaço, com a tabela no máximo meio cheia
+	while ( size < 4*s->count )
+		size <<= 1;
+	table = malloc(size*sizeof(*table));
+	memset(table, 0xff, size*sizeof(*table));
+	s->buffers = malloc(2*s->count*sizeof(*s->buffers));
+
+	// Um bloco quantizado começa e termina no meio de vértices
+	for (i = 0; i < s->count; ++i)
+		if ( s->p[i].gpuFormat.stride > stride )
+			stride = s->p[i].gpuFormat.stride;
+	scratch[0] = malloc(STREAM_HASH_BLOCK + 2*stride);
+	scratch[1] = malloc(STREAM_HASH_BLOCK + 2*stride);
+
+	for (i = 0; i < s->count; ++i) {
+		StreamChunk *c = &s->chunks[i];
+
+		c->vertexBuffer = shareBuffer(s, table, size - 1, i,
+					      c->gpuSize - c->elementSize, GL_FALSE,
+					      scratch);
+		c->elementBuffer = STREAM_NO_BUFFER;
+		if ( c->elementSize > 0 )
+			c->elementBuffer = shareBuffer(s, table, size - 1, i,
+						       c->elementSize, GL_TRUE,
+						       scratch);
+		blobs += STREAM_NO_BUFFER != c->elementBuffer ? 2 : 1;
+	}
+	free(scratch[0]);
+	free(scratch[1]);
+	free(table);
+
+	for (i = 0; i < s->bufferCount; ++i)
+		saved += (size_t) (s->buffers[i].users - 1)*s->buffers[i].size;
+	printf("Deduplicação: %u de %u buffers repetidos (%.1f%%), %.1f MB poupados\n",
+	       blobs - s->bufferCount, blobs,
+	       blobs > 0 ? 100.*(blobs - s->bufferCount) / blobs : 0.,
+	       saved / (1024.*1024.));
+}
+
+/**
+ * Inicia o streaming das primitivas
+ *
+ * Nenhum pedaço é enviado aqui: os pedaços visíveis são pedidos a cada
+ * quadro por updateStreaming. Calcula as caixas envolventes e o layout dos
+ * elementos, agrupa os conteúdos repetidos, cria a caixa desenhada no lugar dos pedaços ausentes e inicia a
+ * thread de carga. Se o driver oferece cercas, a thread de carga ganha um
+ * contexto compartilhado com share e envia os buffers ela mesma. Deve ser
+ * chamado na thread principal, com o contexto OpenGL atual, depois de todas
+ * as mudanças nas primitivas.
+ *
+ * @param s Estrutura a ser inicializada
+ * @param p Array de primitivas
+ * @param count Quantidade de elementos do array
+ * @param budget Bytes permitidos na memória de vídeo
+ * @param uploadLimit Bytes enviados por quadro na thread do OpenGL, no
+ *                    máximo. Um pedaço maior que o limite é enviado sozinho.
+ *                    Não se aplica aos envios da thread de carga
+ * @param share Janela cujo contexto é compartilhado com a thread de carga.
+ *              NULL para enviar os buffers na thread do OpenGL
+ * @return 0 em caso de sucesso
+ */
+int initStreaming(StreamManager *s, Primitive *p, uint count, size_t budget,
+		  size_t uploadLimit, GLFWwindow *share)
+{
+	VertexFormat fmt;
+	uint i;
+
+	assert(NULL != s);
+	assert(NULL != p);
+
+	memset(s, 0, sizeof(*s));
+	s->p = p;
+	s->count = count;
+	s->budget = budget;
+	s->uploadLimit = uploadLimit;
+	s->chunks = calloc(count, sizeof(*s->chunks));
+	s->queue = malloc(count*sizeof(*s->queue));
+
+	for (i = 0; i < count; ++i) {
+		computeChunkBounds(&p[i], &s->chunks[i]);
+		s->chunks[i].elementSize = layoutPrimitiveElements(p, i, count);
+		s->chunks[i].gpuSize = (GLsizeiptr) getPrimitiveVertexCount(p, i, count) *
+				       p[i].gpuFormat.stride + s->chunks[i].elementSize;
+	}
+	dedupChunkBuffers(s);
+
+	glGenVertexArrays(1, &s->placeholderVao);
+	glBindVertexArray(s->placeholderVao);
+	glGenBuffers(1, &s->placeholderId);
+	glBindBuffer(GL_ARRAY_BUFFER, s->placeholderId);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(placeholderVertex), placeholderVertex,
+		     GL_STATIC_DRAW);
+	initVertexFormat(&fmt);
+	addVertexAttribute(&fmt, ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE);
+	setupVertexFormat(&fmt);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Sem cercas, a thread do OpenGL não saberia quando os buffers estão prontos
+	if ( NULL != share && (GLEW_VERSION_3_2 || GLEW_ARB_sync) ) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		s->context = glfwCreateWindow(1, 1, "", NULL, share);
+		glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+		if ( NULL == s->context )
+			printf("Contexto compartilhado indisponível: envios feitos no desenho\n");
+	}
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->wake, NULL);
+	if ( pthread_create(&s->thread, NULL, streamThread, s) ) {
+		printf("Incapaz de criar a thread de carga\n");
+		if ( NULL != s->context )
+			glfwDestroyWindow(s->context);
+		pthread_cond_destroy(&s->wake);
+		pthread_mutex_destroy(&s->lock);
+		free(s->queue);
+		free(s->buffers);
+		free(s->chunks);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Instâncias testadas por um trabalho
+ */
+typedef struct CullJob
+{
+	StreamManager	*s;
+	Instance	*inst;
+	uint		count;	/**< quantidade de instâncias */
+	const GLboolean	*animated;	/**< instâncias giradas pelo shader. Pode ser NULL */
+} CullJob;
+
+/**
+ * Testa um intervalo de instâncias contra o volume de visão
+ *
+ * Cada instância só escreve a sua distância: os intervalos são executados
+ * em paralelo, sem trava. Uma instância animada gira em torno do eixo Y
+ * local, depois da sua matriz: a esfera é trocada por uma que contém todas
+ * as posições do giro, com o centro levado ao eixo.
+ */
+static void cullInstances(void *arg, uint first, uint count)
+{
+	CullJob *job = arg;
+	StreamManager *s = job->s;
+	uint i;
+
+	for (i = first; i < first + count; ++i) {
+		const StreamChunk *c = &s->chunks[job->inst[i].prefab];
+		mat4x4 *transf = getInstanceTransformation(job->inst, i, job->count);
+		MeshletCuller culler;
+		Meshlet bound;
+
+		assert(job->inst[i].prefab < s->count);
+
+		s->distance[i] = INFINITY;
+		memset(&bound, 0, sizeof(bound));
+		memcpy(bound.center, c->center, sizeof(bound.center));
+		bound.radius = c->radius;
+		bound.coneCutoff = 1.f;
+		if ( NULL != job->animated && job->animated[i] ) {
+			bound.radius += sqrtf(c->center[0]*c->center[0] +
+					      c->center[2]*c->center[2]);
+			bound.center[0] = bound.center[2] = 0.f;
+		}
+
+		initMeshletCuller(&culler, *transf, GL_FALSE);
+		if ( !isinf(c->radius) && !meshletVisible(&culler, &bound) )
+			continue;
+		s->distance[i] = (*transf)[0][3]*bound.center[0] + (*transf)[1][3]*bound.center[1] +
+				 (*transf)[2][3]*bound.center[2] + (*transf)[3][3];
+	}
+}
+
+/**
+ * Atualiza os pedaços na memória de vídeo para o quadro atual
+ *
+ * Deve ser chamado uma vez por quadro, na thread do OpenGL, depois de
+ * atualizadas as matrizes. Um pedaço é visível se alguma das instâncias da
+ * primitiva é visível; sem instâncias, nunca é carregado. As instâncias são
+ * testadas em paralelo pelo sistema de trabalhos. Os pedaços
+ * visíveis ausentes são pedidos à
+ * thread de carga, mais próximos primeiro, reservando a memória de vídeo e
+ * removendo os menos usados recentemente quando o orçamento é ultrapassado.
+ * Os pedaços cuja cerca foi sinalizada ganham o vertex array; sem contexto
+ * compartilhado, os pedaços já lidos são enviados até o limite por quadro.
+ * Das primitivas dinâmicas, somente os intervalos alterados são enviados; a
+ * thread de carga recebe uma cópia dos pedaços pedidos, feita aqui, e por
+ * isso nenhuma alteração das malhas pode estar em andamento durante a
+ * chamada. Nunca espera pela thread de carga nem pelo driver.
+ *
+ * @param inst Instâncias desenhadas no quadro
+ * @param instanceCount Quantidade de instâncias
+ * @param animated Instâncias giradas pelo shader em torno do eixo Y local,
+ *                 como em initDrawList. Pode ser NULL
+ * @param jobs Sistema de trabalhos. Se NULL, as instâncias são testadas na
+ *             thread atual
+ */
+void updateStreaming(StreamManager *s, Instance *inst, uint instanceCount,
+		     const GLboolean *animated, JobSystem *jobs)
+{
+	StreamRequest *ready;
+	CullJob cull;
+	JobCounter culled = { 0 };
+	uint i, n, readyCount = 0;
+	size_t uploaded = 0;
+
+	assert(NULL != s);
+
+	++s->frame;
+
+	assert(NULL != inst || 0 == instanceCount);
+
+	if ( instanceCount > s->distanceCount ) {
+		free(s->distance);
+		s->distance = malloc(instanceCount*sizeof(*s->distance));
+		s->distanceCount = instanceCount;
+	}
+	cull.s = s;
+	cull.inst = inst;
+	cull.count = instanceCount;
+	cull.animated = animated;
+	parallelFor(jobs, cullInstances, &cull, instanceCount, STREAM_CULL_GRAIN,
+		    &culled, NULL);
+
+	for (i = 0; i < s->count; ++i) {
+		s->chunks[i].visible = GL_FALSE;
+		s->chunks[i].distance = INFINITY;
+	}
+	waitJobs(jobs, &culled);
+
+	// A distância de um pedaço é a da sua instância visível mais próxima
+	for (i = 0; i < instanceCount; ++i) {
+		StreamChunk *c = &s->chunks[inst[i].prefab];
+
+		if ( isinf(s->distance[i]) )
+			continue;
+		if ( s->distance[i] < c->distance )
+			c->distance = s->distance[i];
+		c->visible = GL_TRUE;
+		c->lastUsed = s->frame;
+	}
+
+	// Refaz a fila de pedidos e separa os pedaços já lidos
+	ready = malloc(s->count*sizeof(*ready));
+	pthread_mutex_lock(&s->lock);
+	s->queueCount = 0;
+	s->queueNext = 0;
+	for (i = 0; i < s->count; ++i) {
+		StreamChunk *c = &s->chunks[i];
+
+		if ( CHUNK_READY == c->state && !c->visible && NULL == c->fence ) {
+			// Saiu de vista antes do envio
+			free(c->staging);
+			free(c->elementStaging);
+			c->staging = NULL;
+			c->elementStaging = NULL;
+			c->state = CHUNK_UNLOADED;
+			releaseChunkBuffers(s, i);
+		}
+		if ( CHUNK_QUEUED == c->state && !c->visible ) {
+			free(c->staging);
+			free(c->elementStaging);
+			c->staging = NULL;
+			c->elementStaging = NULL;
+			c->state = CHUNK_UNLOADED;
+			releaseChunkBuffers(s, i);
+		}
+
+		if ( c->visible && (CHUNK_UNLOADED == c->state || CHUNK_QUEUED == c->state) ) {
+			s->queue[s->queueCount].chunk = i;
+			s->queue[s->queueCount++].distance = c->distance;
+		} else if ( CHUNK_READY == c->state ) {
+			ready[readyCount].chunk = i;
+			ready[readyCount++].distance = c->distance;
+		}
+	}
+	qsort(s->queue, s->queueCount, sizeof(*s->queue), compareRequest);
+
+	// Os pedidos novos reservam a memória, mais próximos primeiro
+	for (i = 0, n = 0; i < s->queueCount; ++i) {
+		StreamChunk *c = &s->chunks[s->queue[i].chunk];
+
+		if ( CHUNK_UNLOADED == c->state ) {
+			if ( !makeRoom(s, c) )
+				continue;
+			acquireChunkBuffers(s, s->queue[i].chunk);
+			if ( NULL != s->p[s->queue[i].chunk].dynamic )
+				snapshotDynamicChunk(&s->p[s->queue[i].chunk], c);
+			c->state = CHUNK_QUEUED;
+		}
+		s->queue[n++] = s->queue[i];
+	}
+	s->queueCount = n;
+	if ( s->queueCount > 0 )
+		pthread_cond_signal(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+
+	// A thread de carga não toca nos pedaços prontos
+	qsort(ready, readyCount, sizeof(*ready), compareRequest);
+	for (i = 0; i < readyCount; ++i) {
+		StreamChunk *c = &s->chunks[ready[i].chunk];
+		size_t size = 0;
+		double start = monotonicClock();
+		int pending;
+
+		if ( NULL != c->fence ) {
+			GLenum status = glClientWaitSync(c->fence, 0, 0);
+
+			if ( GL_ALREADY_SIGNALED != status && GL_CONDITION_SATISFIED != status )
+				continue;
+			glDeleteSync(c->fence);
+			c->fence = NULL;
+		} else {
+			size = chunkUploadSize(s, c);
+			if ( uploaded > 0 && uploaded + size > s->uploadLimit )
+				continue;
+			uploadChunk(s, ready[i].chunk);
+		}
+
+		// Os buffers compartilhados podem estar com outro pedaço
+		pthread_mutex_lock(&s->lock);
+		publishChunkBuffers(s, c);
+		pending = requireBuffer(s, ready[i].chunk, c->vertexBuffer, &size) ||
+			  requireBuffer(s, ready[i].chunk, c->elementBuffer, &size);
+		if ( !pending ) {
+			bindChunk(s, ready[i].chunk);
+			c->state = CHUNK_RESIDENT;
+		}
+		if ( size > 0 ) {
+			s->stats.uploadTime += monotonicClock() - start;
+			s->stats.uploaded += size;
+		}
+		pthread_mutex_unlock(&s->lock);
+		uploaded += size;
+	}
+	free(ready);
+
+	// As primitivas dinâmicas enviam somente o que mudou
+	for (i = 0; i < s->count; ++i) {
+		const DynamicMesh *d = s->p[i].dynamic;
+		double start;
+
+		if ( NULL == d || CHUNK_RESIDENT != s->chunks[i].state ||
+		     0 == d->vertices.count + d->indices.count )
+			continue;
+		start = monotonicClock();
+		uploaded = uploadDynamicRanges(&s->p[i]);
+		pthread_mutex_lock(&s->lock);
+		s->stats.uploaded += uploaded;
+		s->stats.uploadTime += monotonicClock() - start;
+		pthread_mutex_unlock(&s->lock);
+	}
+
+	s->stats.placeholders = 0;
+	for (i = 0; i < s->count; ++i)
+		if ( s->chunks[i].visible && CHUNK_RESIDENT != s->chunks[i].state )
+			++s->stats.placeholders;
+}
+
+/**
+ * Verifica se um pedaço pode ser desenhado
+ *
+ * @return GL_TRUE se o vertex array da primitiva está pronto
+ */
+GLboolean chunkResident(const StreamManager *s, uint position)
+{
+	assert(NULL != s);
+	assert(position < s->count);
+
+	return CHUNK_RESIDENT == s->chunks[position].state;
+}
+
+/**
+ * Grava o desenho da caixa envolvente de um pedaço ausente
+ *
+ * Não chama o OpenGL: pode ser usada pelos trabalhos, enquanto o estado dos
+ * pedaços não muda.
+ *
+ * @param transf Matriz de transformação da primitiva
+ * @param b Recebe a troca da variável, do vertex array e o desenho
+ * @param uniform Índice da variável transformation, de findUniform
+ * @param model Índice da variável model, para uma instância girada pelo
+ *              shader: a caixa vai em model, e transf em transformation.
+ *              Negativo para juntar as duas em transformation
+ */
+void recordChunkPlaceholder(const StreamManager *s, uint position,
+			    mat4x4 transf, CommandBuffer *b, int uniform,
+			    int model)
+{
+	const StreamChunk *c;
+	mat4x4 box, full;
+
+	assert(NULL != s);
+	assert(position < s->count);
+
+	c = &s->chunks[position];
+	if ( isinf(c->radius) )
+		return;
+
+	mat4x4_translate(box, c->center[0], c->center[1], c->center[2]);
+	mat4x4_scale_aniso(box, box, c->half[0], c->half[1], c->half[2]);
+	if ( model >= 0 ) {
+		recordUniformMatrix4(b, model, box);
+		recordUniformMatrix4(b, uniform, transf);
+	} else {
+		mat4x4_mul(full, transf, box);
+		recordUniformMatrix4(b, uniform, full);
+	}
+	recordBindVertexArray(b, s->placeholderVao);
+	// Os elementos da caixa ficam na memória do programa
+	recordDrawElements(b, GL_LINES,
+			   sizeof(placeholderElem)/sizeof(*placeholderElem),
+			   (GLintptr) (uintptr_t) placeholderElem);
+}
+
+/**
+ * Mostra a ocupação da memória de vídeo e os envios desde o último relatório
+ *
+ * @param elapsed Tempo desde o último relatório, em segundos
+ */
+void printStreamStats(StreamManager *s, double elapsed)
+{
+	uint i, resident = 0;
+
+	assert(NULL != s);
+
+	// A thread de carga também conta os seus envios
+	pthread_mutex_lock(&s->lock);
+	for (i = 0; i < s->count; ++i)
+		if ( CHUNK_RESIDENT == s->chunks[i].state )
+			++resident;
+
+	printf("Streaming: %u/%u pedaços, %.1f de %.1f MB, %u remoções, "
+	       "%.1f MB/s enviados (%.1f MB/s no driver), %u caixas\n",
+	       resident, s->count, s->used / (1024.*1024.),
+	       s->budget / (1024.*1024.), s->stats.evictions,
+	       s->stats.uploaded / (1024.*1024.) / (elapsed > 0. ? elapsed : 1e-9),
+	       s->stats.uploaded / (1024.*1024.) /
+	       (s->stats.uploadTime > 0. ? s->stats.uploadTime : 1e-9),
+	       s->stats.placeholders);
+
+	s->stats.evictions = 0;
+	s->stats.uploaded = 0;
+	s->stats.uploadTime = 0.;
+	pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Encerra a thread de carga e libera os buffers na memória de vídeo
+ */
+void shutdownStreaming(StreamManager *s)
+{
+	uint i;
+
+	assert(NULL != s);
+
+	pthread_mutex_lock(&s->lock);
+	s->quit = 1;
+	pthread_cond_broadcast(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+
+	if ( NULL != s->context )
+		glfwDestroyWindow(s->context);
+
+	for (i = 0; i < s->count; ++i) {
+		StreamChunk *c = &s->chunks[i];
+
+		if ( CHUNK_RESIDENT == c->state )
+			evictChunk(s, i);
+		// Enviado, mas o vertex array não chegou a ser criado
+		if ( NULL != c->fence )
+			glDeleteSync(c->fence);
+		free(c->staging);
+		free(c->elementStaging);
+	}
+	// Inclui os buffers de pedaços que não chegaram a ser residentes
+	for (i = 0; i < s->bufferCount; ++i)
+		glDeleteBuffers(1, &s->buffers[i].id);
+	glDeleteVertexArrays(1, &s->placeholderVao);
+	glDeleteBuffers(1, &s->placeholderId);
+
+	pthread_cond_destroy(&s->wake);
+	pthread_mutex_destroy(&s->lock);
+	free(s->distance);
+	free(s->queue);
+	free(s->buffers);
+	free(s->chunks);
+	memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,166 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+# include <GL/glew.h>
+# include <GLFW/glfw3.h>
+# include <stdlib.h>
+# include <stdint.h>
+# include <pthread.h>
+
+# include "linmath.h"
+# include "primitive.h"
+# include "instance.h"
+# include "jobs.h"
+# include "command.h"
+
+/**
+ * Instâncias testadas contra o volume de visão por trabalho
+ */
+#define STREAM_CULL_GRAIN	256
+
+/**
+ * Buffer de elementos de um pedaço sem faces
+ */
+#define STREAM_NO_BUFFER	((uint) -1)
+
+/**
+ * @brief Situação de um pedaço (chunk) da cena
+ *
+ * Cada primitiva é um pedaço, com o seu próprio vertex array. Os buffers na
+ * memória de vídeo são compartilhados entre pedaços de conteúdo idêntico.
+ */
+typedef enum ChunkState
+{
+	CHUNK_UNLOADED = 0,	/**< fora da memória de vídeo */
+	CHUNK_QUEUED,		/**< aguardando a thread de carga */
+	CHUNK_LOADING,		/**< sendo lido pela thread de carga */
+	CHUNK_READY,		/**< lido, aguardando o envio ao driver ou a cerca */
+	CHUNK_RESIDENT		/**< na memória de vídeo, pronto para o desenho */
+} ChunkState;
+
+/**
+ * @brief Situação de um buffer compartilhado na memória de vídeo
+ */
+typedef enum BufferState
+{
+	BUFFER_ABSENT = 0,	/**< fora da memória de vídeo */
+	BUFFER_LOADING,		/**< sendo preenchido pelo pedaço loader */
+	BUFFER_PRESENT		/**< na memória de vídeo, pronto para o desenho */
+} BufferState;
+
+/**
+ * @brief Vértices ou elementos únicos da cena
+ *
+ * Pedaços com os mesmos bytes usam o mesmo buffer. Qualquer um deles pode
+ * preenchê-lo; o buffer sai da memória de vídeo quando o último sai.
+ */
+typedef struct StreamBuffer
+{
+	BufferState	state;		/**< protegido pelo lock do StreamManager */
+	GLuint		id;		/**< nome do buffer no driver. 0 se ausente */
+	GLsizeiptr	size;		/**< bytes do conteúdo */
+	GLboolean	elements;	/**< GL_TRUE para elementos, GL_FALSE para vértices */
+	uint64_t	hash;		/**< hash do conteúdo */
+	uint		owner;		/**< primeiro pedaço com esse conteúdo */
+	uint		users;		/**< pedaços com esse conteúdo */
+	uint		refs;		/**< pedaços pedidos ou residentes que o usam */
+	uint		loader;		/**< pedaço que o preenche, em BUFFER_LOADING */
+} StreamBuffer;
+
+/**
+ * @brief Estado de um pedaço da cena
+ */
+typedef struct StreamChunk
+{
+	ChunkState	state;		/**< protegido pelo lock do StreamManager */
+	vec3		center;		/**< centro da caixa envolvente, no espaço da primitiva */
+	vec3		half;		/**< metade da caixa envolvente */
+	GLfloat		radius;		/**< raio da esfera envolvente */
+	GLsizeiptr	gpuSize;	/**< bytes ocupados na memória de vídeo */
+	GLsizeiptr	elementSize;	/**< parte de gpuSize usada pelos elementos */
+	uint		vertexBuffer;	/**< buffer compartilhado com os vértices */
+	uint		elementBuffer;	/**< buffer compartilhado com os elementos, ou STREAM_NO_BUFFER */
+	GLboolean	fillsVertices;	/**< se este pedaço preenche o buffer de vértices */
+	GLboolean	fillsElements;	/**< se este pedaço preenche o buffer de elementos */
+	GLvoid		*staging;	/**< vértices no formato de vídeo, ou a cópia dos dinâmicos. NULL se points serve */
+	GLvoid		*elementStaging;	/**< elementos de todas as faces, em sequência */
+	GLsync		fence;		/**< sinalizada quando os buffers da thread de carga estão prontos */
+	uint		lastUsed;	/**< último quadro em que esteve visível */
+	GLboolean	visible;	/**< se está visível no quadro atual */
+	GLfloat		distance;	/**< profundidade do centro no quadro atual */
+} StreamChunk;
+
+/**
+ * @brief Pedido de carga de um pedaço
+ */
+typedef struct StreamRequest
+{
+	uint		chunk;		/**< posição do pedaço */
+	GLfloat		distance;	/**< prioridade: menor primeiro */
+} StreamRequest;
+
+/**
+ * @brief Contadores do streaming, zerados a cada relatório
+ */
+typedef struct StreamStats
+{
+	uint		evictions;	/**< pedaços removidos da memória de vídeo */
+	size_t		uploaded;	/**< bytes enviados ao driver */
+	double		uploadTime;	/**< tempo gasto nos envios, em segundos */
+	uint		placeholders;	/**< pedaços substituídos no último quadro */
+} StreamStats;
+
+/**
+ * @brief Mantém na memória de vídeo somente os pedaços usados recentemente
+ *
+ * A thread de carga prepara os vértices e os elementos dos pedaços pedidos,
+ * mais próximos primeiro. Com um contexto compartilhado, ela mesma envia os
+ * buffers ao driver e publica uma cerca; a thread do OpenGL só cria o vertex
+ * array quando a cerca é sinalizada, sem nunca esperar. Sem ele, o envio
+ * acontece em updateStreaming. A memória é reservada no pedido e a remoção
+ * acontece na thread do OpenGL, respeitando o orçamento de memória de vídeo.
+ * Os buffers são contados uma única vez, por mais pedaços que os usem.
+ */
+typedef struct StreamManager
+{
+	Primitive	*p;		/**< primitivas da cena */
+	uint		count;		/**< quantidade de primitivas */
+	StreamChunk	*chunks;	/**< um pedaço por primitiva */
+	StreamBuffer	*buffers;	/**< conteúdos únicos dos pedaços */
+	uint		bufferCount;	/**< quantidade de buffers */
+	size_t		budget;		/**< bytes permitidos na memória de vídeo */
+	size_t		used;		/**< bytes em uso na memória de vídeo */
+	size_t		uploadLimit;	/**< bytes enviados por quadro, no máximo */
+	uint		frame;		/**< quadro atual */
+	StreamRequest	*queue;		/**< pedidos, do mais prioritário ao menos */
+	GLfloat		*distance;	/**< distância de cada instância no quadro. INFINITY se fora de vista */
+	uint		distanceCount;	/**< capacidade de distance */
+	uint		queueCount;	/**< quantidade de pedidos */
+	uint		queueNext;	/**< próximo pedido a ser atendido */
+	int		quit;		/**< pede o fim da thread de carga */
+	GLFWwindow	*context;	/**< contexto da thread de carga. NULL se o envio é feito no desenho */
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	wake;
+	GLuint		placeholderVao;	/**< caixa desenhada no lugar dos pedaços ausentes */
+	GLuint		placeholderId;	/**< buffer com os vértices da caixa */
+	StreamStats	stats;
+} StreamManager;
+
+int initStreaming(StreamManager *s, Primitive *p, uint count, size_t budget,
+		  size_t uploadLimit, GLFWwindow *share);
+
+void updateStreaming(StreamManager *s, Instance *inst, uint instanceCount,
+		     const GLboolean *animated, JobSystem *jobs);
+
+GLboolean chunkResident(const StreamManager *s, uint position);
+
+void recordChunkPlaceholder(const StreamManager *s, uint position,
+			    mat4x4 transf, CommandBuffer *b, int uniform,
+			    int model);
+
+void printStreamStats(StreamManager *s, double elapsed);
+
+void shutdownStreaming(StreamManager *s);
+
+#endif
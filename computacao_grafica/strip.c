@@ -0,0 +1,164 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "strip.h"
+
+/**
+ * Tamanho máximo, em elementos, do vetor gerado por stripifyTriangles
+ *
+ * No pior caso cada triângulo vira uma tira isolada de 3 elementos, mais até
+ * 3 elementos de ligação entre as tiras.
+ *
+ * @param count Quantidade de elementos da lista de triângulos
+ * @return Quantidade de elementos que o vetor de saída deve comportar
+ */
+GLuint stripMaxLength(uint count)
+{
+	return 2*count;
+}
+
+/**
+ * Procura um triângulo ainda não usado que contenha a aresta orientada u->v
+ *
+ * @return Índice do triângulo, ou -1 se não houver. Em w fica o terceiro vértice
+ */
+static int findTriangle(const GLuint *tris, const uint *offset, const uint *adj,
+			const unsigned char *used, GLuint u, GLuint v, GLuint *w)
+{
+	uint i;
+
+	for (i = offset[u]; i < offset[u + 1]; ++i) {
+		uint t = adj[i];
+		const GLuint *tri = &tris[3*t];
+
+		if ( used[t] )
+			continue;
+		if ( tri[0] == u && tri[1] == v ) {
+			*w = tri[2];
+			return t;
+		}
+		if ( tri[1] == u && tri[2] == v ) {
+			*w = tri[0];
+			return t;
+		}
+		if ( tri[2] == u && tri[0] == v ) {
+			*w = tri[1];
+			return t;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Converte uma lista de triângulos (GL_TRIANGLES) em tiras (GL_TRIANGLE_STRIP)
+ *
+ * Usa um algoritmo guloso: cada tira começa no primeiro triângulo livre e é
+ * estendida enquanto houver um vizinho livre com a orientação correta. As
+ * tiras são separadas por STRIP_RESTART_INDEX ou, se o driver não suportar
+ * primitive restart, ligadas por triângulos degenerados. A orientação dos
+ * triângulos originais é preservada.
+ *
+ * @param tris Lista de triângulos, 3 elementos por triângulo
+ * @param count Quantidade de elementos em tris
+ * @param useRestart GL_TRUE para separar as tiras com o índice de restart
+ * @param out Vetor de saída, com pelo menos stripMaxLength(count) elementos
+ * @return Quantidade de elementos escritos em out
+ */
+GLuint stripifyTriangles(const GLuint *tris, uint count, GLboolean useRestart,
+			 GLuint *out)
+{
+	uint triCount = count / 3;
+	uint vertexCount = 0;
+	uint *offset, *adj;
+	unsigned char *used;
+	GLuint n = 0;
+	uint i, t;
+
+	assert(NULL != tris);
+	assert(NULL != out);
+
+	if ( 0 == triCount )
+		return 0;
+
+	for (i = 0; i < 3*triCount; ++i)
+		if ( tris[i] >= vertexCount )
+			vertexCount = tris[i] + 1;
+
+	// Lista de triângulos incidentes em cada vértice (formato CSR)
+	offset = calloc(vertexCount + 1, sizeof(*offset));
+	adj = malloc(3*triCount*sizeof(*adj));
+	used = calloc(triCount, sizeof(*used));
+
+	for (i = 0; i < 3*triCount; ++i)
+		++offset[tris[i] + 1];
+	for (i = 0; i < vertexCount; ++i)
+		offset[i + 1] += offset[i];
+	{
+		uint *fill = malloc(vertexCount*sizeof(*fill));
+		memcpy(fill, offset, vertexCount*sizeof(*fill));
+		for (i = 0; i < 3*triCount; ++i)
+			adj[fill[tris[i]]++] = i / 3;
+		free(fill);
+	}
+
+	for (t = 0; t < triCount; ++t) {
+		const GLuint *tri = &tris[3*t];
+		GLuint x = tri[0], y = tri[1], z = tri[2], w;
+		uint k;
+
+		if ( used[t] )
+			continue;
+		used[t] = 1;
+
+		// Escolhe a rotação inicial que permite estender a tira
+		for (k = 0; k < 3; ++k) {
+			GLuint a = tri[k], b = tri[(k + 1) % 3], c = tri[(k + 2) % 3];
+			if ( findTriangle(tris, offset, adj, used, c, b, &w) >= 0 ) {
+				x = a;
+				y = b;
+				z = c;
+				break;
+			}
+		}
+
+		// Separa da tira anterior
+		if ( n > 0 ) {
+			if ( useRestart ) {
+				out[n++] = STRIP_RESTART_INDEX;
+			} else {
+				out[n] = out[n - 1];
+				++n;
+				out[n++] = x;
+				// A tira deve começar em posição par para manter a orientação
+				if ( n % 2 )
+					out[n++] = x;
+			}
+		}
+
+		out[n++] = x;
+		out[n++] = y;
+		out[n++] = z;
+
+		for (k = 1; ; ++k) {
+			GLuint u = out[n - 2], v = out[n - 1];
+			int next;
+
+			if ( k % 2 )
+				next = findTriangle(tris, offset, adj, used, v, u, &w);
+			else
+				next = findTriangle(tris, offset, adj, used, u, v, &w);
+			if ( next < 0 )
+				break;
+			used[next] = 1;
+			out[n++] = w;
+		}
+	}
+
+	free(used);
+	free(adj);
+	free(offset);
+
+	return n;
+}
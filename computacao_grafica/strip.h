@@ -0,0 +1,17 @@
+#ifndef __STRIP_H
+#define __STRIP_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+/**
+ * Índice usado para reiniciar uma tira de triângulos (primitive restart)
+ */
+#define STRIP_RESTART_INDEX	0xFFFFFFFFu
+
+GLuint stripMaxLength(uint count);
+
+GLuint stripifyTriangles(const GLuint *tris, uint count, GLboolean useRestart,
+			 GLuint *out);
+
+#endif
@@ -4,10 +4,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "shader.h"
 #include "primitive.h"
+#include "strip.h"
+#include "meshlet.h"
+#include "lod.h"
+#include "quantize.h"
+#include "vertexformat.h"
+#include "importer.h"
+#include "scenefile.h"
+#include "scenedesc.h"
+#include "stream.h"
+#include "dynamic.h"
+#include "instance.h"
+#include "procedural.h"
+#include "variant.h"
+#include "reload.h"
+#include "reflect.h"
+#include "jobs.h"
+#include "drawlist.h"
+#include "simulation.h"
+#include "command.h"
+#include "animation.h"
 #include "linmath.h"
 
 // Algumas variáveis globais
@@ -15,6 +36,32 @@ const int MAJOR = 2;
 const int MINOR = 1;
 const uint WIDTH = 800;
 const uint HEIGHT = 600;
+// Descarta faces traseiras. Desligado, pois a cena é desenhada em wireframe
+const GLboolean CULL_BACKFACES = GL_FALSE;
+// Guarda as posições em SNORM16 na memória de vídeo: metade dos bytes
+const GLboolean QUANTIZE_POSITIONS = GL_TRUE;
+// Memória máxima para uma malha importada
+const size_t MESH_BUDGET = (size_t) 4 << 30;
+// Grava as cenas com elementos e posições codificados: arquivos menores
+const GLboolean COMPRESS_SCENES = GL_TRUE;
+// Memória de vídeo para vértices e elementos. Pedaços usados há mais tempo saem antes
+const size_t GPU_BUDGET = (size_t) 256 << 20;
+// Bytes enviados ao driver por quadro, quando não há contexto compartilhado
+const size_t UPLOAD_LIMIT = (size_t) 16 << 20;
+// Intervalo entre os relatórios do streaming, em segundos
+const double STATS_INTERVAL = 5.;
+// Cópias da viga H na cena de exemplo, todas instâncias da mesma primitiva
+const uint BEAM_COUNT = 1;
+// Passos da simulação por segundo, independentes dos quadros
+const double SIMULATION_RATE = 60.;
+// Rotação das instâncias, em radianos por segundo
+const GLfloat ROTATION_SPEED = .3f;
+// Chaves por segundo das trilhas de animação
+const GLfloat ANIMATION_KEY_RATE = 30.f;
+// Gira as instâncias no shader: a CPU não recalcula as matrizes a cada passo
+const GLboolean GPU_ANIMATION = GL_TRUE;
+// Instâncias de cada buffer de comandos, gravado por uma thread
+const uint RECORD_PARTITION = 128;
 
 // Definindo algumas primitivas a ser desenhada
 
@@ -27,6 +74,15 @@ static const GLfloat prismVertex[] = {
 	0.f, 1.f, 0.f,
 };
 
+// Deslocamento do topo do prisma, usado como alvo de morph
+static const GLfloat prismApexDelta[] = {
+	0.f, 0.f, 0.f,
+	0.f, 0.f, 0.f,
+	0.f, 0.f, 0.f,
+	0.f, 0.f, 0.f,
+	0.f, .6f, 0.f,
+};
+
 static const GLuint prismElem[] = { // são 18 elementos
 	0, 1, 4,
 	1, 2, 4,
@@ -36,31 +92,20 @@ static const GLuint prismElem[] = { // são 18 elementos
 	2, 1, 0
 };
 
-// Um cubo unitário
-static const GLfloat cubeVertex[] = {
-	-1.f, -1.f, 1.f,
-	1.f, -1.f, 1.f,
-	1.f, 1.f, 1.f,
-	-1.f, 1.f, 1.f,
-	-1.f, -1.f, -1.f,
-	1.f, -1.f, -1.f,
-	1.f, 1.f, -1.f,
-	-1.f, 1.f, -1.f
-};
-
-static const GLuint cubeElem[] = {  // são 36 elementos
-	0, 1, 3,
-	3, 1, 2,
-	1, 5, 2,
-	2, 5, 6,
-	5, 4, 7,
-	7, 6, 5,
-	4, 0, 3,
-	3, 7, 4,
-	0, 4, 5,
-	5, 1, 0,
-	3, 2, 6,
-	7, 3, 6
+// Perfil da viga H, extrudado ao longo de z. Fixo, fica pronto em tempo de compilação
+static const GLfloat beamProfile[] = {
+	-2.2f, -2.f,
+	-1.8f, -2.f,
+	-1.8f, -.2f,
+	1.8f, -.2f,
+	1.8f, -2.f,
+	2.2f, -2.f,
+	2.2f, 2.f,
+	1.8f, 2.f,
+	1.8f, .2f,
+	-1.8f, .2f,
+	-1.8f, 2.f,
+	-2.2f, 2.f
 };
 
 /////////////////////////////////////////////////////////////////////////
@@ -70,138 +115,468 @@ typedef struct Parameters
 {
 	char vertex[256];
 	char fragment[256];
+	char mesh[256];	// opcional: malha OBJ ou PLY acrescentada à cena, ou cena .scn
+	char scene[256];	// descrição textual da cena, com os shaders
 } Parameters;
 
+/**
+ * @brief Programa em uso e os índices das suas variáveis
+ */
+typedef struct SceneShader
+{
+	ProgramReflection	reflection;	/**< variáveis ativas do programa */
+	int			transformation;	/**< índice da uniform transformation */
+	int			dequant;	/**< índice da uniform dequant. -1 se a variante não dequantiza */
+	int			time;		/**< índice da uniform time. -1 se a variante não anima */
+	int			spin;		/**< índice da uniform spin */
+	int			model;		/**< índice da uniform model */
+} SceneShader;
+
+/**
+ * @brief Animação da cena, avaliada a cada passo da simulação
+ */
+typedef struct SceneAnimation
+{
+	JobSystem	*jobs;
+	AnimationTrack	spin;	/**< giro em torno de y, repetido */
+	AnimationSet	set;	/**< instâncias animadas pela CPU */
+	uint		steps;	/**< passos executados */
+	GLboolean	*gpu;	/**< instâncias giradas pelo shader. NULL se nenhuma */
+	vec4		*gpuSpin;	/**< eixo e velocidade de cada instância girada pelo shader. A velocidade é sempre ROTATION_SPEED */
+} SceneAnimation;
+
+/**
+ * @brief Comandos de desenho do quadro, um buffer por parte da cena
+ */
+typedef struct SceneCommands
+{
+	CommandBuffer		*buffers;	/**< um por RECORD_PARTITION instâncias */
+	uint			partitionCount;
+	const SceneShader	*shader;
+	const DrawList		*list;
+	const Primitive		*p;
+	const StreamManager	*stream;
+	const SceneAnimation	*animation;
+} SceneCommands;
+
 
 /**
  * @brief Inicializa alguns valores no OpenGL
  */
 static void initOpenGL()
 {
-	GLuint VertexArrayID;
-
 	// preenche o frameBuffer com a seguinte cor
 	glClearColor(0.0, 0.0, 0.0, 1.0);
 	
+	// Desenha somente as arestas dos triângulos
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	
-	// Necessário para funcionar
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
+	if ( CULL_BACKFACES )
+		glEnable(GL_CULL_FACE);
 }
 
 /**
- * @brief Passa os valores de vértices para um buffer na memória de vídeo
+ * @brief Habilita o primitive restart, se suportado pelo driver
  * 
- * @param p estrutura que contem um ponteiro para o buffer e o seu tamanho total
+ * No OpenGL 3.1 o recurso faz parte do núcleo. No OpenGL 2.1 depende da
+ * extensão NV_primitive_restart.
+ * 
+ * @return GL_TRUE se o índice STRIP_RESTART_INDEX reinicia as tiras
  */
-static void loadVertexBuffer(Primitive *p)
+static GLboolean initPrimitiveRestart()
 {
-	// Cria um buffer para armazernar, na memória de Video, os pontos que definem um objeto
-	glGenBuffers(1, &p->id);
-	glBindBuffer(GL_ARRAY_BUFFER, p->id);
+	if ( GLEW_VERSION_3_1 ) {
+		glEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(STRIP_RESTART_INDEX);
+		return GL_TRUE;
+	}
 	
-	// Passa para a memória de video esses pontos
-	glBufferData(GL_ARRAY_BUFFER, p->pSize, p->points, GL_STATIC_DRAW);
+	if ( GLEW_NV_primitive_restart ) {
+		glEnableClientState(GL_PRIMITIVE_RESTART_NV);
+		glPrimitiveRestartIndexNV(STRIP_RESTART_INDEX);
+		return GL_TRUE;
+	}
 	
-	return;
+	return GL_FALSE;
 }
 
 /**
- * @brief Permite atualizar as matrizes de cada primitiva
+ * @brief Amostra o giro das instâncias em torno de y
  * 
- * Antes de renderizar uma cena, é possível atualizar as matrizes de cada
- * primitiva. Permite realizar a animação das cenas
+ * Usado somente para criar as chaves da trilha.
+ */
+static void spin(void *arg, float time, vec3 translation, quat rotation,
+		 vec3 scale)
+{
+	vec3 axis = { 0.f, 1.f, 0.f };
+	
+	// Mesmo sentido de mat4x4_rotate_Y
+	axisAngleRotation(rotation, axis, -ROTATION_SPEED*time);
+	translation[0] = translation[1] = translation[2] = 0.f;
+	scale[0] = scale[1] = scale[2] = 1.f;
+}
+
+/**
+ * @brief Duração de uma volta completa das instâncias, em segundos
+ */
+static double spinPeriod()
+{
+	return 2.*M_PI/ROTATION_SPEED;
+}
+
+/**
+ * @brief Verifica se o programa em uso calcula o giro das instâncias
+ */
+static GLboolean shaderSpins(const SceneShader *shader)
+{
+	return shader->time >= 0 && shader->spin >= 0 && shader->model >= 0;
+}
+
+/**
+ * @brief Cria a trilha do giro e liga cada instância a ela
  * 
- * @param p <i>Array</i> de primitivas
- * @param count tamanho deste array, em elementos
+ * @param phase Instante da volta em que as instâncias começam, em segundos
+ * @return 0 em caso de sucesso
  */
-static void update(Primitive *p, int count)
+static int bakeSceneAnimation(SceneAnimation *animation, Instance *inst,
+			      uint count, float phase)
 {
-	int i;
+	uint i;
+	
+	if ( bakeAnimationTrack(&animation->spin, spinPeriod(),
+				ANIMATION_KEY_RATE, GL_TRUE, spin, NULL) )
+		return -1;
+	initAnimationSet(&animation->set, &animation->spin, 1, count);
+	for (i = 0; i < count; ++i)
+		bindAnimation(&animation->set, i, i, 0, phase,
+			      *getInstanceTransformation(inst, i, count));
+	return 0;
+}
 
-	for (i = 0; i < count; ++i) {
-		mat4x4 matrix;
-		mat4x4 *tmp = getPrimitiveTransformation(p, i, count);
+/**
+ * @brief Prepara a animação das instâncias
+ * 
+ * Cada instância gira a partir da sua matriz inicial. Se o programa em uso
+ * calcula o giro, cada instância recebe somente o eixo e a velocidade, e a
+ * sua matriz não muda mais: a simulação não tem o que animar. Todas giram na
+ * mesma velocidade, ROTATION_SPEED: o tempo enviado ao shader é limitado a
+ * uma volta dessa velocidade, o que só vale para ela. Senão, o giro vem de
+ * uma trilha que cobre uma volta e se repete.
+ * 
+ * @param shader Programa em uso
+ * @return 0 em caso de sucesso
+ */
+static int initSceneAnimation(SceneAnimation *animation, JobSystem *jobs,
+			      const SceneShader *shader, Instance *inst,
+			      uint count)
+{
+	uint i;
+	
+	animation->jobs = jobs;
+	animation->steps = 0;
+	if ( shaderSpins(shader) ) {
+		animation->gpu = malloc(count*sizeof(*animation->gpu));
+		animation->gpuSpin = malloc(count*sizeof(*animation->gpuSpin));
+		for (i = 0; i < count; ++i) {
+			animation->gpu[i] = GL_TRUE;
+			// Mesmo sentido de mat4x4_rotate_Y
+			animation->gpuSpin[i][0] = 0.f;
+			animation->gpuSpin[i][1] = 1.f;
+			animation->gpuSpin[i][2] = 0.f;
+			animation->gpuSpin[i][3] = -ROTATION_SPEED;
+			// Outra velocidade exigiria limitar o tempo por instância
+			assert(2.*M_PI/fabsf(animation->gpuSpin[i][3]) == spinPeriod());
+		}
+		initAnimationSet(&animation->set, NULL, 0, 0);
+		printf("Instâncias giradas pelo shader\n");
+		return 0;
+	}
+	
+	return bakeSceneAnimation(animation, inst, count, 0.f);
+}
+
+/**
+ * @brief Executa um passo da simulação, na thread da simulação
+ * 
+ * As instâncias são as da simulação, não as desenhadas: quem desenha recebe
+ * as matrizes interpoladas entre os passos. As matrizes vêm somente do
+ * instante do passo, sem acumular erros de um passo para o outro.
+ * 
+ * @param arg Animação da cena, em SceneAnimation
+ * @param dt Duração do passo, em segundos
+ */
+static void simulate(void *arg, Instance *inst, uint count, double dt)
+{
+	SceneAnimation *animation = arg;
+	JobCounter animated = { 0 };
+	
+	++animation->steps;
+	evaluateAnimations(&animation->set, animation->steps*dt, inst, count,
+			   animation->jobs, &animated);
+	waitJobs(animation->jobs, &animated);
+}
+
+/**
+ * @brief Passa o giro das instâncias do shader para a simulação
+ * 
+ * Chamada quando um programa recarregado não tem mais as variáveis do giro.
+ * As instâncias continuam do ponto da volta em que o shader as deixou, e o
+ * giro não volta mais ao shader, mesmo que uma recarga seguinte as devolva.
+ * 
+ * @param sim Recebe a simulação, que ainda não foi iniciada
+ * @param inst Instâncias desenhadas, ainda nas matrizes iniciais
+ */
+static void leaveShaderAnimation(SceneAnimation *animation, Simulation *sim,
+				 Instance *inst, uint count)
+{
+	JobCounter evaluated = { 0 };
+	
+	memset(animation->gpu, 0, count*sizeof(*animation->gpu));
+	if ( bakeSceneAnimation(animation, inst, count,
+				fmod(glfwGetTime(), spinPeriod())) ) {
+		printf("Memória insuficiente: as instâncias param de girar\n");
+		return;
+	}
+	// Até o primeiro passo, a simulação mostra a pose do instante atual
+	evaluateAnimations(&animation->set, 0., inst, count, animation->jobs,
+			   &evaluated);
+	waitJobs(animation->jobs, &evaluated);
+	startSimulation(sim, inst, count, SIMULATION_RATE, simulate, animation);
+	printf("Instâncias giradas pela CPU\n");
+}
+
+/**
+ * @brief Anima o topo do prisma
+ * 
+ * Somente o vértice do topo muda a cada quadro. Os demais vértices e os
+ * elementos não são reenviados ao driver. Executado como um trabalho de um
+ * único item, em paralelo com a atualização das instâncias
+ * 
+ * @param arg Malha dinâmica do prisma
+ */
+static void deform(void *arg, uint first, uint count)
+{
+	DynamicMesh *prism = arg;
+	const GLfloat *deltas[] = { prismApexDelta };
+	GLfloat weight = .5f*(1.f + sinf(glfwGetTime()));
+	
+	blendMorphTargets(prism, prismVertex, deltas, &weight, 1, 4, 1);
+}
+
+/**
+ * @brief Cria as instâncias da cena de exemplo
+ * 
+ * Cada primitiva aparece uma vez, na posição definida em createScene. A viga H
+ * se repete BEAM_COUNT vezes: as cópias usam a mesma primitiva, com as mesmas
+ * faces e os mesmos buffers na memória de vídeo.
+ * 
+ * @param p Primitivas criadas por createScene
+ * @param count Quantidade de primitivas
+ * @param instanceCount Recebe a quantidade de instâncias
+ */
+static Instance* instantiateScene(Primitive *p, uint count, uint *instanceCount)
+{
+	const uint vigaH = 1;
+	Instance *inst;
+	uint i;
+	
+	*instanceCount = count + BEAM_COUNT - 1;
+	inst = createInstances(*instanceCount);
+	for (i = 0; i < count; ++i)
+		setInstance(inst, i, *instanceCount, i,
+			    *getPrimitiveTransformation(p, i, count));
+	
+	// As cópias ficam em diagonal, a partir da original
+	for (i = 1; i < BEAM_COUNT; ++i) {
+		mat4x4 shift, matrix;
+		
+		mat4x4_translate(shift, .25f*i, -.25f*i, 0.f);
+		mat4x4_mul(matrix, shift, *getPrimitiveTransformation(p, vigaH, count));
+		setInstance(inst, count + i - 1, *instanceCount, vigaH, matrix);
+	}
+	return inst;
+}
+
+/**
+ * @brief Grava os comandos de desenho de algumas partes da cena
+ * 
+ * Executado pelo sistema de trabalhos, depois que os pacotes estão prontos e
+ * o streaming decidiu o que está na memória de vídeo. Cada parte tem o seu
+ * buffer: as threads não dividem nada, e nenhuma chama o OpenGL.
+ * 
+ * Primitivas que ainda não estão na memória de vídeo são substituídas pela
+ * sua caixa envolvente.
+ * 
+ * Com a variante QUANTIZED do shader, a dequantização das posições é feita
+ * pelo shader e enviada somente quando a primitiva muda. Sem ela, já está na
+ * matriz de cada pacote.
+ * 
+ * @param arg Comandos do quadro, em SceneCommands
+ * @param first Primeira parte
+ * @param count Quantidade de partes
+ */
+static void record(void *arg, uint first, uint count)
+{
+	SceneCommands *commands = arg;
+	const DrawList *list = commands->list;
+	const SceneShader *shader = commands->shader;
+	const SceneAnimation *animation = commands->animation;
+	const vec4 still = { 0.f, 1.f, 0.f, 0.f };
+	mat4x4 identity;
+	uint n, i, j, k, packets;
+	
+	mat4x4_identity(identity);
+	
+	for (n = first; n < first + count; ++n) {
+		CommandBuffer *b = &commands->buffers[n];
+		uint last = (n + 1)*RECORD_PARTITION;
+		// Cada parte começa sem saber o vertex array das anteriores
+		GLuint vao = 0;
 		
-		mat4x4_rotate_Y(matrix, *tmp, 0.005);
-		setPrimitiveTransformation(p, i, count, matrix);
+		if ( last > list->instanceCount )
+			last = list->instanceCount;
+		resetCommandBuffer(b);
+		for (i = n*RECORD_PARTITION; i < last; ++i) {
+			const Instance *in = &list->inst[i];
+			const Primitive *prefab = &commands->p[in->prefab];
+			const DrawPacket *pk;
+			GLboolean resident = chunkResident(commands->stream, in->prefab);
+			GLboolean spinning = shaderSpins(shader) &&
+					     NULL != animation->gpu && animation->gpu[i];
+			
+			// Sem giro, model e spin não mudam nada. Gravados somente se a
+			// variante anima
+			if ( !spinning ) {
+				recordUniformMatrix4(b, shader->model, identity);
+				recordUniformVec4(b, shader->spin, still);
+			}
+			if ( !resident ) {
+				// A caixa não é quantizada
+				recordUniformMatrix4(b, shader->dequant, identity);
+				// Girada como a instância, a caixa fica em model
+				if ( spinning )
+					recordUniformVec4(b, shader->spin,
+							  animation->gpuSpin[i]);
+				recordChunkPlaceholder(commands->stream, in->prefab,
+						       (vec4 *) in->transf, b,
+						       shader->transformation,
+						       spinning ? shader->model : -1);
+				vao = 0;
+				continue;
+			}
+			
+			// O vertex array já sabe como acessar os dados na memória de
+			// video. Instâncias seguidas da mesma primitiva não o trocam
+			if ( prefab->vao != vao ) {
+				vao = prefab->vao;
+				recordBindVertexArray(b, vao);
+				recordUniformMatrix4(b, shader->dequant,
+						     (vec4 *) prefab->dequant);
+			}
+			
+			// Girada pelo shader, a instância envia somente a matriz de
+			// repouso; a de cada face fica em model
+			if ( spinning ) {
+				recordUniformVec4(b, shader->spin, animation->gpuSpin[i]);
+				recordUniformMatrix4(b, shader->transformation,
+						     (vec4 *) in->transf);
+			}
+			
+			pk = getInstancePackets(list, i, &packets);
+			for (j = 0; j < packets; ++j, ++pk) {
+				if ( 0 == pk->rangeCount )
+					continue;
+				if ( spinning ) {
+					mat4x4 model;
+					
+					if ( shader->dequant < 0 )
+						mat4x4_mul(model, pk->face->transf,
+							   (vec4 *) prefab->dequant);
+					else
+						mat4x4_dup(model, pk->face->transf);
+					recordUniformMatrix4(b, shader->model, model);
+				} else
+					recordUniformMatrix4(b, shader->transformation,
+							     (vec4 *) pk->transf);
+				for (k = 0; k < pk->rangeCount; ++k) {
+					const DrawRange *r = &list->ranges[pk->firstRange + k];
+					recordDrawElements(b, pk->face->mode, r->count,
+							   r->offset);
+				}
+			}
+		}
 	}
 }
 
 /**
  * @brief Renderiza a cena, quadro a quadro
  * 
- * Permite a renderização da cena, quadro a quadro, de um array de primitivas.
- * Note que as matrizes de transformação são aplicadas, tanto para as definidas
- * na estrutura FACE, quanto as definidas de modo mais global, ou seja, na
- * estrutura PRIMITIVE
+ * Os comandos já foram gravados pelos trabalhos: aqui ficam somente as
+ * chamadas ao OpenGL, na thread do contexto, parte por parte, na ordem das
+ * instâncias. Valores iguais aos já enviados não chegam ao driver. O nível de
+ * detalhe escolhido para cada face também volta às faces aqui, em série, pois
+ * instâncias da mesma primitiva dividem as faces
  * 
- * @param transf Identificador da variável transformation no shader vertex
- * @param p Array de primitivas que deve ser renderizada
- * @param count Quantidade de elementos do array
+ * @param shader Programa em uso
+ * @param commands Comandos gravados por record
+ * @param stream Streaming das primitivas
  */
-static void render(GLuint transf, Primitive *p, int count)
+static void render(SceneShader *shader, const SceneCommands *commands,
+		   const StreamManager *stream)
 {
-	int i, j;
+	const DrawList *list = commands->list;
+	uint i, j, packets;
 	
 	// Clear frameBuffer
 	glClear(GL_COLOR_BUFFER_BIT);
-
-	glEnableVertexAttribArray(0);
 	
-	for (i = 0; i < count; ++i) {
-		mat4x4 *pMatrix = getPrimitiveTransformation(p, i, count);
-
-		glBindBuffer(GL_ARRAY_BUFFER, p[i].id);
-	
-		// Como acessar os dados que estão na memória de video
-		glVertexAttribPointer(
-			0, 		// location 0 in vertex program
-			3, 		// cada vertex possui 3 pontos
-			GL_FLOAT,	// tipo dos pontos
-			GL_FALSE,	// não normalizar
-			0, 		// pontos estão sem folgas entre eles
-			(GLvoid *) 0 	// sem offset inicial
-		);
-	
-		// Desenha a primitiva
-		for (j = 0; j < p[i].faceCount; ++j)  {
-			assert(NULL != p[i].faceArray);
-			mat4x4 tmp;
-			
-			mat4x4_mul(tmp, *pMatrix, p[i].faceArray[j].transf);
-			glUniformMatrix4fv(transf, 1, GL_FALSE, 
-					   (GLfloat*) tmp);
-			glDrawElements(
-//				GL_TRIANGLES,
-				GL_LINE_LOOP,
-				p[i].faceArray[j].count,
-				GL_UNSIGNED_INT,
-				p[i].faceArray[j].face
-			);
-		}
+	// O único valor do giro que muda a cada quadro. Limitado a uma volta,
+	// para não perder a precisão do float com o tempo: todas as instâncias
+	// giram em ROTATION_SPEED, e a volta de uma é a de todas
+	setUniformFloat(&shader->reflection, shader->time,
+			fmod(glfwGetTime(), spinPeriod()));
+	
+	for (i = 0; i < list->instanceCount; ++i) {
+		const DrawPacket *pk;
+		
+		if ( !chunkResident(stream, list->inst[i].prefab) )
+			continue;
+		pk = getInstancePackets(list, i, &packets);
+		for (j = 0; j < packets; ++j, ++pk)
+			pk->face->lodCurrent = pk->lod;
 	}
 	
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glDisableVertexAttribArray(0);
+	replayCommandBuffers(commands->buffers, commands->partitionCount,
+			     &shader->reflection);
+	glBindVertexArray(0);
 }
 
 
 static void printHelp(int argc, char **argv)
 {
 	printf("Uso:\n");
-	printf("%s <programa vertex> <programa fragment>\n", argv[0]);
+	printf("%s <programa vertex> <programa fragment> [malha .obj ou .ply, ou cena .scn]\n", argv[0]);
+	printf("%s <cena .scene>\n", argv[0]);
 }
 
 
 static int parseParameters(int argc, char **argv, Parameters *params)
 {
-	if ( argc != 3 ) {
+	if ( argc < 2 || argc > 4 || (2 == argc && !isSceneDescription(argv[1])) ) {
 		printHelp(argc, argv);
 		return -1;
 	}
-	strncpy(params->vertex, argv[1], 256);
-	strncpy(params->fragment, argv[2], 256);
+	params->scene[0] = '\0';
+	params->mesh[0] = '\0';
+	if ( 2 == argc ) {
+		// Os shaders vêm da própria descrição
+		snprintf(params->scene, sizeof(params->scene), "%s", argv[1]);
+		return 0;
+	}
+	snprintf(params->vertex, sizeof(params->vertex), "%s", argv[1]);
+	snprintf(params->fragment, sizeof(params->fragment), "%s", argv[2]);
+	if ( 4 == argc )
+		snprintf(params->mesh, sizeof(params->mesh), "%s", argv[3]);
 	return 0;
 }
 
@@ -233,30 +608,171 @@ static GLFWwindow* initWindow(int argc, char *argv[], Parameters *params)
 	return glfwCreateWindow(WIDTH, HEIGHT, "Primeiro Programa em OpenGL", NULL, NULL);
 }
 
+/**
+ * @brief Ativa a variante dos shaders usada pela cena
+ * 
+ * Chamada na preparação e a cada recarga dos shaders: as variáveis mudam
+ * com o programa. Os nomes são procurados somente aqui.
+ * 
+ * @param variants Variantes dos shaders
+ * @param shader Recebe o programa em uso e as suas variáveis. A reflexão do
+ *               programa anterior é liberada
+ * @return 0 em caso de sucesso
+ */
+static int useVariant(ShaderVariants *variants, SceneShader *shader)
+{
+	GLuint programa;
+	uint features = 0;
+	
+	if ( QUANTIZE_POSITIONS )
+		features |= SHADER_QUANTIZED;
+	if ( GPU_ANIMATION )
+		features |= SHADER_ANIMATED;
+	programa = getShaderVariant(variants, features);
+	if ( 0 == programa ) {
+		printf("Erro na instalação dos shaders\n");
+		return -1;
+	}
+	runProgram(programa);
+	
+	releaseProgramReflection(&shader->reflection);
+	if ( reflectProgram(&shader->reflection, programa) )
+		return -1;
+	shader->transformation = findUniform(&shader->reflection, "transformation");
+	shader->dequant = findUniform(&shader->reflection, "dequant");
+	shader->time = findUniform(&shader->reflection, "time");
+	shader->spin = findUniform(&shader->reflection, "spin");
+	shader->model = findUniform(&shader->reflection, "model");
+	return 0;
+}
+
 /**
  * @brief Inicializa os buffers e instala os shaders
  * 
- * Transfere as primitivas para a memória de vídeo, instala os shaders e
- * inicializa o programa correspondente
+ * Instala a variante dos shaders usada pela cena, inicializa o programa
+ * correspondente e inicia o streaming das primitivas para a memória de
+ * vídeo. Nenhuma primitiva é enviada aqui: as visíveis chegam nos primeiros
+ * quadros.
+ * 
+ * Os vértices e os elementos são enviados por uma thread de carga, com um
+ * contexto compartilhado com a janela. Se a primitiva usa posições
+ * quantizadas, a conversão é feita por essa thread e somente a versão
+ * quantizada é enviada. O vertex array de cada primitiva é criado no desenho,
+ * com os atributos configurados a partir do formato dos vértices.
+ * 
+ * Os códigos fonte dos shaders passam a ser observados: quando gravados, as
+ * variantes são recompiladas em segundo plano. Sem a recarga, a cena é
+ * desenhada normalmente.
  * 
  * @param params Estrutura que contêm os nomes dos shaders, no sistema de arquivo
- * @param transf Identificador usado para acessar a variável transformation
- *               dentro do shader vertex
+ * @param variants Recebe as variantes dos shaders
+ * @param reload Recebe o estado da recarga dos shaders
+ * @param shader Recebe o programa em uso e as suas variáveis
  * @param p Array de primitivas que devem ser passadas para a memória de video
  * @param count Quantidade de elementos neste array
+ * @param window Janela cujo contexto é compartilhado com a thread de carga
+ * @param stream Recebe o estado do streaming
+ * @return 0 em caso de sucesso
  */
-static void prepare(Parameters *params, GLint *transf, Primitive *p, uint count)
+static int prepare(Parameters *params, ShaderVariants *variants,
+		   ShaderReload *reload, SceneShader *shader, Primitive *p,
+		   uint count, GLFWwindow *window, StreamManager *stream)
 {
-	GLuint programa;
-	int i;
+	if ( initShaderVariants(variants, params->vertex, params->fragment) ||
+	     useVariant(variants, shader) )
+		return -1;
 	
-	programa = installShaders(params->vertex, params->fragment);
-	runProgram(programa);
+	if ( initStreaming(stream, p, count, GPU_BUDGET, UPLOAD_LIMIT, window) ) {
+		printf("Erro ao iniciar o streaming da cena\n");
+		return -1;
+	}
+	startShaderReload(reload, variants, window);
+	return 0;
+}
+
+/**
+ * @brief Cria a cena de exemplo
+ * 
+ * A cena possui um prisma e uma viga H. Se uma malha OBJ ou PLY foi
+ * informada, ela é importada, acrescentada à cena e a cena completa é gravada
+ * em formato binário, ao lado da malha.
+ * 
+ * @param params Estrutura que contêm o nome da malha, se houver
+ * @param jobs Sistema de trabalhos, usado na importação e na geração das formas
+ * @param mesh Recebe a malha importada. Deve continuar válida enquanto a cena
+ *             for usada
+ * @param shapes Recebe as formas geradas. Deve continuar válido enquanto a
+ *               cena for usada
+ * @param count Recebe a quantidade de primitivas da cena
+ * @return Array de primitivas
+ */
+static Primitive* createScene(const Parameters *params, JobSystem *jobs,
+				MeshData *mesh, ShapeBatch *shapes, uint *count)
+{
+	const ShapeDesc beam = {
+		SHAPE_EXTRUSION, 0, 0, 0.f, beamProfile,
+		sizeof(beamProfile) / (2*sizeof(*beamProfile))
+	};
+	Primitive *p;
+	Faces *f;
+	mat4x4 matrix;
+	char name[sizeof(params->mesh) + sizeof(SCENE_EXTENSION)];
 	
-	*transf = glGetUniformLocation(programa, "transformation");
+	*count = 2;
 	
-	for (i = 0; i < count; ++i)
-		loadVertexBuffer(&p[i]);
+	// Exemplo de criação de primitivas mais complexas
+	const uint vigaH = 1;
+	const uint prism = 0;
+	
+	const uint imported = 2;
+
+	if ( '\0' != params->mesh[0] && 0 == importMesh(params->mesh, MESH_BUDGET, jobs, mesh) )
+		*count = 3;
+
+	p = createPrimitive(*count);
+	
+	mat4x4 *tmp;
+	
+	// Inicializando o prisma
+	setPrimitiveBuffer(p, prism, *count, prismVertex, sizeof(prismVertex));
+	tmp = getPrimitiveTransformation(p, prism, *count);
+	mat4x4_scale_aniso(matrix, *tmp, .3, .3, .3);
+	mat4x4_translate_in_place(matrix, 0.f, 1.2f, 0.f);
+	setPrimitiveTransformation(p, prism, *count, matrix);
+
+	initPrimitiveFaceArray(p, prism, *count, 1);
+	f = getPrimitiveFaceElement(p, prism, *count, 0);
+	initFace(f);
+	setFace(f, prismElem, 18);
+	
+	// Inicializando a viga H, um perfil extrudado
+	generateShapes(&beam, 1, jobs, shapes);
+	loadPrimitiveFromShape(p, vigaH, *count, shapes, 0);
+	mat4x4_scale_aniso(matrix, *getPrimitiveTransformation(p, vigaH, *count), .3, .3, .3);
+	setPrimitiveTransformation(p, vigaH, *count, matrix);
+	
+	f = getPrimitiveFaceElement(p, vigaH, *count, 0);
+	mat4x4_scale_aniso(matrix, f->transf, 1.f, 1.f, 2.f);
+	setFaceTransformation(f, matrix);
+	
+	// Inicializando a malha importada, ajustada para caber na janela
+	if ( *count > imported ) {
+		mat4x4 box, fit, half;
+		
+		loadPrimitiveFromMesh(p, imported, *count, mesh);
+		computeQuantization(mesh->vertices, 3, mesh->vertexCount, box);
+		mat4x4_invert(fit, box);
+		mat4x4_identity(half);
+		mat4x4_scale_aniso(half, half, .5f, .5f, .5f);
+		mat4x4_mul(matrix, half, fit);
+		setPrimitiveTransformation(p, imported, *count, matrix);
+		
+		// Na próxima execução, a cena pode ser carregada sem interpretar a malha
+		snprintf(name, sizeof(name), "%s" SCENE_EXTENSION, params->mesh);
+		saveScene(name, p, *count, COMPRESS_SCENES, NULL);
+	}
+	
+	return p;
 }
 
 int main(int argc, char *argv[])
@@ -265,14 +781,31 @@ int main(int argc, char *argv[])
 	int result = EXIT_SUCCESS;
 	Parameters params;
 	Primitive *p;
-	GLint transformation;
+	SceneShader shader = { { 0 } };
 	mat4x4 scale = { {0.5f, 0, 0, 0.3},
 			 {0, 0.5f, 0, 0.4},
 			 {0, 0, 1, 0},
 			 {0, 0, 0, 1}
 			};
-	Faces *f;
-	mat4x4 matrix;
+	GLboolean restart;
+	MeshData mesh = { NULL };
+	SceneFile scene = { NULL };
+	SceneDescription desc = { NULL };
+	ShapeBatch shapes = { NULL };
+	StreamManager stream;
+	ShaderVariants variants = { "" };
+	ShaderReload reload = { NULL };
+	Simulation sim = { NULL };
+	SceneAnimation animation = { NULL };
+	JobSystem jobs = { 0 };
+	DrawList list = { NULL };
+	SceneCommands commands = { NULL };
+	DynamicMesh *prism = NULL;
+	Instance *inst = NULL;
+	uint instanceCount;
+	double lastStats;
+	uint count;
+	int i;
 
 	glfwInit();
 	window = initWindow(argc, argv, &params);
@@ -290,68 +823,131 @@ int main(int argc, char *argv[])
 	
 	// Inicializa o OpenGL
 	initOpenGL();
+	restart = initPrimitiveRestart();
+	// Um único conjunto de threads, da importação ao desenho
+	initJobSystem(&jobs, 0);
 	
 /////////////////////////////////////////////////////////////////////////
 	
-	// Exemplo de criação de primitivas mais complexas
-	const uint vigaH = 1;
-	const uint prism = 0;
-	
-	const uint vigaH_centro = 0;
-	const uint vigaH_esquerda = 1;
-	const uint vigaH_direita = 2;
-
-	p = createPrimitive(2);
-	
-	mat4x4 *tmp;
-	
-	// Inicializando o prisma
-	setPrimitiveBuffer(p, prism, 2, prismVertex, sizeof(prismVertex));
-	tmp = getPrimitiveTransformation(p, prism, 2);
-	mat4x4_scale_aniso(matrix, *tmp, .3, .3, .3);
-	mat4x4_translate_in_place(matrix, 0.f, 1.2f, 0.f);
-	setPrimitiveTransformation(p, prism, 2, matrix);
-
-	initPrimitiveFaceArray(p, prism, 2, 1);
-	f = getPrimitiveFaceElement(p, prism, 2, 0);
-	initFace(f);
-	setFace(f, prismElem, 18);
-	
-	// Inicializando a viga H
-	setPrimitiveBuffer(p, vigaH, 2, cubeVertex, sizeof(cubeVertex));
-	initPrimitiveFaceArray(p, vigaH, 2, 3);
-	mat4x4_scale_aniso(matrix, *getPrimitiveTransformation(p, vigaH, 2), .3, .3, .3);
-	setPrimitiveTransformation(p, vigaH, 2, matrix);
-	
-	f = getPrimitiveFaceElement(p, vigaH, 2, vigaH_centro);
-	initFace(f);
-	setFace(f, cubeElem, 36);
-	mat4x4_scale_aniso(matrix, f->transf, 2.f, 0.2, 2.f);
-	setFaceTransformation(f, matrix);
+	// Uma cena descrita em texto traz também os shaders
+	if ( '\0' != params.scene[0] ) {
+		if ( loadSceneDescription(params.scene, MESH_BUDGET, COMPRESS_SCENES,
+					  &jobs, &desc) ) {
+			shutdownJobSystem(&jobs);
+			glfwTerminate();
+			return EXIT_FAILURE;
+		}
+		if ( '\0' == desc.vertex[0] ) {
+			printf("A cena %s não define os shaders\n", params.scene);
+			destroyPrimitive(desc.primitives, desc.count);
+			releaseSceneDescription(&desc);
+			shutdownJobSystem(&jobs);
+			glfwTerminate();
+			return EXIT_FAILURE;
+		}
+		p = desc.primitives;
+		count = desc.count;
+		snprintf(params.vertex, sizeof(params.vertex), "%s", desc.vertex);
+		snprintf(params.fragment, sizeof(params.fragment), "%s", desc.fragment);
+	// Uma cena gravada é carregada diretamente do arquivo, sem interpretação
+	} else if ( isSceneFile(params.mesh) ) {
+		p = loadScene(params.mesh, &scene, &count);
+		if ( NULL == p ) {
+			shutdownJobSystem(&jobs);
+			glfwTerminate();
+			return EXIT_FAILURE;
+		}
+	} else {
+		p = createScene(&params, &jobs, &mesh, &shapes, &count);
+		// O topo do prisma é animado
+		prism = makePrimitiveDynamic(p, 0, count);
+		inst = instantiateScene(p, count, &instanceCount);
+	}
 	
-	f = getPrimitiveFaceElement(p, vigaH, 2, vigaH_direita);
-	initFace(f);
-	setFace(f, cubeElem, 36);
-	mat4x4_scale_aniso(matrix, f->transf, 0.2f, 2.f, 2.f);
-	mat4x4_translate_in_place(matrix, 10.f, 0.f, 0.f);
-	setFaceTransformation(f, matrix);
+	// Sem instâncias definidas, cada primitiva aparece uma vez
+	if ( NULL == inst ) {
+		inst = instantiatePrimitives(p, count);
+		instanceCount = count;
+	}
 	
-	f = getPrimitiveFaceElement(p, vigaH, 2, vigaH_esquerda);
-	initFace(f);
-	setFace(f, cubeElem, 36);
-	mat4x4_scale_aniso(matrix, f->transf, 0.2f, 2.f, 2.f);
-	mat4x4_translate_in_place(matrix, -10.f, 0.f, 0.f);
-	setFaceTransformation(f, matrix);
+	// Faces grandes ganham níveis de detalhe e são divididas em meshlets,
+	// descartados individualmente. As demais são agrupadas em tiras: menos
+	// elementos e menos desenhos
+	for (i = 0; i < count; ++i) {
+		if ( QUANTIZE_POSITIONS )
+			setPrimitiveQuantization(p, i, count, GL_SHORT);
+		buildPrimitiveLods(p, i, count, LOD_MAX_LEVELS);
+		buildPrimitiveMeshlets(p, i, count, MESHLET_MAX_VERTICES,
+				       MESHLET_MAX_TRIANGLES);
+		optimizePrimitiveStrips(p, i, count, restart);
+	}
 	
 /////////////////////////////////////////////////////////////////////////
 	
-	prepare(&params, &transformation, p, 2);
+	if ( prepare(&params, &variants, &reload, &shader, p, count, window,
+		     &stream) ) {
+		result = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if ( initSceneAnimation(&animation, &jobs, &shader, inst, instanceCount) ) {
+		shutdownStreaming(&stream);
+		result = EXIT_FAILURE;
+		goto cleanup;
+	}
+	initDrawList(&list, p, inst, instanceCount, animation.gpu);
+	commands.partitionCount = (instanceCount + RECORD_PARTITION - 1)/RECORD_PARTITION;
+	commands.buffers = calloc(commands.partitionCount, sizeof(*commands.buffers));
+	commands.shader = &shader;
+	commands.list = &list;
+	commands.p = p;
+	commands.stream = &stream;
+	commands.animation = &animation;
+	// A simulação segue o seu relógio, sem esperar pelos quadros. Com todas
+	// as instâncias giradas pelo shader, as matrizes não mudam
+	if ( animation.set.count > 0 )
+		startSimulation(&sim, inst, instanceCount, SIMULATION_RATE,
+				simulate, &animation);
+	lastStats = glfwGetTime();
 	
 	// Entra em loop até receber um comando de termino
 	while (!glfwWindowShouldClose(window))
 	{
-		update(p, 2);
-		render(transformation, p, 2);
+		JobCounter updated = { 0 }, built = { 0 }, recorded = { 0 };
+		
+		// Programas recarregados entram somente entre os quadros
+		if ( swapReloadedShaders(&reload) ) {
+			useVariant(&variants, &shader);
+			if ( NULL != animation.gpu && 0 == animation.set.count &&
+			     !shaderSpins(&shader) )
+				leaveShaderAnimation(&animation, &sim, inst,
+						     instanceCount);
+		}
+		
+		if ( animation.set.count > 0 )
+			interpolateInstances(&sim, inst, &jobs, &updated);
+		if ( NULL != prism )
+			runJob(&jobs, deform, prism, &updated, NULL);
+		// Os pacotes dependem somente das matrizes: são montados enquanto o
+		// streaming é atualizado
+		buildDrawList(&list, &jobs, shader.dequant < 0, CULL_BACKFACES, HEIGHT,
+			      &built, &updated);
+		waitJobs(&jobs, &updated);
+		updateStreaming(&stream, inst, instanceCount, animation.gpu, &jobs);
+		// Com o streaming decidido, os comandos são gravados em paralelo
+		parallelFor(&jobs, record, &commands, commands.partitionCount, 1,
+			    &recorded, &built);
+		waitJobs(&jobs, &recorded);
+		render(&shader, &commands, &stream);
+		
+		if ( glfwGetTime() - lastStats >= STATS_INTERVAL ) {
+			printStreamStats(&stream, glfwGetTime() - lastStats);
+			printf("Uniforms: %u enviadas, %u iguais às anteriores\n",
+			       shader.reflection.uploads, shader.reflection.skipped);
+			shader.reflection.uploads = shader.reflection.skipped = 0;
+			printf("Simulação: %u passos, %u descartados por atraso\n",
+			       sim.steps, sim.dropped);
+			lastStats = glfwGetTime();
+		}
 
 		// Troca os buffers
 		glfwSwapBuffers(window);
@@ -360,7 +956,27 @@ int main(int argc, char *argv[])
 		glfwPollEvents();
 	}
 
-	destroyPrimitive(p, 1);
+	shutdownStreaming(&stream);
+cleanup:
+	stopSimulation(&sim);
+	releaseAnimationSet(&animation.set);
+	releaseAnimationTrack(&animation.spin);
+	free(animation.gpu);
+	free(animation.gpuSpin);
+	shutdownJobSystem(&jobs);
+	for (i = 0; i < commands.partitionCount; ++i)
+		releaseCommandBuffer(&commands.buffers[i]);
+	free(commands.buffers);
+	releaseDrawList(&list);
+	destroyInstances(inst);
+	destroyPrimitive(p, count);
+	releaseMesh(&mesh);
+	releaseShapes(&shapes);
+	closeScene(&scene);
+	releaseSceneDescription(&desc);
+	stopShaderReload(&reload);
+	releaseProgramReflection(&shader.reflection);
+	destroyShaderVariants(&variants);
 	glfwTerminate();
 	return result;
 }
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "shader.h"
+#include "variant.h"
+
+/**
+ * Tamanho máximo das diretivas inseridas em uma variante
+ */
+#define VARIANT_DEFINES_MAX	256
+
+/**
+ * Versão GLSL usada nos códigos fonte
+ *
+ * A maior entre 330, 140 e 120 aceita pelo contexto. Os códigos usam
+ * __VERSION__ para escolher entre attribute e in, e entre gl_FragColor e
+ * uma saída declarada.
+ */
+static uint contextVersion()
+{
+	const char *s = (const char *) glGetString(GL_SHADING_LANGUAGE_VERSION);
+	uint major = 1, minor = 20, version;
+
+	if ( NULL != s )
+		sscanf(s, "%u.%u", &major, &minor);
+	version = 100*major + minor;
+	if ( version >= 330 )
+		return 330;
+	if ( version >= 140 )
+		return 140;
+	return 120;
+}
+
+/**
+ * Diretivas de uma combinação de recursos
+ */
+static void buildDefines(const ShaderVariants *v, uint features, char *out)
+{
+	out[0] = '\0';
+	if ( features & SHADER_INSTANCING )
+		strcat(out, "#define INSTANCING 1\n");
+	if ( features & SHADER_QUANTIZED )
+		strcat(out, "#define QUANTIZED 1\n");
+	if ( features & SHADER_UBO_TRANSFORMS ) {
+		// Uniform blocks só fazem parte da linguagem a partir da 1.40
+		if ( v->version < 140 )
+			strcat(out, "#extension GL_ARB_uniform_buffer_object : require\n");
+		strcat(out, "#define UBO_TRANSFORMS 1\n");
+	}
+	if ( features & SHADER_ANIMATED )
+		strcat(out, "#define ANIMATED 1\n");
+}
+
+/**
+ * Prepara as variantes de um par de códigos fonte
+ *
+ * Nenhum programa é compilado aqui. Deve ser chamada com o contexto OpenGL
+ * atual, que define a versão GLSL e os recursos disponíveis.
+ *
+ * @param vertex Código fonte do shader vertex, no sistema de arquivo
+ * @param fragment Código fonte do shader fragment, no sistema de arquivo
+ * @return 0 em caso de sucesso
+ */
+int initShaderVariants(ShaderVariants *v, const char *vertex,
+		       const char *fragment)
+{
+	assert(NULL != v);
+	assert(NULL != vertex && NULL != fragment);
+
+	memset(v, 0, sizeof(*v));
+	if ( strlen(vertex) >= VARIANT_NAME_MAX || strlen(fragment) >= VARIANT_NAME_MAX ) {
+		printf("Nome de shader muito longo\n");
+		return -1;
+	}
+	strcpy(v->vertex, vertex);
+	strcpy(v->fragment, fragment);
+
+	v->version = contextVersion();
+	v->supported = SHADER_QUANTIZED | SHADER_ANIMATED;
+	if ( GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays )
+		v->supported |= SHADER_INSTANCING;
+	if ( GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object )
+		v->supported |= SHADER_UBO_TRANSFORMS;
+	return 0;
+}
+
+/**
+ * Remove da máscara os recursos que o contexto não oferece
+ *
+ * O programa fica com o caminho mais rápido disponível, e o código que o
+ * usa deve consultar a máscara devolvida.
+ */
+uint supportedShaderFeatures(const ShaderVariants *v, uint features)
+{
+	assert(NULL != v);
+	return features & v->supported & (SHADER_VARIANT_COUNT - 1);
+}
+
+/**
+ * Compila variantes em novos programas, sem alterar as já guardadas
+ *
+ * As variantes são compiladas em um único lote de installPrograms, que
+ * também as procura no cache de binários. Não usa o estado do contexto atual:
+ * pode ser chamada em uma thread com um contexto compartilhado.
+ *
+ * @param features Máscaras das variantes. Devem ser oferecidas pelo contexto
+ * @param count Quantidade de máscaras
+ * @param program Recebe o programa de cada máscara. 0 nas que falharam
+ * @return Quantidade de variantes que falharam
+ */
+int buildShaderVariants(const ShaderVariants *v, const uint *features,
+			uint count, GLuint *program)
+{
+	ProgramSource *src;
+	char (*defines)[VARIANT_DEFINES_MAX];
+	uint i;
+	int failed;
+
+	assert(NULL != v);
+	assert(NULL != features || 0 == count);
+	assert(NULL != program || 0 == count);
+
+	if ( 0 == count )
+		return 0;
+
+	src = calloc(count, sizeof(*src));
+	defines = malloc(count*sizeof(*defines));
+	for (i = 0; i < count; ++i) {
+		assert(features[i] == supportedShaderFeatures(v, features[i]));
+
+		buildDefines(v, features[i], defines[i]);
+		src[i].vertex = v->vertex;
+		src[i].fragment = v->fragment;
+		src[i].version = v->version;
+		src[i].defines = defines[i];
+	}
+
+	failed = installPrograms(src, count, program);
+
+	free(defines);
+	free(src);
+	return failed;
+}
+
+/**
+ * Compila, de uma vez, as variantes ainda não compiladas
+ *
+ * @param features Máscaras das variantes. Devem ser oferecidas pelo contexto
+ * @param count Quantidade de máscaras
+ * @return Quantidade de variantes que falharam
+ */
+int compileShaderVariants(ShaderVariants *v, const uint *features, uint count)
+{
+	uint *mask;
+	GLuint *program;
+	uint i, k, n = 0;
+	int failed;
+
+	assert(NULL != v);
+	assert(NULL != features || 0 == count);
+
+	if ( 0 == count )
+		return 0;
+	mask = malloc(count*sizeof(*mask));
+	program = malloc(count*sizeof(*program));
+
+	for (i = 0; i < count; ++i) {
+		assert(features[i] == supportedShaderFeatures(v, features[i]));
+
+		// Somente as que ainda não existem, cada uma uma vez
+		if ( 0 != v->program[features[i]] )
+			continue;
+		for (k = 0; k < n && mask[k] != features[i]; ++k)
+			;
+		if ( k < n )
+			continue;
+		mask[n++] = features[i];
+	}
+
+	failed = 0;
+	if ( n > 0 ) {
+		failed = buildShaderVariants(v, mask, n, program);
+		// A compilação não precisa da trava, somente a publicação
+		if ( NULL != v->lock )
+			pthread_mutex_lock(v->lock);
+		for (i = 0; i < n; ++i)
+			v->program[mask[i]] = program[i];
+		if ( NULL != v->lock )
+			pthread_mutex_unlock(v->lock);
+	}
+
+	free(program);
+	free(mask);
+	return failed;
+}
+
+/**
+ * Programa de uma combinação de recursos, compilado no primeiro pedido
+ *
+ * @param features Máscara de ShaderFeature. Recursos que o contexto não
+ *                 oferece são ignorados
+ * @return Programa ligado, ou 0 se a compilação falhou
+ */
+GLuint getShaderVariant(ShaderVariants *v, uint features)
+{
+	assert(NULL != v);
+
+	features = supportedShaderFeatures(v, features);
+	if ( 0 == v->program[features] )
+		compileShaderVariants(v, &features, 1);
+	return v->program[features];
+}
+
+void destroyShaderVariants(ShaderVariants *v)
+{
+	uint i;
+
+	assert(NULL != v);
+
+	if ( NULL != v->lock )
+		pthread_mutex_lock(v->lock);
+	for (i = 0; i < SHADER_VARIANT_COUNT; ++i)
+		if ( 0 != v->program[i] )
+			glDeleteProgram(v->program[i]);
+	memset(v->program, 0, sizeof(v->program));
+	if ( NULL != v->lock )
+		pthread_mutex_unlock(v->lock);
+}
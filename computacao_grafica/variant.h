@@ -0,0 +1,62 @@
+#ifndef __VARIANT_H
+#define __VARIANT_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+# include <pthread.h>
+
+/**
+ * Tamanho máximo dos nomes dos códigos fonte
+ */
+#define VARIANT_NAME_MAX	256
+
+/**
+ * @brief Recursos opcionais dos shaders, combinados em uma máscara
+ *
+ * Cada recurso vira uma definição do pré-processador no código fonte.
+ */
+typedef enum ShaderFeature
+{
+	SHADER_INSTANCING = 1 << 0,	/**< INSTANCING: transformação por instância, em um atributo */
+	SHADER_QUANTIZED = 1 << 1,	/**< QUANTIZED: posições convertidas pela uniform dequant */
+	SHADER_UBO_TRANSFORMS = 1 << 2,	/**< UBO_TRANSFORMS: transformação em um uniform block */
+	SHADER_ANIMATED = 1 << 3	/**< ANIMATED: giro calculado pelo shader, pelas uniforms time e spin */
+} ShaderFeature;
+
+/**
+ * Quantidade de combinações de recursos
+ */
+#define SHADER_VARIANT_COUNT	(1 << 4)
+
+/**
+ * @brief Programas gerados a partir de um mesmo par de códigos fonte
+ *
+ * Cada combinação de recursos é compilada somente quando pedida, e guardada
+ * pela sua máscara. Somente a thread do OpenGL muda os programas; se outra
+ * thread os lê, lock protege as mudanças.
+ */
+typedef struct ShaderVariants
+{
+	char		vertex[VARIANT_NAME_MAX];	/**< código fonte do shader vertex */
+	char		fragment[VARIANT_NAME_MAX];	/**< código fonte do shader fragment */
+	uint		version;			/**< versão GLSL inserida nos códigos */
+	uint		supported;			/**< recursos oferecidos pelo contexto */
+	GLuint		program[SHADER_VARIANT_COUNT];	/**< programa de cada máscara. 0 se não compilado */
+	pthread_mutex_t	*lock;				/**< trava de quem lê program em outra thread. Pode ser NULL */
+} ShaderVariants;
+
+int initShaderVariants(ShaderVariants *v, const char *vertex,
+		       const char *fragment);
+
+uint supportedShaderFeatures(const ShaderVariants *v, uint features);
+
+int buildShaderVariants(const ShaderVariants *v, const uint *features,
+			uint count, GLuint *program);
+
+int compileShaderVariants(ShaderVariants *v, const uint *features, uint count);
+
+GLuint getShaderVariant(ShaderVariants *v, uint features);
+
+void destroyShaderVariants(ShaderVariants *v);
+
+#endif
@@ -0,0 +1,136 @@
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "vertexformat.h"
+
+// Nome de cada atributo nos shaders, indexado por VertexAttribute
+static const char *attributeName[ATTRIB_COUNT] = {
+	"position",
+	"normal",
+	"color",
+	"texcoord"
+};
+
+/**
+ * Inicializa um formato sem nenhum atributo
+ *
+ * @param fmt Formato a ser inicializado
+ */
+void initVertexFormat(VertexFormat *fmt)
+{
+	assert(NULL != fmt);
+	memset(fmt, 0, sizeof(*fmt));
+}
+
+/**
+ * Tamanho, em bytes, de um componente do tipo informado
+ *
+ * @param type Tipo OpenGL do componente
+ * @return Tamanho em bytes. 0 para tipos não suportados
+ */
+GLsizei vertexTypeSize(GLenum type)
+{
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	case GL_INT:
+	case GL_UNSIGNED_INT:
+	case GL_FLOAT:
+		return 4;
+	}
+	return 0;
+}
+
+/**
+ * Acrescenta um atributo ao final do vértice
+ *
+ * O atributo é colocado depois dos já existentes e o tamanho do vértice é
+ * arredondado para múltiplos de 4 bytes, como recomendado pelos drivers.
+ *
+ * @param fmt Formato a ser modificado
+ * @param attrib Atributo acrescentado. Não pode estar presente
+ * @param size Quantidade de componentes, de 1 a 4
+ * @param type Tipo de cada componente
+ * @param normalized Se os inteiros devem ser normalizados
+ */
+void addVertexAttribute(VertexFormat *fmt, VertexAttribute attrib, GLint size,
+			GLenum type, GLboolean normalized)
+{
+	VertexElement *e;
+
+	assert(NULL != fmt);
+	assert(attrib < ATTRIB_COUNT);
+	assert(0 == fmt->attrib[attrib].size);
+	assert(size >= 1 && size <= 4);
+	assert(vertexTypeSize(type) > 0);
+
+	e = &fmt->attrib[attrib];
+	e->size = size;
+	e->type = type;
+	e->normalized = normalized;
+	e->offset = fmt->stride;
+
+	fmt->stride += (size*vertexTypeSize(type) + 3) & ~3;
+}
+
+/**
+ * Configura os atributos do vertex array atual a partir do formato
+ *
+ * O buffer de vértices deve estar associado a GL_ARRAY_BUFFER. Atributos
+ * ausentes são desabilitados.
+ *
+ * @param fmt Formato dos vértices no buffer
+ */
+void setupVertexFormat(const VertexFormat *fmt)
+{
+	int i;
+
+	assert(NULL != fmt);
+
+	for (i = 0; i < ATTRIB_COUNT; ++i) {
+		const VertexElement *e = &fmt->attrib[i];
+
+		if ( 0 == e->size ) {
+			glDisableVertexAttribArray(i);
+			continue;
+		}
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, e->size, e->type, e->normalized,
+				      fmt->stride, (GLvoid *) (uintptr_t) e->offset);
+	}
+}
+
+/**
+ * Nome de um atributo nos shaders
+ */
+const char* vertexAttributeName(VertexAttribute attrib)
+{
+	assert(attrib < ATTRIB_COUNT);
+	return attributeName[attrib];
+}
+
+/**
+ * Fixa a location de cada atributo conhecido, antes da ligação do programa
+ *
+ * Sem layout(location) no GLSL 1.20, o driver escolheria as locations, e os
+ * vertex arrays configurados por setupVertexFormat só funcionariam por sorte.
+ * Atributos ausentes no shader são ignorados pelo driver.
+ *
+ * @param program Programa ainda não ligado
+ */
+void bindVertexAttributes(GLuint program)
+{
+	uint i;
+
+	for (i = 0; i < ATTRIB_COUNT; ++i)
+		glBindAttribLocation(program, i, attributeName[i]);
+	glBindAttribLocation(program, ATTRIB_INSTANCE_TRANSFORM,
+			     "instanceTransformation");
+}
@@ -0,0 +1,60 @@
+#ifndef __VERTEXFORMAT_H
+#define __VERTEXFORMAT_H
+
+# include <GL/glew.h>
+# include <stdlib.h>
+
+/**
+ * @brief Atributos de vértice conhecidos
+ *
+ * O valor de cada atributo é também a sua location no shader vertex.
+ */
+typedef enum VertexAttribute
+{
+	ATTRIB_POSITION = 0,	/**< posição */
+	ATTRIB_NORMAL,		/**< vetor normal */
+	ATTRIB_COLOR,		/**< cor */
+	ATTRIB_TEXCOORD,	/**< coordenada de textura */
+	ATTRIB_COUNT
+} VertexAttribute;
+
+/**
+ * Location da transformação por instância, logo depois dos atributos de
+ * vértice. Uma mat4 ocupa quatro locations
+ */
+#define ATTRIB_INSTANCE_TRANSFORM	ATTRIB_COUNT
+
+/**
+ * @brief Como um atributo está guardado dentro de um vértice
+ */
+typedef struct VertexElement
+{
+	GLint		size;		/**< quantidade de componentes. 0 se ausente */
+	GLenum		type;		/**< tipo de cada componente */
+	GLboolean	normalized;	/**< se inteiros devem ser levados a [-1, 1] ou [0, 1] */
+	GLuint		offset;		/**< início do atributo dentro do vértice, em bytes */
+} VertexElement;
+
+/**
+ * @brief Descreve o layout de um vetor de vértices intercalados
+ */
+typedef struct VertexFormat
+{
+	VertexElement	attrib[ATTRIB_COUNT];	/**< cada atributo, indexado por VertexAttribute */
+	GLsizei		stride;			/**< tamanho de um vértice, em bytes */
+} VertexFormat;
+
+void initVertexFormat(VertexFormat *fmt);
+
+void addVertexAttribute(VertexFormat *fmt, VertexAttribute attrib, GLint size,
+			GLenum type, GLboolean normalized);
+
+GLsizei vertexTypeSize(GLenum type);
+
+void setupVertexFormat(const VertexFormat *fmt);
+
+const char* vertexAttributeName(VertexAttribute attrib);
+
+void bindVertexAttributes(GLuint program);
+
+#endif